@@ -0,0 +1,195 @@
+// Records a frame of 60000 objects in 15 batches, one command list each,
+// with one to hardware_concurrency threads: every batch lays out its
+// objects, culls them against the view and records a draw per visible
+// one, then sorts its list. Every list must hold as many commands with
+// any number of threads. The thread count to go up to may be given as the
+// only argument.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <thread>
+
+#include "command_buffer.hpp"
+#include "frustum_culling.hpp"
+#include "job_system.hpp"
+
+static constexpr std::size_t batchCount{CommandBuffer::maxLists - 1};
+static constexpr std::size_t objectsPerBatch{4000};
+static constexpr std::size_t objectCount{batchCount * objectsPerBatch};
+static constexpr int         frames{50};
+static constexpr float       worldSize{4.0f};
+
+// An orthographic view of [-2, 2] x [-1, 1], depth zero to one, normals
+// pointing inside.
+static constexpr float planes[6][4]{{1.0f, 0.0f, 0.0f, 2.0f},
+                                    {-1.0f, 0.0f, 0.0f, 2.0f},
+                                    {0.0f, 1.0f, 0.0f, 1.0f},
+                                    {0.0f, -1.0f, 0.0f, 1.0f},
+                                    {0.0f, 0.0f, 1.0f, 0.0f},
+                                    {0.0f, 0.0f, -1.0f, 1.0f}};
+
+static CommandBuffer commandBuffer;
+
+// Bounding spheres, all x, then all y, z and radii.
+static std::unique_ptr<float[]>         bounds;
+static std::unique_ptr<std::uint32_t[]> visible;
+
+// Lays out the batch's objects like the renderer does, on a grid over
+// several screens, then records their draws.
+static void RecordBatch(std::size_t batch, float time) noexcept
+{
+  const auto columns{static_cast<std::size_t>(
+    std::ceil(std::sqrt(static_cast<float>(objectCount))))};
+  const auto cell{2.0f * worldSize / static_cast<float>(columns)};
+  const auto first{batch * objectsPerBatch};
+  auto&      commands{commandBuffer.List(1 + batch)};
+
+  for (auto i{first}; i < first + objectsPerBatch; ++i) {
+    const auto phase{static_cast<float>(i) * 0.37f};
+
+    bounds[i] = -worldSize
+                + (static_cast<float>(i % columns) + 0.5f) * cell
+                + 0.5f * std::sin(time);
+    bounds[objectCount + i] = -worldSize
+                              + (static_cast<float>(i / columns) + 0.5f)
+                                  * cell;
+    bounds[2 * objectCount + i] = 0.3f + 0.6f * (phase - std::floor(phase));
+    bounds[3 * objectCount + i] = cell
+                                  * (0.3f + 0.1f * std::sin(time + phase));
+  }
+
+  const auto pVisible{visible.get() + first};
+  const auto count{CullSpheres({bounds.get() + first,
+                                bounds.get() + objectCount + first,
+                                bounds.get() + 2 * objectCount + first,
+                                bounds.get() + 3 * objectCount + first,
+                                objectsPerBatch},
+                               planes,
+                               pVisible)};
+
+  for (std::size_t i{0}; i < count; ++i) {
+    const auto object{first + pVisible[i]};
+    const auto mesh{static_cast<std::uint32_t>(object % 3)};
+    const auto depth{static_cast<std::uint32_t>(
+      bounds[2 * objectCount + object] * 16777215.0f)};
+
+    commands.Record(MakeSortKey(RenderPass::opaque, 1, mesh, depth),
+                    DrawCommand{.program              = 1,
+                                .vertexArray          = 1,
+                                .state                = drawStateDepthTest,
+                                .mode                 = GL_TRIANGLES,
+                                .indexType            = GL_UNSIGNED_INT,
+                                .first                = 0,
+                                .count                = 12,
+                                .instanceCount        = 1,
+                                .baseVertex           = 0,
+                                .firstInstanceUniform = -1,
+                                .firstInstance =
+                                  static_cast<GLint>(object)});
+  }
+
+  commands.Sort();
+}
+
+int main(int argc, char** argv)
+{
+  using Clock = std::chrono::steady_clock;
+
+  const auto maxThreads{
+    1 < argc ? static_cast<unsigned>(std::max(std::atoi(argv[1]), 1))
+             : std::max(std::thread::hardware_concurrency(), 1u)};
+  std::size_t expected[batchCount]{};
+  double      baseline{0};
+
+  bounds.reset(new (std::nothrow) float[4 * objectCount]);
+  visible.reset(new (std::nothrow) std::uint32_t[objectCount]);
+  if (!bounds || !visible) {
+    std::fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+
+  std::printf("%zu objects in %zu batches, %d frames\n",
+              objectCount,
+              batchCount,
+              frames);
+
+  for (unsigned threads{1}; threads <= maxThreads; ++threads) {
+    // Start(0) would mean one worker per core.
+    if (1 < threads) {
+      jobSystem.Start(threads - 1);
+    }
+    else {
+      jobSystem.Stop();
+    }
+
+    std::size_t recorded{0};
+
+    const auto start{Clock::now()};
+    for (auto frame{0}; frame < frames; ++frame) {
+      const auto time{static_cast<float>(frame) / 60.0f};
+
+      jobSystem.ParallelFor("record",
+                            batchCount,
+                            1,
+                            [time](std::size_t begin, std::size_t end) {
+                              for (auto batch{begin}; batch < end; ++batch) {
+                                RecordBatch(batch, time);
+                              }
+                            });
+
+      // The lists of the last frame are checked against those of the
+      // first run.
+      if (frames - 1 == frame) {
+        for (std::size_t batch{0}; batch < batchCount; ++batch) {
+          const auto count{commandBuffer.List(1 + batch).Count()};
+
+          if (1 == threads) {
+            expected[batch] = count;
+          }
+          else if (expected[batch] != count) {
+            std::fprintf(stderr,
+                         "mismatch: batch %zu has %zu command(s) with %u "
+                         "thread(s), %zu with one\n",
+                         batch,
+                         count,
+                         threads,
+                         expected[batch]);
+            return 1;
+          }
+        }
+      }
+
+      for (std::size_t batch{0}; batch < batchCount; ++batch) {
+        recorded += commandBuffer.List(1 + batch).Count();
+      }
+      commandBuffer.Reset();
+    }
+    const auto end{Clock::now()};
+
+    const auto milliseconds{
+      std::chrono::duration<double, std::milli>{end - start}.count()
+      / frames};
+
+    if (1 == threads) {
+      baseline = milliseconds;
+    }
+
+    std::printf("%2u thread(s): %6.3f ms per frame, %5.2fx, %.1f M "
+                "commands/s\n",
+                threads,
+                milliseconds,
+                baseline / milliseconds,
+                static_cast<double>(recorded) / frames / milliseconds
+                  / 1000.0);
+  }
+
+  jobSystem.Stop();
+
+  return 0;
+}
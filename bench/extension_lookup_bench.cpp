@@ -0,0 +1,155 @@
+// Compares capability queries against a 400 entry extension string: the
+// linear scan HasExtension used to do per query, and ExtensionSet, which
+// tokenizes the string once.
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "extensions.hpp"
+
+static constexpr int extensionCount{400};
+static constexpr int iterations{20000};
+
+// The scan the WGL path did for every query.
+static bool HasExtension(const char* extensionsString,
+                         const char* extension) noexcept
+{
+  const auto n{std::strlen(extension)};
+
+  while (*extensionsString) {
+    const auto i{std::strcspn(extensionsString, " ")};
+
+    if (i == n && 0 == std::strncmp(extensionsString, extension, n)) {
+      return true;
+    }
+
+    extensionsString += i;
+    while (' ' == *extensionsString) {
+      ++extensionsString;
+    }
+  }
+
+  return false;
+}
+
+// Vendor prefixes and names the way drivers spell them, with the queried
+// extensions spread through the string.
+static std::string MakeExtensionsString()
+{
+  static constexpr const char* vendors[]{
+    "ARB", "EXT", "KHR", "NV", "AMD", "INTEL", "OES", "MESA"};
+  static constexpr const char* features[]{"texture_compression",
+                                          "shader_atomic_counters",
+                                          "draw_buffers_blend",
+                                          "sample_shading",
+                                          "vertex_attrib_binding",
+                                          "buffer_storage",
+                                          "sparse_texture",
+                                          "gpu_shader_int64"};
+  static constexpr const char* known[]{"GL_ARB_indirect_parameters",
+                                       "GL_KHR_parallel_shader_compile",
+                                       "GL_ARB_multi_draw_indirect",
+                                       "GL_ARB_get_program_binary",
+                                       "GL_ARB_compute_shader",
+                                       "GL_ARB_buffer_storage"};
+  std::string text;
+  auto        nKnown{0};
+
+  for (auto i{0}; i < extensionCount; ++i) {
+    if (i % (extensionCount / 6) == extensionCount / 12 && nKnown < 6) {
+      text += known[nKnown++];
+    }
+    else {
+      text += "GL_";
+      text += vendors[i % 8];
+      text += '_';
+      text += features[(i / 8) % 8];
+      text += '_';
+      text += std::to_string(i);
+    }
+    text += ' ';
+  }
+
+  return text;
+}
+
+int main()
+{
+  using Clock = std::chrono::steady_clock;
+
+  // Half of the queries miss, which scans the whole string.
+  static constexpr const char* queries[]{"GL_ARB_indirect_parameters",
+                                         "GL_KHR_parallel_shader_compile",
+                                         "GL_ARB_multi_draw_indirect",
+                                         "GL_ARB_get_program_binary",
+                                         "GL_ARB_compute_shader",
+                                         "GL_ARB_buffer_storage",
+                                         "GL_NV_mesh_shader",
+                                         "GL_EXT_mesh_shader",
+                                         "GL_ARB_bindless_texture",
+                                         "GL_NV_command_list",
+                                         "GL_AMD_gpu_shader_half_float",
+                                         "GL_ARB_shader_clock"};
+  static constexpr auto queryCount{sizeof queries / sizeof queries[0]};
+  const auto            text{MakeExtensionsString()};
+  std::uint64_t         hashes[queryCount]{};
+  ExtensionSet          set;
+  std::size_t           scanHits{0};
+  std::size_t           setHits{0};
+
+  for (std::size_t i{0}; i < queryCount; ++i) {
+    hashes[i] = HashExtension(queries[i]);
+  }
+
+  const auto tokenizeStart{Clock::now()};
+  for (auto i{0}; i < iterations; ++i) {
+    set.Clear();
+    set.InsertAll(text.c_str());
+  }
+  const auto tokenizeEnd{Clock::now()};
+
+  for (auto i{0}; i < iterations; ++i) {
+    for (const auto query : queries) {
+      scanHits += HasExtension(text.c_str(), query);
+    }
+  }
+  const auto scanEnd{Clock::now()};
+
+  for (auto i{0}; i < iterations; ++i) {
+    for (const auto hash : hashes) {
+      setHits += set.Contains(hash);
+    }
+  }
+  const auto setEnd{Clock::now()};
+
+  const auto nanoseconds{[](Clock::duration duration, double count) {
+    return std::chrono::duration<double, std::nano>{duration}.count()
+           / count;
+  }};
+  const auto queriesRun{static_cast<double>(iterations * queryCount)};
+
+  if (scanHits != setHits
+      || static_cast<std::size_t>(extensionCount) != set.Size()) {
+    std::fprintf(stderr,
+                 "mismatch: %zu scan hit(s), %zu set hit(s), %zu in set\n",
+                 scanHits,
+                 setHits,
+                 set.Size());
+    return 1;
+  }
+
+  std::printf("%d extensions, %zu queries, %zu hit(s) per round\n",
+              extensionCount,
+              queryCount,
+              setHits / iterations);
+  std::printf("tokenize once: %.1f ns\n",
+              nanoseconds(tokenizeEnd - tokenizeStart, iterations));
+  std::printf("linear scan:   %.1f ns per query\n",
+              nanoseconds(scanEnd - tokenizeEnd, queriesRun));
+  std::printf("hashed set:    %.1f ns per query\n",
+              nanoseconds(setEnd - scanEnd, queriesRun));
+
+  return 0;
+}
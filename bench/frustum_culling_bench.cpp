@@ -0,0 +1,188 @@
+// Culls a million bounding spheres against a view frustum: a naive loop
+// over an array of structures, every instruction set the CPU supports on
+// one thread over the structure-of-arrays layout, and CullSpheres, which
+// splits the work across the job system. Every kernel must find the very
+// spheres the naive loop finds.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <new>
+
+#include "frustum_culling.hpp"
+#include "job_system.hpp"
+
+static constexpr std::size_t sphereCount{1'000'000};
+static constexpr int         iterations{20};
+
+struct Sphere {
+  float x;
+  float y;
+  float z;
+  float radius;
+};
+
+// A perspective frustum looking down -z with a 90 degree field of view,
+// from 1 to 100, normals pointing inside and normalised.
+static constexpr float planes[6][4]{{0.70710678f, 0.0f, -0.70710678f, 0.0f},
+                                    {-0.70710678f, 0.0f, -0.70710678f, 0.0f},
+                                    {0.0f, 0.70710678f, -0.70710678f, 0.0f},
+                                    {0.0f, -0.70710678f, -0.70710678f, 0.0f},
+                                    {0.0f, 0.0f, -1.0f, -1.0f},
+                                    {0.0f, 0.0f, 1.0f, 100.0f}};
+
+// The loop culling usually starts out as, with the same comparison as the
+// kernels so that they agree on spheres touching a plane.
+static std::size_t CullNaive(const Sphere*  pSpheres,
+                             std::size_t    count,
+                             std::uint32_t* pVisible) noexcept
+{
+  std::size_t visible{0};
+
+  for (std::size_t i{0}; i < count; ++i) {
+    const auto& sphere{pSpheres[i]};
+    auto        bInside{true};
+
+    for (const auto& plane : planes) {
+      if (plane[0] * sphere.x + plane[1] * sphere.y + plane[2] * sphere.z
+            + plane[3]
+          < -sphere.radius) {
+        bInside = false;
+        break;
+      }
+    }
+
+    if (bInside) {
+      pVisible[visible++] = static_cast<std::uint32_t>(i);
+    }
+  }
+
+  return visible;
+}
+
+int main()
+{
+  using Clock = std::chrono::steady_clock;
+
+  const std::unique_ptr<Sphere[]> spheres{new (std::nothrow)
+                                            Sphere[sphereCount]};
+  const std::unique_ptr<float[]>  soa{new (std::nothrow)
+                                       float[4 * sphereCount]};
+  const std::unique_ptr<std::uint32_t[]> expected{
+    new (std::nothrow) std::uint32_t[sphereCount]};
+  const std::unique_ptr<std::uint32_t[]> visible{
+    new (std::nothrow) std::uint32_t[sphereCount]};
+  if (!spheres || !soa || !expected || !visible) {
+    std::fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+
+  // Spread over a cube around the frustum, so that some spheres straddle
+  // every plane.
+  std::uint32_t random{1};
+
+  const auto next{[&random](float low, float high) {
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+    return low + (high - low) * static_cast<float>(random >> 8) / 16777216.0f;
+  }};
+
+  for (std::size_t i{0}; i < sphereCount; ++i) {
+    spheres[i] = {next(-120.0f, 120.0f),
+                  next(-120.0f, 120.0f),
+                  next(-120.0f, 20.0f),
+                  next(0.1f, 4.0f)};
+
+    soa[i]                   = spheres[i].x;
+    soa[sphereCount + i]     = spheres[i].y;
+    soa[2 * sphereCount + i] = spheres[i].z;
+    soa[3 * sphereCount + i] = spheres[i].radius;
+  }
+
+  const SphereBounds bounds{soa.get(),
+                            soa.get() + sphereCount,
+                            soa.get() + 2 * sphereCount,
+                            soa.get() + 3 * sphereCount,
+                            sphereCount};
+  std::size_t        expectedCount{0};
+
+  const auto milliseconds{[](Clock::duration duration) {
+    return std::chrono::duration<double, std::milli>{duration}.count()
+           / iterations;
+  }};
+
+  auto start{Clock::now()};
+  for (auto i{0}; i < iterations; ++i) {
+    expectedCount = CullNaive(spheres.get(), sphereCount, expected.get());
+  }
+  const auto naive{milliseconds(Clock::now() - start)};
+
+  std::printf("%zu spheres, %zu visible\n", sphereCount, expectedCount);
+  std::printf("naive AoS:     %7.3f ms\n", naive);
+
+  const auto check{[&](const char* name, std::size_t count) {
+    if (count != expectedCount
+        || 0 != std::memcmp(visible.get(),
+                            expected.get(),
+                            count * sizeof(std::uint32_t))) {
+      std::fprintf(stderr,
+                   "mismatch: %s found %zu sphere(s), the naive loop %zu\n",
+                   name,
+                   count,
+                   expectedCount);
+      return false;
+    }
+    return true;
+  }};
+
+  // The detected instruction set and every narrower one.
+  for (auto isa{static_cast<int>(DetectCullingIsa())};
+       isa <= static_cast<int>(CullingIsa::scalar);
+       ++isa) {
+    const auto  cullingIsa{static_cast<CullingIsa>(isa)};
+    std::size_t count{0};
+
+    start = Clock::now();
+    for (auto i{0}; i < iterations; ++i) {
+      count = CullSphereRange(
+        cullingIsa, bounds, planes, 0, sphereCount, visible.get());
+    }
+    const auto elapsed{milliseconds(Clock::now() - start)};
+
+    if (!check(CullingIsaName(cullingIsa), count)) {
+      return 1;
+    }
+
+    std::printf("%-8s SoA:  %7.3f ms, %5.2fx\n",
+                CullingIsaName(cullingIsa),
+                elapsed,
+                naive / elapsed);
+  }
+
+  jobSystem.Start(0);
+
+  const auto  threads{jobSystem.WorkerCount() + 1};
+  std::size_t count{0};
+
+  start = Clock::now();
+  for (auto i{0}; i < iterations; ++i) {
+    count = CullSpheres(bounds, planes, visible.get());
+  }
+  const auto elapsed{milliseconds(Clock::now() - start)};
+
+  jobSystem.Stop();
+
+  if (!check("CullSpheres", count)) {
+    return 1;
+  }
+
+  std::printf("%u thread(s):   %7.3f ms, %5.2fx\n",
+              threads,
+              elapsed,
+              naive / elapsed);
+
+  return 0;
+}
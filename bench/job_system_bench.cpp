@@ -0,0 +1,131 @@
+// Runs the same ParallelFor workload with one to hardware_concurrency
+// threads, restarting the job system in between, and reports the speedup
+// over the calling thread alone. A second loop spawns empty child jobs to
+// measure the scheduling overhead per job. The thread count to go up to
+// may be given as the only argument.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include "job_system.hpp"
+
+static constexpr std::size_t itemCount{1 << 20};
+static constexpr std::size_t grain{1024};
+static constexpr int         rounds{20};
+static constexpr int         emptyJobs{2048};
+
+// Enough arithmetic per item that the loop is not bound by memory.
+static std::uint64_t Work(std::size_t item) noexcept
+{
+  auto x{static_cast<std::uint64_t>(item) * 0x9E3779B97F4A7C15ull + 1};
+
+  for (auto i{0}; i < 64; ++i) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+  }
+
+  return x;
+}
+
+int main(int argc, char** argv)
+{
+  using Clock = std::chrono::steady_clock;
+
+  const auto maxThreads{
+    1 < argc ? static_cast<unsigned>(std::max(std::atoi(argv[1]), 1))
+             : std::max(std::thread::hardware_concurrency(), 1u)};
+  std::uint64_t expected{0};
+  double        baseline{0};
+
+  for (std::size_t i{0}; i < itemCount; ++i) {
+    expected += Work(i);
+  }
+
+  std::printf("%zu items, %zu per chunk, %d rounds\n",
+              itemCount,
+              grain,
+              rounds);
+
+  for (unsigned threads{1}; threads <= maxThreads; ++threads) {
+    // Start(0) would mean one worker per core.
+    if (1 < threads) {
+      jobSystem.Start(threads - 1);
+    }
+    else {
+      jobSystem.Stop();
+    }
+
+    if (jobSystem.WorkerCount() != threads - 1) {
+      std::fprintf(stderr,
+                   "mismatch: %u worker(s) for %u thread(s)\n",
+                   jobSystem.WorkerCount(),
+                   threads);
+      return 1;
+    }
+
+    std::atomic<std::uint64_t> sum{0};
+
+    const auto start{Clock::now()};
+    for (auto round{0}; round < rounds; ++round) {
+      sum.store(0, std::memory_order_relaxed);
+      jobSystem.ParallelFor("bench",
+                            itemCount,
+                            grain,
+                            [&sum](std::size_t begin, std::size_t end) {
+                              std::uint64_t partial{0};
+                              for (auto i{begin}; i < end; ++i) {
+                                partial += Work(i);
+                              }
+                              sum.fetch_add(partial,
+                                            std::memory_order_relaxed);
+                            });
+
+      if (expected != sum.load(std::memory_order_relaxed)) {
+        std::fprintf(stderr,
+                     "mismatch: wrong sum with %u thread(s)\n",
+                     threads);
+        return 1;
+      }
+    }
+    const auto forEnd{Clock::now()};
+
+    for (auto round{0}; round < rounds; ++round) {
+      const auto pRoot{jobSystem.Create("root", [] {})};
+
+      for (auto i{0}; i < emptyJobs; ++i) {
+        jobSystem.Run(jobSystem.Create("empty", [] {}, pRoot));
+      }
+
+      jobSystem.Run(pRoot);
+      jobSystem.Wait(pRoot);
+    }
+    const auto spawnEnd{Clock::now()};
+
+    const auto milliseconds{
+      std::chrono::duration<double, std::milli>{forEnd - start}.count()
+      / rounds};
+    const auto jobNanoseconds{
+      std::chrono::duration<double, std::nano>{spawnEnd - forEnd}.count()
+      / (rounds * emptyJobs)};
+
+    if (1 == threads) {
+      baseline = milliseconds;
+    }
+
+    std::printf("%2u thread(s): %7.2f ms, %5.2fx, %6.1f ns per empty job\n",
+                threads,
+                milliseconds,
+                baseline / milliseconds,
+                jobNanoseconds);
+  }
+
+  jobSystem.Stop();
+
+  return 0;
+}
@@ -0,0 +1,344 @@
+// Draws growing numbers of objects with each path of the mesh batcher on
+// a headless EGL context: a draw per object, one instanced draw per mesh
+// and batch, and one glMultiDrawElementsIndirect per batch. Every object
+// is on screen and none overlaps another, so that no path culls any. The
+// frames are split into as many batches as there are command lists. Per
+// frame it prints the draw calls, the time to record and submit them and
+// the time until the GPU finished, which glFinish waits for. Multi-draw
+// is skipped below OpenGL 4.3. Needs EGL_KHR_create_context and
+// EGL_KHR_surfaceless_context.
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+
+#include "command_buffer.hpp"
+#include "frame_arena.hpp"
+#include "gl.hpp"
+#include "mesh_batcher.hpp"
+#include "state_cache.hpp"
+#include "stream_buffer.hpp"
+
+static constexpr std::size_t objectCounts[]{256, 1024, 4096, 16384};
+static constexpr std::size_t batchCount{std::min(MeshBatcher::maxBatches,
+                                                 CommandBuffer::maxLists
+                                                   - 1)};
+static constexpr int         warmUpFrames{10};
+static constexpr int         frames{50};
+static constexpr GLsizei     width{1280};
+static constexpr GLsizei     height{720};
+
+static CommandBuffer commandBuffer;
+static StreamBuffer  streamBuffer;
+static MeshBatcher   batcher;
+static int           meshes[3]{-1, -1, -1};
+
+static GlProc GetGlProcAddress(const char* name) noexcept
+{
+  return reinterpret_cast<GlProc>(eglGetProcAddress(name));
+}
+
+// A core context of the newest version the driver creates, current
+// without a surface.
+static bool CreateContext(EGLDisplay* pDisplay, EGLContext* pContext) noexcept
+{
+  const int  glVersions[]{46, 45, 44, 43, 42, 41, 40, 33};
+  EGLConfig  config{nullptr};
+  EGLint     nNumConfigs{0};
+  EGLDisplay display{eglGetDisplay(EGL_DEFAULT_DISPLAY)};
+
+#if defined(EGL_EXT_platform_base) && defined(EGL_MESA_platform_surfaceless)
+  if (const auto pfneglGetPlatformDisplayEXT{
+        reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+          eglGetProcAddress("eglGetPlatformDisplayEXT"))}) {
+    display = pfneglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA,
+                                          EGL_DEFAULT_DISPLAY,
+                                          nullptr);
+  }
+#endif
+
+  const EGLint configAttribs[]{EGL_SURFACE_TYPE,
+                               0,
+                               EGL_RENDERABLE_TYPE,
+                               EGL_OPENGL_BIT,
+                               EGL_NONE};
+
+  if (EGL_NO_DISPLAY == display || !eglInitialize(display, nullptr, nullptr)
+      || !eglBindAPI(EGL_OPENGL_API)
+      || !eglChooseConfig(display, configAttribs, &config, 1, &nNumConfigs)
+      || !nNumConfigs) {
+    return false;
+  }
+
+  *pDisplay = display;
+  *pContext = EGL_NO_CONTEXT;
+  for (const auto version : glVersions) {
+    const EGLint attribList[]{EGL_CONTEXT_MAJOR_VERSION_KHR,
+                              version / 10,
+                              EGL_CONTEXT_MINOR_VERSION_KHR,
+                              version % 10,
+                              EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR,
+                              EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+                              EGL_NONE};
+
+    *pContext = eglCreateContext(display, config, EGL_NO_CONTEXT, attribList);
+    if (EGL_NO_CONTEXT != *pContext) {
+      break;
+    }
+  }
+
+  return EGL_NO_CONTEXT != *pContext
+         && eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, *pContext);
+}
+
+// Without a surface the default framebuffer is incomplete.
+static bool CreateFramebuffer(GLuint* pFramebuffer,
+                              GLuint  renderbuffers[2]) noexcept
+{
+  glGenRenderbuffers(2, renderbuffers);
+  glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glGenFramebuffers(1, pFramebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, *pFramebuffer);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER,
+                            GL_COLOR_ATTACHMENT0,
+                            GL_RENDERBUFFER,
+                            renderbuffers[0]);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER,
+                            GL_DEPTH_STENCIL_ATTACHMENT,
+                            GL_RENDERBUFFER,
+                            renderbuffers[1]);
+
+  return GL_FRAMEBUFFER_COMPLETE == glCheckFramebufferStatus(GL_FRAMEBUFFER);
+}
+
+// Appends a regular polygon around the origin as a triangle fan.
+static int AddPolygon(int sides) noexcept
+{
+  MeshVertex    vertices[8]{};
+  std::uint32_t indices[3 * 6]{};
+
+  for (auto i{0}; i < sides; ++i) {
+    const auto angle{6.2831853f * static_cast<float>(i)
+                     / static_cast<float>(sides)};
+
+    vertices[i] = {std::cos(angle), std::sin(angle)};
+  }
+  for (auto i{0}; i < sides - 2; ++i) {
+    indices[3 * i]     = 0;
+    indices[3 * i + 1] = static_cast<std::uint32_t>(i + 1);
+    indices[3 * i + 2] = static_cast<std::uint32_t>(i + 2);
+  }
+
+  return batcher.AddMesh(vertices,
+                         static_cast<std::size_t>(sides),
+                         indices,
+                         static_cast<std::size_t>(3 * (sides - 2)));
+}
+
+// Objects on a square grid over the whole clip space, each inside its
+// cell.
+static void AddObjects(std::size_t objectCount) noexcept
+{
+  const auto columns{static_cast<std::size_t>(
+    std::ceil(std::sqrt(static_cast<float>(objectCount))))};
+  const auto cell{2.0f / static_cast<float>(columns)};
+
+  for (std::size_t i{0}; i < objectCount; ++i) {
+    const auto phase{static_cast<float>(i) * 0.37f};
+
+    batcher.Add(
+      i,
+      meshes[i % std::size(meshes)],
+      MeshInstance{-1.0f + (static_cast<float>(i % columns) + 0.5f) * cell,
+                   -1.0f + (static_cast<float>(i / columns) + 0.5f) * cell,
+                   0.1f + 0.8f * (phase - std::floor(phase)),
+                   0.45f * cell,
+                   {0.5f + 0.5f * std::sin(phase),
+                    0.5f + 0.5f * std::sin(phase + 2.1f),
+                    0.5f + 0.5f * std::sin(phase + 4.2f),
+                    1.0f}});
+  }
+}
+
+// Renders a frame like the renderer does, returning the draw calls.
+static std::size_t RenderFrame(std::size_t objectCount) noexcept
+{
+  // Clip space is the world, depth zero to one mapped to the near and far
+  // planes.
+  static constexpr GLfloat viewProjection[16]{1.0f,
+                                              0.0f,
+                                              0.0f,
+                                              0.0f,
+                                              0.0f,
+                                              1.0f,
+                                              0.0f,
+                                              0.0f,
+                                              0.0f,
+                                              0.0f,
+                                              2.0f,
+                                              0.0f,
+                                              0.0f,
+                                              0.0f,
+                                              -1.0f,
+                                              1.0f};
+  std::size_t draws{0};
+
+  frameArena.BeginFrame();
+  streamBuffer.BeginFrame();
+
+  auto& commands{commandBuffer.List(0)};
+
+  commands.Record(MakeSortKey(RenderPass::clear, 0, 0, 0),
+                  ViewportCommand{0, 0, width, height});
+  commands.Record(MakeSortKey(RenderPass::clear, 0, 0, 1),
+                  ClearCommand{GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT,
+                               {0.25f, 0.5f, 1.0f, 1.0f},
+                               1.0,
+                               0});
+
+  batcher.SetCamera(viewProjection);
+  batcher.BeginFrame();
+  AddObjects(objectCount);
+
+  const auto key{MakeSortKey(RenderPass::opaque, batcher.Program(), 0, 0)};
+
+  for (std::size_t batch{0}; batch < batchCount; ++batch) {
+    const auto first{objectCount * batch / batchCount};
+    const auto count{objectCount * (batch + 1) / batchCount - first};
+
+    batcher.Submit(streamBuffer,
+                   commandBuffer.List(1 + batch),
+                   key,
+                   batch,
+                   first,
+                   count);
+    draws += commandBuffer.List(1 + batch).Draws();
+  }
+
+  streamBuffer.Commit();
+  batcher.Cull();
+  commandBuffer.Execute();
+  batcher.CaptureDepth(width, height);
+  streamBuffer.EndFrame();
+
+  return draws;
+}
+
+int main()
+{
+  using Clock = std::chrono::steady_clock;
+
+  constexpr struct {
+    MeshDrawPath path;
+    const char*  name;
+  } paths[]{{MeshDrawPath::perInstance, "per object"},
+            {MeshDrawPath::instanced, "instanced"},
+            {MeshDrawPath::multiDraw, "multi-draw"}};
+
+  EGLDisplay display{EGL_NO_DISPLAY};
+  EGLContext context{EGL_NO_CONTEXT};
+  GLuint     framebuffer{0};
+  GLuint     renderbuffers[2]{};
+  auto       nExitCode{EXIT_FAILURE};
+
+  if (!CreateContext(&display, &context) || !LoadGl(&GetGlProcAddress)) {
+    std::fprintf(stderr, "failed to create an OpenGL context\n");
+    return EXIT_FAILURE;
+  }
+
+  InstallStateCache();
+
+  if (!CreateFramebuffer(&framebuffer, renderbuffers)
+      || !frameArena.Init(FrameArena::defaultBytesPerFrame, 1)
+      || !streamBuffer.Init(std::size_t{1} << 22, 3)) {
+    std::fprintf(stderr, "failed to create the frame resources\n");
+    goto release;
+  }
+
+  std::printf("OpenGL %d.%d, %zu batches, %d frames\n",
+              glVersion / 10,
+              glVersion % 10,
+              batchCount,
+              frames);
+
+  for (const auto& path : paths) {
+    if (MeshDrawPath::multiDraw == path.path
+        && (GL_DISPATCH_VERSION < 43 || glVersion < 43)) {
+      std::printf("%-10s  skipped, needs OpenGL 4.3\n", path.name);
+      continue;
+    }
+
+    for (const auto objectCount : objectCounts) {
+      if (!batcher.Init(streamBuffer, 64, 64, objectCount, path.path)) {
+        std::fprintf(stderr, "failed to initialize the mesh batcher\n");
+        goto release;
+      }
+
+      meshes[0] = AddPolygon(3);
+      meshes[1] = AddPolygon(4);
+      meshes[2] = AddPolygon(6);
+
+      // Until the programs are linked and cached in the driver.
+      for (auto frame{0}; frame < warmUpFrames; ++frame) {
+        RenderFrame(objectCount);
+        glFinish();
+      }
+
+      std::size_t     draws{0};
+      Clock::duration submitted{};
+      Clock::duration finished{};
+
+      for (auto frame{0}; frame < frames; ++frame) {
+        const auto start{Clock::now()};
+
+        draws = RenderFrame(objectCount);
+
+        const auto end{Clock::now()};
+
+        glFinish();
+        submitted += end - start;
+        finished  += Clock::now() - start;
+      }
+
+      batcher.Release();
+
+      std::printf(
+        "%-10s %6zu objects: %6zu draw calls, %8.3f ms submitted, "
+        "%8.3f ms finished\n",
+        path.name,
+        objectCount,
+        draws,
+        std::chrono::duration<double, std::milli>{submitted}.count() / frames,
+        std::chrono::duration<double, std::milli>{finished}.count() / frames);
+    }
+  }
+
+  nExitCode = EXIT_SUCCESS;
+
+release:
+  batcher.Release();
+  streamBuffer.Release();
+  frameArena.Release();
+  if (framebuffer) {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(2, renderbuffers);
+  }
+  eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglDestroyContext(display, context);
+  eglTerminate(display);
+
+  return nExitCode;
+}
@@ -0,0 +1,326 @@
+#include "command_buffer.hpp"
+#include "gpu_profiler.hpp"
+#include "log.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+
+static const char* const renderPassNames[renderPassCount]{
+  "clear",
+  "opaque",
+  "blended",
+  "overlay",
+};
+
+static void SetCapability(GLenum capability, bool bEnable) noexcept
+{
+  // Redundant calls are elided by the state cache.
+  if (bEnable) {
+    glEnable(capability);
+  }
+  else {
+    glDisable(capability);
+  }
+}
+
+static void Run(const ClearCommand& command) noexcept
+{
+  if (command.mask & GL_COLOR_BUFFER_BIT) {
+    glClearColor(command.color[0],
+                 command.color[1],
+                 command.color[2],
+                 command.color[3]);
+  }
+  if (command.mask & GL_DEPTH_BUFFER_BIT) {
+    glClearDepth(command.depth);
+  }
+  if (command.mask & GL_STENCIL_BUFFER_BIT) {
+    glClearStencil(command.stencil);
+  }
+
+  glClear(command.mask);
+}
+
+static void Run(const ViewportCommand& command) noexcept
+{
+  glViewport(command.x, command.y, command.width, command.height);
+}
+
+static void Run(const BindBufferCommand& command) noexcept
+{
+  glBindBufferRange(command.target,
+                    command.index,
+                    command.buffer,
+                    command.offset,
+                    command.size);
+}
+
+static void ApplyDrawState(GLuint        program,
+                           GLuint        vertexArray,
+                           std::uint32_t state) noexcept
+{
+  SetCapability(GL_DEPTH_TEST, state & drawStateDepthTest);
+  SetCapability(GL_BLEND, state & drawStateBlend);
+  SetCapability(GL_CULL_FACE, state & drawStateCullFace);
+  glUseProgram(program);
+  glBindVertexArray(vertexArray);
+}
+
+static void Run(const DrawCommand& command) noexcept
+{
+  ApplyDrawState(command.program, command.vertexArray, command.state);
+
+  if (0 <= command.firstInstanceUniform) {
+    glUniform1i(command.firstInstanceUniform, command.firstInstance);
+  }
+
+  if (!command.indexType) {
+    glDrawArraysInstanced(command.mode,
+                          command.first,
+                          command.count,
+                          command.instanceCount);
+    return;
+  }
+
+  const auto indexSize{GL_UNSIGNED_INT == command.indexType     ? 4
+                       : GL_UNSIGNED_SHORT == command.indexType ? 2
+                                                                : 1};
+  const auto pIndices{reinterpret_cast<const void*>(
+    static_cast<std::uintptr_t>(command.first) * indexSize)};
+
+  glDrawElementsInstancedBaseVertex(command.mode,
+                                    command.count,
+                                    command.indexType,
+                                    pIndices,
+                                    command.instanceCount,
+                                    command.baseVertex);
+}
+
+bool CanDrawIndirectCount() noexcept
+{
+#if GL_DISPATCH_VERSION >= 46
+  if (glMultiDrawElementsIndirectCount) {
+    return true;
+  }
+#endif
+#ifdef glMultiDrawElementsIndirectCountARB
+  if (glMultiDrawElementsIndirectCountARB) {
+    return true;
+  }
+#endif
+
+  return false;
+}
+
+#if GL_DISPATCH_VERSION >= 43
+// The core entry point of OpenGL 4.6 if loaded, else the extension's.
+static void MultiDrawElementsIndirectCount(
+  const MultiDrawCommand& command) noexcept
+{
+  [[maybe_unused]] const auto pIndirect{
+    reinterpret_cast<const void*>(command.indirectOffset)};
+
+#if GL_DISPATCH_VERSION >= 46
+  if (glMultiDrawElementsIndirectCount) {
+    glMultiDrawElementsIndirectCount(command.mode,
+                                     command.indexType,
+                                     pIndirect,
+                                     command.parameterOffset,
+                                     command.drawCount,
+                                     command.stride);
+    return;
+  }
+#endif
+#ifdef glMultiDrawElementsIndirectCountARB
+  if (glMultiDrawElementsIndirectCountARB) {
+    glMultiDrawElementsIndirectCountARB(command.mode,
+                                        command.indexType,
+                                        pIndirect,
+                                        command.parameterOffset,
+                                        command.drawCount,
+                                        command.stride);
+  }
+#endif
+}
+#endif
+
+static void Run(const MultiDrawCommand& command) noexcept
+{
+#if GL_DISPATCH_VERSION >= 43
+  ApplyDrawState(command.program, command.vertexArray, command.state);
+
+  if (command.storageBuffer) {
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER,
+                      0,
+                      command.storageBuffer,
+                      command.storageOffset,
+                      command.storageSize);
+  }
+
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command.indirectBuffer);
+  if (command.parameterBuffer) {
+    glBindBuffer(GL_PARAMETER_BUFFER_ARB, command.parameterBuffer);
+    MultiDrawElementsIndirectCount(command);
+    return;
+  }
+
+  glMultiDrawElementsIndirect(
+    command.mode,
+    command.indexType,
+    reinterpret_cast<const void*>(command.indirectOffset),
+    command.drawCount,
+    command.stride);
+#else
+  static_cast<void>(command);
+#endif
+}
+
+// Least significant digit radix sort on the bytes of the key, which is
+// stable. Bytes that are equal in all keys, usually most of them, are
+// skipped.
+void CommandList::Sort() noexcept
+{
+  constexpr std::size_t digits{sizeof(std::uint64_t)};
+  constexpr std::size_t radix{256};
+
+  std::uint32_t counts[digits][radix]{};
+
+  if (m_bSorted) {
+    return;
+  }
+
+  for (std::size_t i{0}; i < m_count; ++i) {
+    for (std::size_t digit{0}; digit < digits; ++digit) {
+      ++counts[digit][(m_entries[i].key >> (8 * digit)) & 0xff];
+    }
+  }
+
+  auto pFrom{m_entries};
+  auto pTo{m_scratch};
+
+  for (std::size_t digit{0}; digit < digits; ++digit) {
+    auto& count{counts[digit]};
+
+    if (count[(pFrom[0].key >> (8 * digit)) & 0xff] == m_count) {
+      continue;
+    }
+
+    std::uint32_t offset{0};
+    for (auto& bucket : count) {
+      offset += std::exchange(bucket, offset);
+    }
+
+    for (std::size_t i{0}; i < m_count; ++i) {
+      pTo[count[(pFrom[i].key >> (8 * digit)) & 0xff]++] = pFrom[i];
+    }
+
+    std::swap(pFrom, pTo);
+  }
+
+  if (pFrom != m_entries) {
+    std::copy_n(pFrom, m_count, m_entries);
+  }
+
+  m_bSorted = true;
+}
+
+void CommandList::Reset() noexcept
+{
+  m_used    = 0;
+  m_count   = 0;
+  m_draws   = 0;
+  m_dropped = 0;
+  m_bSorted = true;
+}
+
+void CommandBuffer::Execute() noexcept
+{
+  struct Head {
+    std::uint64_t key;
+    std::size_t   list;
+  };
+
+  const TraceZone zone{"execute"};
+  Head            heads[maxLists];
+  std::size_t     cursors[maxLists]{};
+  std::size_t     headCount{0};
+  auto            scope{-1};
+  auto            pass{renderPassCount};
+
+  for (std::size_t i{0}; i < maxLists; ++i) {
+    auto& list{m_lists[i]};
+
+    if (list.m_dropped) {
+      Log("command list %zu: %zu command(s) dropped", i, list.m_dropped);
+    }
+
+    if (list.m_count) {
+      list.Sort();
+      heads[headCount++] = {list.m_entries[0].key, i};
+    }
+  }
+
+  // Min-heap of the next command of every list, a k-way merge.
+  const auto later{[](const Head& a, const Head& b) {
+    return a.key != b.key ? a.key > b.key : a.list > b.list;
+  }};
+
+  std::make_heap(heads, heads + headCount, later);
+
+  while (headCount) {
+    std::pop_heap(heads, heads + headCount, later);
+
+    auto&       head{heads[headCount - 1]};
+    const auto& list{m_lists[head.list]};
+    auto&       cursor{cursors[head.list]};
+    const auto& entry{list.m_entries[cursor++]};
+
+    // Every pass present in the stream is timed as one GPU scope.
+    if (const auto entryPass{entry.key >> (64 - sortKeyPassBits)};
+        entryPass != pass) {
+      gpuProfiler.End(scope);
+      pass  = static_cast<std::size_t>(entryPass);
+      scope = gpuProfiler.Begin(pass < renderPassCount ? renderPassNames[pass]
+                                                       : "pass");
+    }
+
+    switch (entry.type) {
+    case CommandType::clear:
+      Run(list.At<ClearCommand>(entry));
+      break;
+    case CommandType::viewport:
+      Run(list.At<ViewportCommand>(entry));
+      break;
+    case CommandType::bindBuffer:
+      Run(list.At<BindBufferCommand>(entry));
+      break;
+    case CommandType::draw:
+      Run(list.At<DrawCommand>(entry));
+      break;
+    case CommandType::multiDraw:
+      Run(list.At<MultiDrawCommand>(entry));
+      break;
+    }
+
+    if (cursor < list.m_count) {
+      head.key = list.m_entries[cursor].key;
+      std::push_heap(heads, heads + headCount, later);
+    }
+    else {
+      --headCount;
+    }
+  }
+
+  gpuProfiler.End(scope);
+
+  Reset();
+}
+
+void CommandBuffer::Reset() noexcept
+{
+  for (auto& list : m_lists) {
+    list.Reset();
+  }
+}
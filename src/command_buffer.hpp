@@ -0,0 +1,248 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+
+#include "gl.hpp"
+
+// Passes run in this order, each timed as a GPU scope of that name.
+enum class RenderPass : std::uint8_t { clear, opaque, blended, overlay };
+
+constexpr std::size_t renderPassCount{4};
+
+// Bit layout of a sort key, most significant first: pass, program,
+// material and depth, so a sorted buffer changes programs at most once
+// per pass and materials once per program. Blended geometry wants its
+// depth inverted to draw back to front.
+constexpr int sortKeyPassBits{4};
+constexpr int sortKeyProgramBits{12};
+constexpr int sortKeyMaterialBits{16};
+constexpr int sortKeyDepthBits{32};
+
+static_assert(64
+              == sortKeyPassBits + sortKeyProgramBits + sortKeyMaterialBits
+                   + sortKeyDepthBits);
+
+constexpr std::uint64_t MakeSortKey(RenderPass    pass,
+                                    std::uint32_t program,
+                                    std::uint32_t material,
+                                    std::uint32_t depth) noexcept
+{
+  constexpr auto programMask{(std::uint64_t{1} << sortKeyProgramBits) - 1};
+  constexpr auto materialMask{(std::uint64_t{1} << sortKeyMaterialBits) - 1};
+
+  const std::uint64_t passBits{static_cast<std::uint8_t>(pass)};
+
+  return passBits << (64 - sortKeyPassBits)
+         | (program & programMask) << (sortKeyMaterialBits + sortKeyDepthBits)
+         | (material & materialMask) << sortKeyDepthBits | depth;
+}
+
+enum class CommandType : std::uint8_t {
+  clear,
+  viewport,
+  bindBuffer,
+  draw,
+  multiDraw,
+};
+
+// Commands are plain data copied into the arena, they must not own
+// anything.
+struct ClearCommand {
+  static constexpr auto type{CommandType::clear};
+
+  GLbitfield mask;
+  GLfloat    color[4];
+  GLdouble   depth;
+  GLint      stencil;
+};
+
+struct ViewportCommand {
+  static constexpr auto type{CommandType::viewport};
+
+  GLint   x;
+  GLint   y;
+  GLsizei width;
+  GLsizei height;
+};
+
+// Binds a buffer range to an indexed target, e.g. GL_UNIFORM_BUFFER, for
+// the draws recorded after it under the same key.
+struct BindBufferCommand {
+  static constexpr auto type{CommandType::bindBuffer};
+
+  GLenum     target;
+  GLuint     index;
+  GLuint     buffer;
+  GLintptr   offset;
+  GLsizeiptr size;
+};
+
+// Fixed function state of a draw, applied before it.
+enum DrawState : std::uint32_t {
+  drawStateDepthTest = 1 << 0,
+  drawStateBlend     = 1 << 1,
+  drawStateCullFace  = 1 << 2,
+};
+
+struct DrawCommand {
+  static constexpr auto type{CommandType::draw};
+
+  GLuint        program;
+  GLuint        vertexArray;
+  std::uint32_t state;     // DrawState bits.
+  GLenum        mode;      // E.g. GL_TRIANGLES.
+  GLenum        indexType; // Zero for non-indexed draws.
+  GLint         first;     // First vertex or index.
+  GLsizei       count;
+  GLsizei       instanceCount;
+  GLint         baseVertex;
+  // Without base instances, before OpenGL 4.2, shaders take the first
+  // instance from a uniform. Its location, -1 for none.
+  GLint firstInstanceUniform;
+  GLint firstInstance;
+};
+
+// Indexed draws from GL_DRAW_INDIRECT_BUFFER, OpenGL 4.3. The storage
+// buffer range is bound to binding 0 unless the buffer is zero. With a
+// parameter buffer the GPU reads the draw count from it, which needs
+// OpenGL 4.6 or GL_ARB_indirect_parameters, and drawCount is the maximum.
+struct MultiDrawCommand {
+  static constexpr auto type{CommandType::multiDraw};
+
+  GLuint        program;
+  GLuint        vertexArray;
+  std::uint32_t state; // DrawState bits.
+  GLenum        mode;
+  GLenum        indexType;
+  GLuint        indirectBuffer;
+  GLintptr      indirectOffset;
+  GLsizei       stride; // Between commands, zero if tightly packed.
+  GLsizei       drawCount;
+  GLuint        parameterBuffer;
+  GLintptr      parameterOffset;
+  GLuint        storageBuffer;
+  GLintptr      storageOffset;
+  GLsizeiptr    storageSize;
+};
+
+// True if MultiDrawCommand may read its draw count from a parameter
+// buffer with the current context.
+bool CanDrawIndirectCount() noexcept;
+
+// Commands recorded by one thread into a bump-allocated arena, tagged with
+// a sort key. Recording touches no GL state, so any thread may record into
+// a list it owns. The arena is reused every frame.
+class alignas(64) CommandList {
+public:
+  static constexpr std::size_t arenaSize{std::size_t{1} << 16};
+  static constexpr std::size_t maxCommands{4096};
+
+  CommandList() noexcept = default;
+  CommandList(const CommandList&) = delete;
+  CommandList& operator=(const CommandList&) = delete;
+
+  // False if the list is full, in which case the command is dropped.
+  template<typename Command>
+  bool Record(std::uint64_t key, const Command& command) noexcept
+  {
+    static_assert(std::is_trivially_copyable_v<Command>);
+    static_assert(alignof(Command) <= alignof(std::max_align_t));
+
+    const auto offset{(m_used + alignof(Command) - 1)
+                      & ~(alignof(Command) - 1)};
+
+    if (maxCommands == m_count || offset > arenaSize
+        || arenaSize - offset < sizeof(Command)) {
+      ++m_dropped;
+      return false;
+    }
+
+    std::memcpy(m_arena + offset, &command, sizeof(Command));
+    m_entries[m_count++] = {key,
+                            static_cast<std::uint32_t>(offset),
+                            Command::type};
+    m_used    = offset + sizeof(Command);
+    m_bSorted = false;
+    if constexpr (CommandType::draw == Command::type
+                  || CommandType::multiDraw == Command::type) {
+      ++m_draws;
+    }
+
+    return true;
+  }
+
+  // Sorts the commands by key, keeping the recording order of equal keys.
+  // Calling it on the recording thread once done takes the sort off the
+  // thread that executes the list.
+  void Sort() noexcept;
+  void Reset() noexcept;
+
+  std::size_t Count() const noexcept
+  {
+    return m_count;
+  }
+  // Recorded commands that are draw calls.
+  std::size_t Draws() const noexcept
+  {
+    return m_draws;
+  }
+
+private:
+  friend class CommandBuffer;
+
+  struct Entry {
+    std::uint64_t key;
+    std::uint32_t offset;
+    CommandType   type;
+  };
+
+  template<typename Command>
+  const Command& At(const Entry& entry) const noexcept
+  {
+    return *std::launder(
+      reinterpret_cast<const Command*>(m_arena + entry.offset));
+  }
+
+  alignas(std::max_align_t) std::byte m_arena[arenaSize];
+  Entry                               m_entries[maxCommands];
+  Entry                               m_scratch[maxCommands];
+  std::size_t                         m_used{0};
+  std::size_t                         m_count{0};
+  std::size_t                         m_draws{0};
+  std::size_t                         m_dropped{0};
+  bool                                m_bSorted{true};
+};
+
+// One command list per recording thread, merged into a single stream in
+// key order when executed. Equal keys of different lists run in list
+// order, so the stream only depends on which list each command went to,
+// never on thread timing.
+class CommandBuffer {
+public:
+  static constexpr std::size_t maxLists{16};
+
+  CommandBuffer() noexcept = default;
+  CommandBuffer(const CommandBuffer&) = delete;
+  CommandBuffer& operator=(const CommandBuffer&) = delete;
+
+  // The list of the given recording thread, e.g. a worker index. Indices
+  // past the last list are clamped to it rather than writing past the
+  // array, callers must stay below maxLists to record in parallel.
+  CommandList& List(std::size_t index) noexcept
+  {
+    return m_lists[std::min(index, maxLists - 1)];
+  }
+
+  // Sorts what the recording threads left unsorted, executes all lists
+  // merged and empties them. Recording must have finished.
+  void Execute() noexcept;
+  void Reset() noexcept;
+
+private:
+  CommandList m_lists[maxLists];
+};
@@ -0,0 +1,86 @@
+#include "context_cache.hpp"
+#include "paths.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+static constexpr char magic[]{"polychrome-context-cache 1"};
+
+bool QueryDriver(GlGetProcAddress getProcAddress,
+                 char (&driver)[sizeof ContextCacheEntry::driver]) noexcept
+{
+  const auto pfnglGetString{reinterpret_cast<PFNGLGETSTRINGPROC>(
+    getProcAddress("glGetString"))};
+
+  if (!pfnglGetString) {
+    return false;
+  }
+
+  const auto vendor{pfnglGetString(GL_VENDOR)};
+  const auto renderer{pfnglGetString(GL_RENDERER)};
+  const auto version{pfnglGetString(GL_VERSION)};
+
+  if (!vendor || !renderer || !version) {
+    return false;
+  }
+
+  const auto n{std::snprintf(driver,
+                             sizeof driver,
+                             "%s|%s|%s",
+                             reinterpret_cast<const char*>(vendor),
+                             reinterpret_cast<const char*>(renderer),
+                             reinterpret_cast<const char*>(version))};
+
+  return 0 < n && static_cast<std::size_t>(n) < sizeof driver;
+}
+
+bool LoadContextCache(const char* name, ContextCacheEntry* pEntry) noexcept
+{
+  const auto directory{GetCacheDirectory()};
+
+  if (directory.empty()) {
+    return false;
+  }
+
+  std::ifstream file{directory / name};
+  std::string   line;
+
+  if (!std::getline(file, line) || line != magic) {
+    return false;
+  }
+
+  if (!(file >> pEntry->version >> pEntry->profileMask >> pEntry->flags)
+      || !file.ignore(1)
+      || !file.getline(pEntry->driver, sizeof pEntry->driver)) {
+    *pEntry = {};
+    return false;
+  }
+
+  return true;
+}
+
+bool StoreContextCache(const char*              name,
+                       const ContextCacheEntry& entry) noexcept
+{
+  const auto directory{GetCacheDirectory()};
+  char       buffer[sizeof magic + sizeof entry.driver + 64];
+
+  if (directory.empty()) {
+    return false;
+  }
+
+  const auto n{std::snprintf(buffer,
+                             sizeof buffer,
+                             "%s\n%d %d %d\n%s\n",
+                             magic,
+                             entry.version,
+                             entry.profileMask,
+                             entry.flags,
+                             entry.driver)};
+
+  return 0 < n && static_cast<std::size_t>(n) < sizeof buffer
+         && WriteFileAtomically(
+           directory / name, buffer, static_cast<std::size_t>(n));
+}
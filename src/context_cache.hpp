@@ -0,0 +1,21 @@
+#pragma once
+
+#include "gl.hpp"
+
+// Context version, profile and flags that the version ladder settled on for
+// a driver, persisted so that later launches create the context directly
+// instead of probing every version again.
+struct ContextCacheEntry {
+  int  version{0}; // E.g. 45 for OpenGL 4.5.
+  int  profileMask{0};
+  int  flags{0};
+  char driver[1024]{}; // GL_VENDOR, GL_RENDERER and GL_VERSION.
+};
+
+// Describes the driver behind the current context.
+bool QueryDriver(GlGetProcAddress getProcAddress,
+                 char (&driver)[sizeof ContextCacheEntry::driver]) noexcept;
+
+bool LoadContextCache(const char* name, ContextCacheEntry* pEntry) noexcept;
+bool StoreContextCache(const char*              name,
+                       const ContextCacheEntry& entry) noexcept;
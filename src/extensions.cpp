@@ -0,0 +1,128 @@
+#include "extensions.hpp"
+
+#include <new>
+#include <utility>
+
+void ExtensionSet::Clear() noexcept
+{
+  for (std::size_t i{0}; i < m_capacity; ++i) {
+    m_hashes[i] = 0;
+  }
+  m_size = 0;
+}
+
+bool ExtensionSet::Reserve(std::size_t count) noexcept
+{
+  auto capacity{minCapacity};
+
+  while (capacity < 2 * count) {
+    capacity *= 2;
+  }
+  if (capacity <= m_capacity) {
+    return true;
+  }
+
+  std::unique_ptr<std::uint64_t[]> hashes{
+    new (std::nothrow) std::uint64_t[capacity]{}};
+  if (!hashes) {
+    return false;
+  }
+
+  // Rehash into the larger table.
+  for (std::size_t i{0}; i < m_capacity; ++i) {
+    if (const auto hash{m_hashes[i]}) {
+      auto j{static_cast<std::size_t>(hash) & (capacity - 1)};
+
+      while (hashes[j]) {
+        j = (j + 1) & (capacity - 1);
+      }
+      hashes[j] = hash;
+    }
+  }
+
+  m_hashes   = std::move(hashes);
+  m_capacity = capacity;
+
+  return true;
+}
+
+bool ExtensionSet::Insert(std::string_view extension) noexcept
+{
+  const auto hash{HashExtension(extension)};
+
+  if (2 * (m_size + 1) > m_capacity && !Reserve(m_size + 1)) {
+    return false;
+  }
+
+  auto i{static_cast<std::size_t>(hash) & (m_capacity - 1)};
+
+  while (m_hashes[i]) {
+    if (hash == m_hashes[i]) {
+      return true;
+    }
+    i = (i + 1) & (m_capacity - 1);
+  }
+
+  m_hashes[i] = hash;
+  ++m_size;
+
+  return true;
+}
+
+bool ExtensionSet::InsertAll(const char* extensionsString) noexcept
+{
+  std::size_t count{0};
+  auto        bRet{true};
+
+  if (!extensionsString) {
+    return false;
+  }
+
+  // Count the names first to size the table once.
+  for (auto p{extensionsString}; *p; ++p) {
+    if (' ' != *p && (p == extensionsString || ' ' == p[-1])) {
+      ++count;
+    }
+  }
+  if (!Reserve(m_size + count)) {
+    return false;
+  }
+
+  while (*extensionsString) {
+    const auto begin{extensionsString};
+
+    while (*extensionsString && ' ' != *extensionsString) {
+      ++extensionsString;
+    }
+
+    const auto n{static_cast<std::size_t>(extensionsString - begin)};
+
+    if (n > 0 && !Insert({begin, n})) {
+      bRet = false;
+    }
+
+    while (' ' == *extensionsString) {
+      ++extensionsString;
+    }
+  }
+
+  return bRet;
+}
+
+bool ExtensionSet::Contains(std::uint64_t hash) const noexcept
+{
+  if (!m_capacity) {
+    return false;
+  }
+
+  auto i{static_cast<std::size_t>(hash) & (m_capacity - 1)};
+
+  while (m_hashes[i]) {
+    if (hash == m_hashes[i]) {
+      return true;
+    }
+    i = (i + 1) & (m_capacity - 1);
+  }
+
+  return false;
+}
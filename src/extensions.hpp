@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+// 64-bit FNV-1a. Zero marks an empty slot in ExtensionSet, so no extension
+// name may hash to it.
+constexpr std::uint64_t HashExtension(std::string_view extension) noexcept
+{
+  std::uint64_t hash{0xcbf29ce484222325};
+
+  for (const auto c : extension) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 0x100000001b3;
+  }
+
+  return hash ? hash : 1;
+}
+
+// Hashes extension names known to the code at compile time, e.g.
+// "WGL_ARB_pixel_format"_ext.
+consteval std::uint64_t operator""_ext(const char* extension,
+                                       std::size_t length) noexcept
+{
+  return HashExtension({extension, length});
+}
+
+// Set of extension name hashes, filled once from a space separated
+// extensions string or one name at a time from glGetStringi, so that every
+// later query is a single probe instead of a scan of the string.
+class ExtensionSet {
+public:
+  void Clear() noexcept;
+  // Sizes the table for that many extensions in total, which Insert would
+  // otherwise do by doubling it. False if it is out of memory.
+  bool Reserve(std::size_t count) noexcept;
+
+  bool Insert(std::string_view extension) noexcept;
+  bool InsertAll(const char* extensionsString) noexcept;
+
+  bool Contains(std::uint64_t hash) const noexcept;
+  bool Contains(std::string_view extension) const noexcept
+  {
+    return Contains(HashExtension(extension));
+  }
+
+  std::size_t Size() const noexcept
+  {
+    return m_size;
+  }
+
+private:
+  // Open addressing with linear probing in a power of two sized table,
+  // kept at most half full.
+  static constexpr std::size_t minCapacity{16};
+
+  std::unique_ptr<std::uint64_t[]> m_hashes;
+  std::size_t                      m_capacity{0};
+  std::size_t                      m_size{0};
+};
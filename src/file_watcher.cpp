@@ -0,0 +1,191 @@
+#include "file_watcher.hpp"
+
+#include <algorithm>
+#include <system_error>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+bool FileWatcher::Start(const std::filesystem::path& directory) noexcept
+{
+  Stop();
+
+#ifdef _WIN32
+  const auto handle{
+    CreateFileW(directory.c_str(),
+                FILE_LIST_DIRECTORY,
+                FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                nullptr,
+                OPEN_EXISTING,
+                FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+                nullptr)};
+
+  if (INVALID_HANDLE_VALUE == handle) {
+    return false;
+  }
+
+  m_directory = handle;
+#else
+  m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (m_inotify < 0) {
+    return false;
+  }
+
+  // Writes show when the file is closed, replacements as the rename.
+  if (inotify_add_watch(m_inotify,
+                        directory.c_str(),
+                        IN_CLOSE_WRITE | IN_MOVED_TO)
+      < 0) {
+    close(m_inotify);
+    m_inotify = -1;
+    return false;
+  }
+#endif
+
+  m_bStop = false;
+
+  try {
+    m_thread = std::thread{&FileWatcher::Run, this};
+  }
+  catch (const std::system_error&) {
+    Stop();
+    return false;
+  }
+
+  return true;
+}
+
+void FileWatcher::Stop() noexcept
+{
+  m_bStop = true;
+  if (m_thread.joinable()) {
+    m_thread.join();
+  }
+
+#ifdef _WIN32
+  if (m_directory) {
+    CloseHandle(m_directory);
+    m_directory = nullptr;
+  }
+#else
+  if (0 <= m_inotify) {
+    close(m_inotify);
+    m_inotify = -1;
+  }
+#endif
+
+  const std::lock_guard lock{m_mutex};
+  m_changes.clear();
+}
+
+std::vector<std::string> FileWatcher::TakeChanges() noexcept
+{
+  const std::lock_guard lock{m_mutex};
+
+  return std::exchange(m_changes, {});
+}
+
+void FileWatcher::Add(std::string name) noexcept
+{
+  const std::lock_guard lock{m_mutex};
+
+  if (std::find(m_changes.begin(), m_changes.end(), name)
+      == m_changes.end()) {
+    m_changes.push_back(std::move(name));
+  }
+}
+
+void FileWatcher::Run() noexcept
+{
+#ifdef _WIN32
+  alignas(DWORD) char buffer[16384];
+  OVERLAPPED          overlapped{};
+  DWORD               size{0};
+  auto                bPending{false};
+
+  overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+  if (!overlapped.hEvent) {
+    return;
+  }
+
+  while (!m_bStop) {
+    if (!bPending) {
+      if (!ReadDirectoryChangesW(m_directory,
+                                 buffer,
+                                 static_cast<DWORD>(sizeof buffer),
+                                 FALSE,
+                                 FILE_NOTIFY_CHANGE_LAST_WRITE
+                                   | FILE_NOTIFY_CHANGE_FILE_NAME,
+                                 nullptr,
+                                 &overlapped,
+                                 nullptr)) {
+        break;
+      }
+      bPending = true;
+    }
+
+    if (WAIT_OBJECT_0
+        != WaitForSingleObject(overlapped.hEvent, pollMilliseconds)) {
+      continue;
+    }
+
+    bPending = false;
+    if (!GetOverlappedResult(m_directory, &overlapped, &size, FALSE)) {
+      break;
+    }
+
+    // Zero bytes if the buffer overflowed, the changes are lost then.
+    for (DWORD offset{0}; offset < size;) {
+      const auto pInfo{
+        reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(buffer + offset)};
+
+      if (FILE_ACTION_MODIFIED == pInfo->Action
+          || FILE_ACTION_ADDED == pInfo->Action
+          || FILE_ACTION_RENAMED_NEW_NAME == pInfo->Action) {
+        Add(std::filesystem::path{std::wstring{
+                                    pInfo->FileName,
+                                    pInfo->FileNameLength / sizeof(WCHAR)}}
+              .string());
+      }
+      if (!pInfo->NextEntryOffset) {
+        break;
+      }
+      offset += pInfo->NextEntryOffset;
+    }
+  }
+
+  if (bPending) {
+    CancelIoEx(m_directory, &overlapped);
+    GetOverlappedResult(m_directory, &overlapped, &size, TRUE);
+  }
+  CloseHandle(overlapped.hEvent);
+#else
+  alignas(inotify_event) char buffer[4096];
+  pollfd                      fd{m_inotify, POLLIN, 0};
+
+  while (!m_bStop) {
+    if (poll(&fd, 1, pollMilliseconds) <= 0) {
+      continue;
+    }
+
+    const auto size{read(m_inotify, buffer, sizeof buffer)};
+
+    for (ssize_t offset{0}; offset < size;) {
+      const auto pEvent{
+        reinterpret_cast<const inotify_event*>(buffer + offset)};
+
+      if (pEvent->len) {
+        Add(pEvent->name);
+      }
+      offset += static_cast<ssize_t>(sizeof(inotify_event) + pEvent->len);
+    }
+  }
+#endif
+}
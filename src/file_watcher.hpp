@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Reports the files of a directory that were written or replaced, e.g. by
+// an editor saving through a temporary file. A thread blocks on inotify,
+// or on ReadDirectoryChangesW on Windows, and collects the names until
+// they are taken. Subdirectories are not watched.
+class FileWatcher {
+public:
+  FileWatcher() noexcept = default;
+  FileWatcher(const FileWatcher&) = delete;
+  FileWatcher& operator=(const FileWatcher&) = delete;
+  ~FileWatcher()
+  {
+    Stop();
+  }
+
+  bool Start(const std::filesystem::path& directory) noexcept;
+  void Stop() noexcept;
+
+  // Names of the files changed since the last call, each once.
+  std::vector<std::string> TakeChanges() noexcept;
+
+private:
+  // How long the thread blocks before it checks whether to stop.
+  static constexpr int pollMilliseconds{100};
+
+  void Run() noexcept;
+  void Add(std::string name) noexcept;
+
+#ifdef _WIN32
+  void* m_directory{nullptr}; // HANDLE opened for overlapped reads.
+#else
+  int m_inotify{-1};
+#endif
+  std::thread              m_thread;
+  std::atomic<bool>        m_bStop{false};
+  std::mutex               m_mutex;
+  std::vector<std::string> m_changes;
+};
@@ -0,0 +1,84 @@
+#include "frame_arena.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <new>
+
+FrameArena frameArena;
+
+bool FrameArena::Init(std::size_t bytesPerFrame, int frames) noexcept
+{
+  Release();
+
+  // Regions start at the strictest alignment Allocate assumes.
+  constexpr auto alignment{alignof(std::max_align_t)};
+
+  m_frames     = static_cast<std::size_t>(std::max(frames, 1));
+  m_regionSize = (bytesPerFrame + alignment - 1) & ~(alignment - 1);
+  m_memory.reset(new (std::nothrow) std::byte[m_regionSize * m_frames]);
+  if (!m_memory) {
+    m_regionSize = 0;
+    return false;
+  }
+
+  Log("frame arena: %zu region(s) of %zu KiB", m_frames, m_regionSize / 1024);
+
+  m_frame = 0;
+  BeginFrame();
+
+  return true;
+}
+
+void FrameArena::Release() noexcept
+{
+  m_memory.reset();
+  m_regionSize = 0;
+  m_pRegion    = nullptr;
+  m_used.store(0, std::memory_order_relaxed);
+}
+
+void FrameArena::BeginFrame() noexcept
+{
+  if (!m_memory) {
+    return;
+  }
+
+  if (const auto failures{m_failures.load(std::memory_order_relaxed)}) {
+    Log("frame arena: %u allocation(s) did not fit", failures);
+  }
+
+  m_pRegion = m_memory.get() + m_frame++ % m_frames * m_regionSize;
+  m_used.store(0, std::memory_order_relaxed);
+  m_allocations.store(0, std::memory_order_relaxed);
+  m_failures.store(0, std::memory_order_relaxed);
+}
+
+// Reserving the worst case padding keeps this a single fetch_add.
+void* FrameArena::Allocate(std::size_t size, std::size_t alignment) noexcept
+{
+  const auto reserved{size + alignment - 1};
+  const auto offset{m_used.fetch_add(reserved, std::memory_order_relaxed)};
+
+  if (!m_pRegion || offset > m_regionSize
+      || m_regionSize - offset < reserved) {
+    m_failures.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+
+  m_allocations.fetch_add(1, std::memory_order_relaxed);
+
+  const auto address{reinterpret_cast<std::uintptr_t>(m_pRegion + offset)};
+  const auto aligned{(address + alignment - 1) & ~(alignment - 1)};
+
+  return m_pRegion + offset + (aligned - address);
+}
+
+FrameArena::Stats FrameArena::Usage() const noexcept
+{
+  const auto bytes{
+    std::min(m_used.load(std::memory_order_relaxed), m_regionSize)};
+
+  return {static_cast<std::uint32_t>(bytes),
+          m_allocations.load(std::memory_order_relaxed),
+          m_failures.load(std::memory_order_relaxed)};
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+
+// Linear allocator for data that lives for one frame, e.g. visible lists
+// or uniform staging. Memory is split into one region per frame in
+// flight and a region is only reset once FramePacer::Wait has seen the
+// GPU finish the frame that last used it, so nothing needs to be freed.
+// Any thread may allocate, the bump pointer is atomic.
+class FrameArena {
+public:
+  static constexpr std::size_t defaultBytesPerFrame{std::size_t{1} << 20};
+
+  struct Stats {
+    std::uint32_t bytes; // Including alignment padding.
+    std::uint32_t allocations;
+    std::uint32_t failures; // Allocations that did not fit.
+  };
+
+  FrameArena() noexcept = default;
+  FrameArena(const FrameArena&) = delete;
+  FrameArena& operator=(const FrameArena&) = delete;
+
+  // Allocates all regions at once, the only heap allocation.
+  bool Init(std::size_t bytesPerFrame, int frames) noexcept;
+  void Release() noexcept;
+
+  // Switches to the next region, call right after FramePacer::Wait.
+  void BeginFrame() noexcept;
+
+  // Null if the region is exhausted.
+  void* Allocate(std::size_t size,
+                 std::size_t alignment = alignof(std::max_align_t)) noexcept;
+
+  // Uninitialized storage for count objects.
+  template<typename T>
+  T* Allocate(std::size_t count) noexcept
+  {
+    static_assert(std::is_trivially_destructible_v<T>);
+
+    return static_cast<T*>(Allocate(count * sizeof(T), alignof(T)));
+  }
+
+  // Usage of the current frame so far.
+  Stats Usage() const noexcept;
+
+  std::size_t Capacity() const noexcept
+  {
+    return m_regionSize;
+  }
+
+private:
+  std::unique_ptr<std::byte[]> m_memory;
+  std::size_t                  m_regionSize{0};
+  std::size_t                  m_frames{0};
+  std::size_t                  m_frame{0};
+  std::byte*                   m_pRegion{nullptr};
+  std::atomic<std::size_t>     m_used{0};
+  std::atomic<std::uint32_t>   m_allocations{0};
+  std::atomic<std::uint32_t>   m_failures{0};
+};
+
+extern FrameArena frameArena;
@@ -0,0 +1,145 @@
+#include "frame_pacer.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#endif
+
+bool FramePacer::Init(int                      framesInFlight,
+                      std::chrono::nanoseconds targetFrameTime) noexcept
+{
+  using namespace std::chrono_literals;
+
+  Release();
+
+  // Fences are core since OpenGL 3.2, without them only pacing is left.
+  m_framesInFlight  = glVersion >= 32
+                        ? std::clamp(framesInFlight, 1, maxFramesInFlight)
+                        : 0;
+  m_frame           = 0;
+  m_targetFrameTime = std::max(targetFrameTime, 0ns);
+  m_deadline        = {};
+
+  // The OS sleep overshoots by up to the scheduler granularity, so sleep
+  // through all but that stretch and yield through the rest.
+#ifdef _WIN32
+  m_hTimer = CreateWaitableTimerExW(NULL,
+                                    NULL,
+                                    CREATE_WAITABLE_TIMER_HIGH_RESOLUTION,
+                                    TIMER_ALL_ACCESS);
+  m_slack  = m_hTimer ? 1ms : 2ms;
+#else
+  m_slack = 200us;
+#endif
+
+  Log("frame pacing: %d frame(s) in flight, target frame time %.3f ms",
+      m_framesInFlight,
+      std::chrono::duration<double, std::milli>(m_targetFrameTime).count());
+
+  return true;
+}
+
+void FramePacer::Release() noexcept
+{
+  for (auto& fence : m_fences) {
+    if (fence) {
+      glDeleteSync(fence);
+      fence = nullptr;
+    }
+  }
+
+#ifdef _WIN32
+  if (m_hTimer) {
+    [[maybe_unused]] const auto bClosed{CloseHandle(m_hTimer)};
+    m_hTimer = NULL;
+  }
+#endif
+}
+
+void FramePacer::Wait() noexcept
+{
+  if (0 < m_framesInFlight) {
+    auto& fence{m_fences[m_frame % m_framesInFlight]};
+
+    if (fence) {
+      GLbitfield flags{GL_SYNC_FLUSH_COMMANDS_BIT};
+      GLenum     result{GL_TIMEOUT_EXPIRED};
+
+      do {
+        result = glClientWaitSync(fence, flags, 100'000'000);
+        flags  = 0;
+      } while (GL_TIMEOUT_EXPIRED == result);
+
+      glDeleteSync(fence);
+      fence = nullptr;
+    }
+  }
+
+  if (0 < m_targetFrameTime.count()) {
+    const auto now{std::chrono::steady_clock::now()};
+
+    // Start over instead of rushing frames after falling behind.
+    if (now < m_deadline) {
+      SleepUntil(m_deadline);
+    }
+    else if (now - m_deadline > m_targetFrameTime) {
+      m_deadline = now;
+    }
+
+    m_deadline += m_targetFrameTime;
+  }
+}
+
+void FramePacer::Submit() noexcept
+{
+  if (0 < m_framesInFlight) {
+    m_fences[m_frame % m_framesInFlight] =
+      glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+
+  ++m_frame;
+}
+
+void FramePacer::SleepUntil(
+  std::chrono::steady_clock::time_point deadline) noexcept
+{
+  const auto wakeUp{deadline - m_slack};
+
+#ifdef _WIN32
+  using Ticks = std::chrono::duration<LONGLONG, std::ratio<1, 10'000'000>>;
+
+  const auto now{std::chrono::steady_clock::now()};
+  const auto remaining{std::chrono::duration_cast<Ticks>(wakeUp - now)};
+
+  if (0 < remaining.count()) {
+    // Negative due times are relative.
+    const LARGE_INTEGER dueTime{.QuadPart = -remaining.count()};
+
+    if (m_hTimer
+        && SetWaitableTimer(m_hTimer, &dueTime, 0, NULL, NULL, FALSE)) {
+      [[maybe_unused]] const auto dwResult{
+        WaitForSingleObject(m_hTimer, INFINITE)};
+    }
+    else {
+      Sleep(static_cast<DWORD>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(remaining)
+          .count()));
+    }
+  }
+#else
+  std::this_thread::sleep_until(wakeUp);
+#endif
+
+  while (std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::yield();
+  }
+}
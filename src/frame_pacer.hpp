@@ -0,0 +1,46 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+
+#include "gl.hpp"
+
+// Caps how many frames the CPU may run ahead of the GPU with a fence per
+// frame and, given a target frame time, paces frames by sleeping instead
+// of spinning. Call Wait before a frame and Submit after its swap, both on
+// the thread the context is current on.
+class FramePacer {
+public:
+  static constexpr int maxFramesInFlight{4};
+
+  FramePacer() noexcept = default;
+  FramePacer(const FramePacer&) = delete;
+  FramePacer& operator=(const FramePacer&) = delete;
+
+  // A zero target frame time leaves pacing to the swap interval. Needs
+  // the GL entry points to be loaded.
+  bool Init(int                      framesInFlight,
+            std::chrono::nanoseconds targetFrameTime) noexcept;
+  // Deletes outstanding fences, needs the context to be current.
+  void Release() noexcept;
+
+  void Wait() noexcept;
+  void Submit() noexcept;
+
+  // Zero without fences.
+  int FramesInFlight() const noexcept
+  {
+    return m_framesInFlight;
+  }
+
+private:
+  void SleepUntil(std::chrono::steady_clock::time_point deadline) noexcept;
+
+  GLsync                                m_fences[maxFramesInFlight]{};
+  int                                   m_framesInFlight{0};
+  std::size_t                           m_frame{0};
+  std::chrono::nanoseconds              m_targetFrameTime{0};
+  std::chrono::nanoseconds              m_slack{0};
+  std::chrono::steady_clock::time_point m_deadline{};
+  void*                                 m_hTimer{nullptr}; // Win32 only.
+};
@@ -0,0 +1,247 @@
+#include "frame_stats.hpp"
+#include "heap_counter.hpp"
+#include "histogram.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <system_error>
+
+static double ToMilliseconds(std::uint64_t ns) noexcept
+{
+  return static_cast<double>(ns) / 1e6;
+}
+
+static std::uint64_t ToUnsigned(std::int64_t ns) noexcept
+{
+  return ns > 0 ? static_cast<std::uint64_t>(ns) : 0;
+}
+
+static void LogPercentiles(const char* name, const Histogram& histogram)
+{
+  Log("%s: p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, p99.9 %.3f ms, "
+      "max %.3f ms",
+      name,
+      ToMilliseconds(histogram.Percentile(0.5)),
+      ToMilliseconds(histogram.Percentile(0.95)),
+      ToMilliseconds(histogram.Percentile(0.99)),
+      ToMilliseconds(histogram.Percentile(0.999)),
+      ToMilliseconds(histogram.Max()));
+}
+
+static void WriteScopePath(std::ostream&      stream,
+                           const FrameTiming& timing,
+                           std::int32_t       index)
+{
+  const auto& scope{timing.scopes[index]};
+
+  if (0 <= scope.parent && scope.parent < index) {
+    WriteScopePath(stream, timing, scope.parent);
+    stream << '/';
+  }
+  stream << scope.name;
+}
+
+// Space separated path=milliseconds pairs, e.g. "frame=0.2 frame/clear=0.1".
+static void WriteScopes(std::ostream& stream, const FrameTiming& timing)
+{
+  const auto count{std::min<std::size_t>(timing.scopeCount, maxGpuScopes)};
+
+  for (std::size_t i{0}; i < count; ++i) {
+    if (i) {
+      stream << ' ';
+    }
+    WriteScopePath(stream, timing, static_cast<std::int32_t>(i));
+    stream << '=' << ToMilliseconds(ToUnsigned(timing.scopes[i].ns));
+  }
+}
+
+bool FrameStats::Start(const std::filesystem::path& path) noexcept
+{
+  Stop();
+
+  m_bStop             = false;
+  m_steadyAllocations = 0;
+
+  try {
+    m_writer = std::thread{&FrameStats::Run, this, path};
+  }
+  catch (const std::system_error&) {
+    return false;
+  }
+
+  return true;
+}
+
+void FrameStats::Stop() noexcept
+{
+  if (!m_writer.joinable()) {
+    return;
+  }
+
+  {
+    const std::lock_guard lock{m_mutex};
+    m_bStop = true;
+  }
+  m_wake.notify_one();
+
+  m_writer.join();
+}
+
+FrameTiming FrameStats::Measure(Clock::time_point begin,
+                                Clock::time_point submitted,
+                                Clock::time_point swapped) noexcept
+{
+  using std::chrono::nanoseconds;
+
+  const auto previous{Clock::time_point{} == m_lastSwapped ? begin
+                                                           : m_lastSwapped};
+
+  m_lastSwapped = swapped;
+
+  return {.frame           = m_frame++,
+          .submitNs        = nanoseconds{submitted - begin}.count(),
+          .swapNs          = nanoseconds{swapped - submitted}.count(),
+          .totalNs         = nanoseconds{swapped - previous}.count(),
+          .gpuNs           = -1,
+          .stateIssued     = 0,
+          .stateElided     = 0,
+          .arenaBytes      = 0,
+          .heapAllocations = 0,
+          .scopeCount      = 0,
+          .scopes          = {}};
+}
+
+void FrameStats::Record(const FrameTiming& timing) noexcept
+{
+  if (!m_ring.TryPush(timing)) {
+    m_dropped.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void FrameStats::Run(std::filesystem::path path) noexcept
+{
+  using Window = std::array<std::int64_t, medianWindow>;
+
+  std::ofstream    file;
+  Histogram        submit;
+  Histogram        swap;
+  Histogram        total;
+  Histogram        gpu;
+  Window           window{};
+  Window           sorted{};
+  std::size_t      windowSize{0};
+  std::uint64_t    samples{0};
+  std::size_t      stutters{0};
+  std::uint64_t    stateIssued{0};
+  std::uint64_t    stateElided{0};
+  std::uint32_t    arenaPeak{0};
+  auto             nextSummary{Clock::now() + summaryPeriod};
+  FrameTiming      timing{};
+  std::unique_lock lock{m_mutex};
+
+  if (!path.empty()) {
+    file.open(path, std::ios::trunc);
+    file << "frame,submit_ms,swap_ms,total_ms,gpu_ms,stutter,state_issued,"
+            "state_elided,arena_bytes,heap_allocations,gpu_scopes\n";
+    if (!file) {
+      Log("failed to open the frame statistics file");
+    }
+  }
+
+  for (auto bStop{false}; !bStop;) {
+    bStop = m_wake.wait_for(lock, drainPeriod, [this] { return m_bStop; });
+
+    while (m_ring.TryPop(&timing)) {
+      submit.Add(ToUnsigned(timing.submitNs));
+      swap.Add(ToUnsigned(timing.swapNs));
+      total.Add(ToUnsigned(timing.totalNs));
+      if (0 <= timing.gpuNs) {
+        gpu.Add(ToUnsigned(timing.gpuNs));
+      }
+      stateIssued += timing.stateIssued;
+      stateElided += timing.stateElided;
+      arenaPeak     = std::max(arenaPeak, timing.arenaBytes);
+
+      // Frames past the warm-up are expected not to touch the heap.
+      if (timing.frame >= warmUpFrames && timing.heapAllocations) {
+        if (!m_steadyAllocations) {
+          Log("frame %llu allocated on the heap %u time(s)",
+              static_cast<unsigned long long>(timing.frame),
+              timing.heapAllocations);
+        }
+        m_steadyAllocations += timing.heapAllocations;
+      }
+
+      // A stutter takes twice the rolling median and at least a
+      // millisecond longer, which keeps jitter of very short frames out.
+      auto bStutter{false};
+      if (medianWindow == windowSize) {
+        sorted = window;
+        std::nth_element(sorted.begin(),
+                         sorted.begin() + medianWindow / 2,
+                         sorted.end());
+
+        const auto median{sorted[medianWindow / 2]};
+        bStutter = timing.totalNs > 2 * median
+                   && timing.totalNs - median >= 1'000'000;
+      }
+      else {
+        ++windowSize;
+      }
+      // Frames may be dropped, so the window is indexed by the samples.
+      window[samples++ % medianWindow] = timing.totalNs;
+
+      if (bStutter) {
+        ++stutters;
+      }
+
+      if (file) {
+        file << timing.frame << ','
+             << ToMilliseconds(ToUnsigned(timing.submitNs)) << ','
+             << ToMilliseconds(ToUnsigned(timing.swapNs)) << ','
+             << ToMilliseconds(ToUnsigned(timing.totalNs)) << ',';
+        if (0 <= timing.gpuNs) {
+          file << ToMilliseconds(ToUnsigned(timing.gpuNs));
+        }
+        file << ',' << bStutter << ',' << timing.stateIssued << ','
+             << timing.stateElided << ',' << timing.arenaBytes << ','
+             << timing.heapAllocations << ',';
+        WriteScopes(file, timing);
+        file << '\n';
+      }
+    }
+
+    if (file) {
+      file.flush();
+    }
+
+    if (bStop || Clock::now() >= nextSummary) {
+      nextSummary = Clock::now() + summaryPeriod;
+
+      Log("frame statistics over %llu frame(s), %zu stutter(s), "
+          "%zu dropped",
+          static_cast<unsigned long long>(total.Count()),
+          stutters,
+          m_dropped.load(std::memory_order_relaxed));
+      LogPercentiles("  submit", submit);
+      LogPercentiles("  swap", swap);
+      LogPercentiles("  total", total);
+      if (0 < gpu.Count()) {
+        LogPercentiles("  gpu", gpu);
+      }
+      if (0 < total.Count()) {
+        Log("  state calls: %.1f issued, %.1f elided per frame",
+            static_cast<double>(stateIssued) / total.Count(),
+            static_cast<double>(stateElided) / total.Count());
+      }
+      Log("  frame arena: peak %.1f KiB", arenaPeak / 1024.0);
+      if (heapAllocationsCounted) {
+        Log("  heap: %llu allocation(s) after the first %llu frames",
+            static_cast<unsigned long long>(m_steadyAllocations),
+            static_cast<unsigned long long>(warmUpFrames));
+      }
+    }
+  }
+}
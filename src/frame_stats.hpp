@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+
+#include "spsc_queue.hpp"
+
+constexpr std::size_t maxGpuScopes{8};
+
+struct GpuScopeTiming {
+  const char*  name;   // Outlives the frame, usually a string literal.
+  std::int32_t parent; // Index of the enclosing scope, -1 for none.
+  std::int64_t ns;
+};
+
+struct FrameTiming {
+  std::uint64_t  frame;
+  std::int64_t   submitNs;        // Events and draw calls.
+  std::int64_t   swapNs;          // SwapBuffers and the fence after it.
+  std::int64_t   totalNs;         // Since the end of the previous frame.
+  std::int64_t   gpuNs;           // First to last GPU timestamp, -1 for none.
+  std::uint32_t  stateIssued;     // GL state calls passed to the driver.
+  std::uint32_t  stateElided;     // Redundant ones dropped by the state cache.
+  std::uint32_t  arenaBytes;      // Frame arena usage.
+  std::uint32_t  heapAllocations; // On the render thread, if counted.
+  std::uint32_t  scopeCount;
+  GpuScopeTiming scopes[maxGpuScopes];
+};
+
+// Frame time telemetry. The render thread only pushes a FrameTiming into a
+// lock-free ring, a writer thread drains it into percentile histograms,
+// flags stutters against the rolling median and, if asked to, appends
+// every frame to a CSV file.
+class FrameStats {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  FrameStats() noexcept = default;
+  FrameStats(const FrameStats&) = delete;
+  FrameStats& operator=(const FrameStats&) = delete;
+  ~FrameStats()
+  {
+    Stop();
+  }
+
+  // Starts the writer thread. Without a path only the summaries are
+  // logged, so that concurrent processes do not write the same file.
+  bool Start(const std::filesystem::path& path) noexcept;
+  void Stop() noexcept;
+
+  // CPU side of the next frame's timing, without GPU timings.
+  FrameTiming Measure(Clock::time_point begin,
+                      Clock::time_point submitted,
+                      Clock::time_point swapped) noexcept;
+  void        Record(const FrameTiming& timing) noexcept;
+
+  // Heap allocations of the frames past the warm-up, which counted builds
+  // treat as a failure. Read it once stopped.
+  std::uint64_t SteadyHeapAllocations() const noexcept
+  {
+    return m_steadyAllocations;
+  }
+
+private:
+  static constexpr std::chrono::milliseconds drainPeriod{100};
+  static constexpr std::chrono::seconds      summaryPeriod{10};
+  static constexpr std::size_t               medianWindow{120};
+  static constexpr std::uint64_t             warmUpFrames{120};
+
+  void Run(std::filesystem::path path) noexcept;
+
+  SpscQueue<FrameTiming, 1024> m_ring;
+  std::atomic<std::size_t>     m_dropped{0};
+  std::uint64_t                m_frame{0};
+  std::uint64_t                m_steadyAllocations{0}; // The writer's.
+  Clock::time_point            m_lastSwapped{};
+
+  std::thread             m_writer;
+  std::mutex              m_mutex;
+  std::condition_variable m_wake;
+  bool                    m_bStop{false};
+};
@@ -0,0 +1,330 @@
+#include "frustum_culling.hpp"
+#include "job_system.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) \
+  || defined(_M_IX86)
+#define CULLING_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC compiles any intrinsic without being told the target.
+#define CULLING_TARGET(isa)
+#else
+#define CULLING_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+// Chunks handed to the job system, few enough to count on the stack and
+// large enough to be worth a job.
+constexpr std::size_t maxChunks{64};
+constexpr std::size_t minChunkSize{4096};
+
+static CullingIsa Detect() noexcept
+{
+#if !defined(CULLING_X86)
+  return CullingIsa::scalar;
+#elif defined(_MSC_VER)
+  // The OS must also save the wider registers on context switches, which
+  // XCR0 tells.
+  int info[4]{};
+
+  __cpuid(info, 0);
+  const auto maxLeaf{info[0]};
+
+  __cpuid(info, 1);
+  const auto bSse2{0 != (info[3] & (1 << 26))};
+  const auto bXsave{0 != (info[2] & (1 << 27))};
+  const auto xcr0{bXsave ? _xgetbv(0) : 0};
+
+  if (7 <= maxLeaf) {
+    __cpuidex(info, 7, 0);
+    if (0 != (info[1] & (1 << 16)) && 0xe6 == (xcr0 & 0xe6)) {
+      return CullingIsa::avx512;
+    }
+    if (0 != (info[1] & (1 << 5)) && 0x6 == (xcr0 & 0x6)) {
+      return CullingIsa::avx2;
+    }
+  }
+
+  return bSse2 ? CullingIsa::sse2 : CullingIsa::scalar;
+#else
+  __builtin_cpu_init();
+
+  return __builtin_cpu_supports("avx512f") ? CullingIsa::avx512
+         : __builtin_cpu_supports("avx2")  ? CullingIsa::avx2
+         : __builtin_cpu_supports("sse2")  ? CullingIsa::sse2
+                                           : CullingIsa::scalar;
+#endif
+}
+
+// Rejects a sphere that lies entirely behind a plane, the comparison the
+// SIMD kernels make too, so they agree on spheres touching a plane.
+static std::size_t CullScalar(const SphereBounds& bounds,
+                              const float (&planes)[6][4],
+                              std::size_t         begin,
+                              std::size_t         end,
+                              std::uint32_t*      pVisible) noexcept
+{
+  std::size_t visible{0};
+
+  for (auto i{begin}; i < end; ++i) {
+    const auto x{bounds.pX[i]};
+    const auto y{bounds.pY[i]};
+    const auto z{bounds.pZ[i]};
+    const auto negativeRadius{-bounds.pRadius[i]};
+    auto       bInside{true};
+
+    for (const auto& plane : planes) {
+      const auto distance{plane[0] * x + plane[1] * y + plane[2] * z
+                          + plane[3]};
+
+      bInside &= !(distance < negativeRadius);
+    }
+
+    // Branchless, the slot past the last visible one may be written.
+    pVisible[visible]  = static_cast<std::uint32_t>(i);
+    visible           += bInside;
+  }
+
+  return visible;
+}
+
+#ifdef CULLING_X86
+CULLING_TARGET("sse2")
+static std::size_t CullSse2(const SphereBounds& bounds,
+                            const float (&planes)[6][4],
+                            std::size_t         begin,
+                            std::size_t         end,
+                            std::uint32_t*      pVisible) noexcept
+{
+  __m128      plane[6][4];
+  std::size_t visible{0};
+  auto        i{begin};
+
+  for (auto p{0}; p < 6; ++p) {
+    for (auto c{0}; c < 4; ++c) {
+      plane[p][c] = _mm_set1_ps(planes[p][c]);
+    }
+  }
+
+  for (; end - i >= 4; i += 4) {
+    const auto x{_mm_loadu_ps(bounds.pX + i)};
+    const auto y{_mm_loadu_ps(bounds.pY + i)};
+    const auto z{_mm_loadu_ps(bounds.pZ + i)};
+    const auto negativeRadius{
+      _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(bounds.pRadius + i))};
+    auto inside{_mm_castsi128_ps(_mm_set1_epi32(-1))};
+
+    for (const auto& p : plane) {
+      const auto distance{_mm_add_ps(
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(p[0], x), _mm_mul_ps(p[1], y)),
+                   _mm_mul_ps(p[2], z)),
+        p[3])};
+
+      inside = _mm_and_ps(inside, _mm_cmpnlt_ps(distance, negativeRadius));
+    }
+
+    for (auto mask{static_cast<unsigned>(_mm_movemask_ps(inside))}; mask;
+         mask &= mask - 1) {
+      pVisible[visible++] = static_cast<std::uint32_t>(
+        i + static_cast<unsigned>(std::countr_zero(mask)));
+    }
+  }
+
+  return visible
+         + CullScalar(bounds, planes, i, end, pVisible + visible);
+}
+
+CULLING_TARGET("avx2")
+static std::size_t CullAvx2(const SphereBounds& bounds,
+                            const float (&planes)[6][4],
+                            std::size_t         begin,
+                            std::size_t         end,
+                            std::uint32_t*      pVisible) noexcept
+{
+  __m256      plane[6][4];
+  std::size_t visible{0};
+  auto        i{begin};
+
+  for (auto p{0}; p < 6; ++p) {
+    for (auto c{0}; c < 4; ++c) {
+      plane[p][c] = _mm256_set1_ps(planes[p][c]);
+    }
+  }
+
+  for (; end - i >= 8; i += 8) {
+    const auto x{_mm256_loadu_ps(bounds.pX + i)};
+    const auto y{_mm256_loadu_ps(bounds.pY + i)};
+    const auto z{_mm256_loadu_ps(bounds.pZ + i)};
+    const auto negativeRadius{_mm256_sub_ps(
+      _mm256_setzero_ps(), _mm256_loadu_ps(bounds.pRadius + i))};
+    auto inside{_mm256_castsi256_ps(_mm256_set1_epi32(-1))};
+
+    for (const auto& p : plane) {
+      const auto distance{_mm256_add_ps(
+        _mm256_add_ps(
+          _mm256_add_ps(_mm256_mul_ps(p[0], x), _mm256_mul_ps(p[1], y)),
+          _mm256_mul_ps(p[2], z)),
+        p[3])};
+
+      inside = _mm256_and_ps(
+        inside, _mm256_cmp_ps(distance, negativeRadius, _CMP_NLT_UQ));
+    }
+
+    for (auto mask{static_cast<unsigned>(_mm256_movemask_ps(inside))}; mask;
+         mask &= mask - 1) {
+      pVisible[visible++] = static_cast<std::uint32_t>(
+        i + static_cast<unsigned>(std::countr_zero(mask)));
+    }
+  }
+
+  return visible
+         + CullScalar(bounds, planes, i, end, pVisible + visible);
+}
+
+// Masks replace the bit scanning, a compress store writes the indices of
+// the visible lanes next to each other.
+CULLING_TARGET("avx512f")
+static std::size_t CullAvx512(const SphereBounds& bounds,
+                              const float (&planes)[6][4],
+                              std::size_t         begin,
+                              std::size_t         end,
+                              std::uint32_t*      pVisible) noexcept
+{
+  __m512      plane[6][4];
+  std::size_t visible{0};
+  auto        i{begin};
+
+  const auto lanes{_mm512_setr_epi32(
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15)};
+
+  for (auto p{0}; p < 6; ++p) {
+    for (auto c{0}; c < 4; ++c) {
+      plane[p][c] = _mm512_set1_ps(planes[p][c]);
+    }
+  }
+
+  for (; end - i >= 16; i += 16) {
+    const auto x{_mm512_loadu_ps(bounds.pX + i)};
+    const auto y{_mm512_loadu_ps(bounds.pY + i)};
+    const auto z{_mm512_loadu_ps(bounds.pZ + i)};
+    const auto negativeRadius{_mm512_sub_ps(
+      _mm512_setzero_ps(), _mm512_loadu_ps(bounds.pRadius + i))};
+    __mmask16 inside{0xffff};
+
+    for (const auto& p : plane) {
+      const auto distance{_mm512_add_ps(
+        _mm512_add_ps(
+          _mm512_add_ps(_mm512_mul_ps(p[0], x), _mm512_mul_ps(p[1], y)),
+          _mm512_mul_ps(p[2], z)),
+        p[3])};
+
+      inside = _mm512_mask_cmp_ps_mask(
+        inside, distance, negativeRadius, _CMP_NLT_UQ);
+    }
+
+    _mm512_mask_compressstoreu_epi32(
+      pVisible + visible,
+      inside,
+      _mm512_add_epi32(_mm512_set1_epi32(static_cast<int>(i)), lanes));
+    visible += static_cast<std::size_t>(std::popcount(
+      static_cast<unsigned>(inside)));
+  }
+
+  return visible
+         + CullScalar(bounds, planes, i, end, pVisible + visible);
+}
+#endif
+
+CullingIsa DetectCullingIsa() noexcept
+{
+  static const auto isa{Detect()};
+
+  return isa;
+}
+
+const char* CullingIsaName(CullingIsa isa) noexcept
+{
+  switch (isa) {
+  case CullingIsa::avx512:
+    return "AVX-512";
+  case CullingIsa::avx2:
+    return "AVX2";
+  case CullingIsa::sse2:
+    return "SSE2";
+  case CullingIsa::scalar:
+    break;
+  }
+
+  return "scalar";
+}
+
+std::size_t CullSphereRange(CullingIsa          isa,
+                            const SphereBounds& bounds,
+                            const float (&planes)[6][4],
+                            std::size_t         begin,
+                            std::size_t         end,
+                            std::uint32_t*      pVisible) noexcept
+{
+  switch (isa) {
+#ifdef CULLING_X86
+  case CullingIsa::avx512:
+    return CullAvx512(bounds, planes, begin, end, pVisible);
+  case CullingIsa::avx2:
+    return CullAvx2(bounds, planes, begin, end, pVisible);
+  case CullingIsa::sse2:
+    return CullSse2(bounds, planes, begin, end, pVisible);
+#endif
+  default:
+    break;
+  }
+
+  return CullScalar(bounds, planes, begin, end, pVisible);
+}
+
+// Every chunk writes its list where its spheres start, the lists are
+// moved together afterwards, which keeps the indices ascending whatever
+// thread ran which chunk.
+std::size_t CullSpheres(const SphereBounds& bounds,
+                        const float (&planes)[6][4],
+                        std::uint32_t*      pVisible) noexcept
+{
+  std::size_t counts[maxChunks]{};
+  std::size_t visible{0};
+
+  const auto isa{DetectCullingIsa()};
+  const auto chunkSize{std::max(minChunkSize,
+                                (bounds.count + maxChunks - 1) / maxChunks)};
+  const auto chunks{(bounds.count + chunkSize - 1) / chunkSize};
+
+  if (chunks <= 1) {
+    return CullSphereRange(isa, bounds, planes, 0, bounds.count, pVisible);
+  }
+
+  jobSystem.ParallelFor(
+    "frustum culling",
+    chunks,
+    1,
+    [&](std::size_t first, std::size_t last) {
+      for (auto chunk{first}; chunk < last; ++chunk) {
+        const auto begin{chunk * chunkSize};
+        const auto end{std::min(begin + chunkSize, bounds.count)};
+
+        counts[chunk] = CullSphereRange(
+          isa, bounds, planes, begin, end, pVisible + begin);
+      }
+    });
+
+  for (std::size_t chunk{0}; chunk < chunks; ++chunk) {
+    std::memmove(pVisible + visible,
+                 pVisible + chunk * chunkSize,
+                 counts[chunk] * sizeof *pVisible);
+    visible += counts[chunk];
+  }
+
+  return visible;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Bounding spheres in structure-of-arrays layout, so that one SIMD
+// register holds the same coordinate of 4, 8 or 16 spheres.
+struct SphereBounds {
+  const float* pX;
+  const float* pY;
+  const float* pZ;
+  const float* pRadius;
+  std::size_t  count;
+};
+
+// Widest first.
+enum class CullingIsa : std::uint8_t { avx512, avx2, sse2, scalar };
+
+// The widest instruction set that both the CPU and the build support,
+// detected on first use.
+CullingIsa  DetectCullingIsa() noexcept;
+const char* CullingIsaName(CullingIsa isa) noexcept;
+
+// Writes the ascending indices of the spheres that intersect the frustum
+// to pVisible, which must hold bounds.count of them, and returns their
+// number. The planes are ax + by + cz + d with their normals pointing
+// inside. Large sets are split across the job system.
+std::size_t CullSpheres(const SphereBounds& bounds,
+                        const float (&planes)[6][4],
+                        std::uint32_t*      pVisible) noexcept;
+
+// The same over the spheres [begin, end) on the calling thread with the
+// given instruction set, which the CPU must support.
+std::size_t CullSphereRange(CullingIsa          isa,
+                            const SphereBounds& bounds,
+                            const float (&planes)[6][4],
+                            std::size_t         begin,
+                            std::size_t         end,
+                            std::uint32_t*      pVisible) noexcept;
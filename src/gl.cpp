@@ -0,0 +1,154 @@
+#include "gl.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+
+GlDispatch gl{};
+
+int          glVersion{0};
+ExtensionSet glExtensions;
+
+static GlGetProcAddress         lazyGetProcAddress{nullptr};
+static std::atomic<std::size_t> resolvedCount{0};
+static std::atomic_flag         unresolvedLogged[glDispatchSize];
+
+static GlProc* Slots() noexcept
+{
+  return reinterpret_cast<GlProc*>(&gl);
+}
+
+GlProc GlResolveLazy(std::size_t slot) noexcept
+{
+  const auto proc{lazyGetProcAddress(glDispatchNames[slot])};
+  auto       expected{glDispatchTrampolines[slot]};
+
+  // The trampoline stays in the slot and skips the call, a null slot would
+  // crash every later call.
+  if (!proc) {
+    if (!unresolvedLogged[slot].test_and_set(std::memory_order_relaxed)) {
+      Log("gl: %s cannot be resolved, calls are skipped",
+          glDispatchNames[slot]);
+    }
+    return nullptr;
+  }
+
+  // Threads sharing the dispatch table may race on the first call, only
+  // count the one that patches the slot.
+  if (std::atomic_ref{Slots()[slot]}.compare_exchange_strong(expected, proc)) {
+    resolvedCount.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  return proc;
+}
+
+std::size_t GlResolvedCount() noexcept
+{
+  return resolvedCount.load(std::memory_order_relaxed);
+}
+
+static int QueryGlVersion() noexcept
+{
+  GLint major{0};
+  GLint minor{0};
+
+  // GL_MAJOR_VERSION and GL_MINOR_VERSION exist since OpenGL 3.0.
+  glGetIntegerv(GL_MAJOR_VERSION, &major);
+  glGetIntegerv(GL_MINOR_VERSION, &minor);
+  if (major <= 0) {
+    const auto version{reinterpret_cast<const char*>(glGetString(GL_VERSION))};
+
+    if (!version || 2 != std::sscanf(version, "%d.%d", &major, &minor)) {
+      return 0;
+    }
+  }
+
+  return major * 10 + minor;
+}
+
+static bool LoadGlExtensions() noexcept
+{
+  GLint n{0};
+
+  glExtensions.Clear();
+
+  // Core profiles removed GL_EXTENSIONS from glGetString.
+  if (glVersion >= 30 && glGetStringi) {
+    glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+    if (!glExtensions.Reserve(static_cast<std::size_t>(std::max(n, 0)))) {
+      return false;
+    }
+    for (GLint i{0}; i < n; ++i) {
+      const auto extension{reinterpret_cast<const char*>(
+        glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i)))};
+
+      if (extension && !glExtensions.Insert(extension)) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+  else {
+    return glExtensions.InsertAll(
+      reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS)));
+  }
+}
+
+bool LoadGl(GlGetProcAddress getProcAddress, GlBinding binding) noexcept
+{
+  const auto slots{Slots()};
+
+  gl                 = {};
+  lazyGetProcAddress = getProcAddress;
+  resolvedCount      = 0;
+  for (auto& bLogged : unresolvedLogged) {
+    bLogged.clear(std::memory_order_relaxed);
+  }
+
+#define GPA(fn) \
+  if ((fn = reinterpret_cast<decltype(fn)>(getProcAddress(#fn)))) { \
+    ++resolvedCount; \
+  }
+
+  // Needed to tell which features the context supports, so these are
+  // always bound eagerly.
+  GPA(glGetString);
+  GPA(glGetStringi);
+  GPA(glGetIntegerv);
+
+#undef GPA
+
+  if (!glGetString || !glGetIntegerv) {
+    return false;
+  }
+
+  glVersion = QueryGlVersion();
+  if (0 == glVersion || !LoadGlExtensions()) {
+    return false;
+  }
+
+  for (const auto& feature : glDispatchFeatures) {
+    if (feature.version ? feature.version <= glVersion
+                        : glExtensions.Contains(feature.extension)) {
+      for (auto i{feature.first}; i < feature.first + feature.count; ++i) {
+        if (slots[i]) {
+          continue;
+        }
+
+        if (GlBinding::lazy == binding) {
+          slots[i] = glDispatchTrampolines[i];
+        }
+        else {
+          slots[i] = getProcAddress(glDispatchNames[i]);
+          if (slots[i]) {
+            ++resolvedCount;
+          }
+        }
+      }
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "extensions.hpp"
+#include "gl_dispatch.hpp"
+
+#include <cstddef>
+
+using GlProc           = void (*)();
+using GlGetProcAddress = GlProc (*)(const char* name);
+
+// Eager binding resolves every supported entry point in LoadGl, lazy
+// binding points each slot at a trampoline that resolves it on first call.
+enum class GlBinding { eager, lazy };
+
+#ifdef POLYCHROME_LAZY_GL
+constexpr auto glDefaultBinding{GlBinding::lazy};
+#else
+constexpr auto glDefaultBinding{GlBinding::eager};
+#endif
+
+// Version of the current context, e.g. 45 for OpenGL 4.5, and its
+// extensions. Both are filled by LoadGl.
+extern int          glVersion;
+extern ExtensionSet glExtensions;
+
+// Binds the entry points of every GL version and extension in the dispatch
+// table that the current context supports and clears all others. The
+// context must be current on the calling thread.
+bool LoadGl(GlGetProcAddress getProcAddress,
+            GlBinding        binding = glDefaultBinding) noexcept;
+
+// Number of entry points resolved so far. With lazy binding this is the
+// number of distinct entry points actually called.
+std::size_t GlResolvedCount() noexcept;
@@ -0,0 +1,183 @@
+#include "gpu_profiler.hpp"
+#include "log.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+GpuProfiler gpuProfiler;
+
+bool GpuProfiler::Init() noexcept
+{
+  GLint bits{0};
+
+  Release();
+
+  if (glVersion >= 33) {
+    glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+  }
+
+  m_bEnabled = 0 < bits;
+  if (m_bEnabled) {
+    for (auto& slot : m_slots) {
+      glGenQueries(static_cast<GLsizei>(std::size(slot.queries)),
+                   slot.queries);
+    }
+
+    if (traceEnabled) {
+      GLint64 gpuNs{0};
+
+      glGetInteger64v(GL_TIMESTAMP, &gpuNs);
+      SetTraceGpuClock(gpuNs, TraceNow());
+    }
+  }
+
+  Log("gpu profiler: %s, %d bit timestamps",
+      m_bEnabled ? "enabled" : "disabled",
+      bits);
+
+  return true;
+}
+
+void GpuProfiler::Release() noexcept
+{
+  if (m_bEnabled) {
+    FrameTiming timing{};
+
+    // Frames nobody drained still get their zones into the trace.
+    while (Drain(&timing)) {
+    }
+
+    for (auto& slot : m_slots) {
+      glDeleteQueries(static_cast<GLsizei>(std::size(slot.queries)),
+                      slot.queries);
+      slot = {};
+    }
+  }
+
+  m_frame    = 0;
+  m_depth    = 0;
+  m_bEnabled = false;
+}
+
+void GpuProfiler::BeginFrame() noexcept
+{
+  m_slots[m_frame % latency].timing.scopeCount = 0;
+  m_depth                                      = 0;
+}
+
+int GpuProfiler::Begin(const char* name) noexcept
+{
+  auto& timing{m_slots[m_frame % latency].timing};
+
+  if (!m_bEnabled || maxGpuScopes == timing.scopeCount) {
+    return -1;
+  }
+
+  const auto scope{static_cast<std::int32_t>(timing.scopeCount++)};
+
+  timing.scopes[scope] = {name, m_depth ? m_stack[m_depth - 1] : -1, 0};
+  glQueryCounter(m_slots[m_frame % latency].queries[2 * scope], GL_TIMESTAMP);
+  m_stack[m_depth++] = scope;
+
+  return scope;
+}
+
+void GpuProfiler::End(int scope) noexcept
+{
+  if (scope < 0) {
+    return;
+  }
+
+  glQueryCounter(m_slots[m_frame % latency].queries[2 * scope + 1],
+                 GL_TIMESTAMP);
+  --m_depth;
+}
+
+bool GpuProfiler::Merge(FrameTiming* pTiming) noexcept
+{
+  if (!m_bEnabled) {
+    return true;
+  }
+
+  // Keep the scopes recorded into the slot, take everything else.
+  auto& current{m_slots[m_frame % latency]};
+
+  current.timing.frame           = pTiming->frame;
+  current.timing.submitNs        = pTiming->submitNs;
+  current.timing.swapNs          = pTiming->swapNs;
+  current.timing.totalNs         = pTiming->totalNs;
+  current.timing.stateIssued     = pTiming->stateIssued;
+  current.timing.stateElided     = pTiming->stateElided;
+  current.timing.arenaBytes      = pTiming->arenaBytes;
+  current.timing.heapAllocations = pTiming->heapAllocations;
+  current.bPending               = true;
+
+  // The slot of the oldest frame is the next one to be written.
+  auto& oldest{m_slots[++m_frame % latency]};
+  if (!oldest.bPending) {
+    return false;
+  }
+
+  Resolve(oldest);
+  *pTiming        = oldest.timing;
+  oldest.bPending = false;
+
+  return true;
+}
+
+bool GpuProfiler::Drain(FrameTiming* pTiming) noexcept
+{
+  // The slot of the oldest frame is the next one to be written.
+  for (std::size_t i{0}; i < latency; ++i) {
+    auto& slot{m_slots[(m_frame + i) % latency]};
+
+    if (slot.bPending) {
+      Resolve(slot);
+      *pTiming      = slot.timing;
+      slot.bPending = false;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void GpuProfiler::Resolve(Slot& slot) noexcept
+{
+  auto&      timing{slot.timing};
+  const auto count{static_cast<GLsizei>(2 * timing.scopeCount)};
+  GLint      available{GL_TRUE};
+  GLuint64   first{std::numeric_limits<GLuint64>::max()};
+  GLuint64   last{0};
+
+  timing.gpuNs = -1;
+
+  for (GLsizei i{0}; i < count && available; ++i) {
+    glGetQueryObjectiv(slot.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+  }
+
+  if (!available || 0 == count) {
+    timing.scopeCount = 0;
+    return;
+  }
+
+  for (std::uint32_t i{0}; i < timing.scopeCount; ++i) {
+    GLuint64 begin{0};
+    GLuint64 end{0};
+
+    glGetQueryObjectui64v(slot.queries[2 * i], GL_QUERY_RESULT, &begin);
+    glGetQueryObjectui64v(slot.queries[2 * i + 1], GL_QUERY_RESULT, &end);
+
+    timing.scopes[i].ns = static_cast<std::int64_t>(end - begin);
+    first               = std::min(first, begin);
+    last                = std::max(last, end);
+
+    RecordTraceGpuZone(timing.scopes[i].name,
+                       static_cast<std::int64_t>(begin),
+                       static_cast<std::int64_t>(end));
+  }
+
+  timing.gpuNs = static_cast<std::int64_t>(last - first);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "frame_stats.hpp"
+#include "gl.hpp"
+
+// GPU profiler built on GL_TIMESTAMP queries, which unlike GL_TIME_ELAPSED
+// may nest. Every frame writes its queries into one of a few slots and a
+// slot is only read back right before it is reused, when the GPU has
+// almost always finished it. A slot whose results are still outstanding
+// then loses its GPU timings rather than stalling the frame.
+class GpuProfiler {
+public:
+  static constexpr std::size_t latency{4}; // Frames until read back.
+
+  GpuProfiler() noexcept = default;
+  GpuProfiler(const GpuProfiler&) = delete;
+  GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+  // Needs OpenGL 3.3 and a timestamp counter; profiles nothing otherwise.
+  bool Init() noexcept;
+  // Reads back the frames still in flight, which the GPU should have
+  // finished by then, and deletes the query objects. Needs the context to
+  // be current.
+  void Release() noexcept;
+
+  void BeginFrame() noexcept;
+  // Returns the scope to pass to End, -1 if it is not timed.
+  int  Begin(const char* name) noexcept;
+  void End(int scope) noexcept;
+
+  // Stores the CPU timing of the frame that just ended and replaces it
+  // with the oldest frame in flight, GPU timings merged in. False while
+  // the first frames are still in flight.
+  bool Merge(FrameTiming* pTiming) noexcept;
+  // Takes the frames still in flight one at a time, oldest first, e.g.
+  // after glFinish at exit. False once there are none.
+  bool Drain(FrameTiming* pTiming) noexcept;
+
+private:
+  struct Slot {
+    GLuint      queries[2 * maxGpuScopes];
+    FrameTiming timing;
+    bool        bPending;
+  };
+
+  void Resolve(Slot& slot) noexcept;
+
+  Slot         m_slots[latency]{};
+  std::size_t  m_frame{0};
+  std::int32_t m_stack[maxGpuScopes]{};
+  std::size_t  m_depth{0};
+  bool         m_bEnabled{false};
+};
+
+extern GpuProfiler gpuProfiler;
+
+// Times the enclosing block on the GPU.
+class GpuScope {
+public:
+  explicit GpuScope(const char* name) noexcept :
+    m_scope{gpuProfiler.Begin(name)}
+  {
+  }
+  GpuScope(const GpuScope&) = delete;
+  GpuScope& operator=(const GpuScope&) = delete;
+  ~GpuScope()
+  {
+    gpuProfiler.End(m_scope);
+  }
+
+private:
+  int m_scope;
+};
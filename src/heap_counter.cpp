@@ -0,0 +1,73 @@
+#include "heap_counter.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+static thread_local std::uint64_t threadHeapAllocations{0};
+
+std::uint64_t ThreadHeapAllocations() noexcept
+{
+  return threadHeapAllocations;
+}
+
+#ifdef POLYCHROME_COUNT_ALLOCATIONS
+// The array and nothrow forms call these by default, so replacing the
+// plain and the aligned form catches every new expression.
+void* operator new(std::size_t size)
+{
+  ++threadHeapAllocations;
+
+  if (const auto p{std::malloc(size ? size : 1)}) {
+    return p;
+  }
+  throw std::bad_alloc{};
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+  const auto align{static_cast<std::size_t>(alignment)};
+
+  ++threadHeapAllocations;
+
+  // Both want the size to be a multiple of the alignment.
+  size = (std::max<std::size_t>(size, 1) + align - 1) & ~(align - 1);
+#ifdef _WIN32
+  if (const auto p{_aligned_malloc(size, align)}) {
+#else
+  if (const auto p{std::aligned_alloc(align, size)}) {
+#endif
+    return p;
+  }
+  throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+#ifdef _WIN32
+  _aligned_free(p);
+#else
+  std::free(p);
+#endif
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t alignment) noexcept
+{
+  operator delete(p, alignment);
+}
+#endif
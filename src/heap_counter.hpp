@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+
+// With POLYCHROME_COUNT_ALLOCATIONS the global operator new is replaced to
+// count heap allocations per thread, and the process fails if frames in
+// steady state still allocate on the render thread.
+#ifdef POLYCHROME_COUNT_ALLOCATIONS
+constexpr bool heapAllocationsCounted{true};
+#else
+constexpr bool heapAllocationsCounted{false};
+#endif
+
+// Heap allocations of the calling thread so far, always zero unless
+// counted.
+std::uint64_t ThreadHeapAllocations() noexcept;
@@ -0,0 +1,222 @@
+#include "hi_z_pyramid.hpp"
+#include "gpu_profiler.hpp"
+#include "shader_library.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <iterator>
+
+constexpr GLuint groupSize{8};
+
+namespace {
+
+enum class DownsampleFeature : std::uint8_t { fromDepth };
+
+} // namespace
+
+constexpr ShaderFeature downsampleFeatures[]{{"FROM_DEPTH", 430}};
+
+// Every texel takes the farthest of the 2x2 texels below it. Level zero is
+// downsampled from the depth copy, the other levels from the level above.
+static const ShaderSource downsampleSource{"hi_z_downsample.comp", R"(
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(r32f, binding = 0) writeonly uniform image2D u_destination;
+
+#ifdef FROM_DEPTH
+layout(binding = 14) uniform sampler2D u_source;
+
+#define SOURCE_SIZE textureSize(u_source, 0)
+#define LOAD(texel) texelFetch(u_source, texel, 0).r
+#else
+layout(r32f, binding = 1) readonly uniform image2D u_source;
+
+#define SOURCE_SIZE imageSize(u_source)
+#define LOAD(texel) imageLoad(u_source, texel).r
+#endif
+
+void main()
+{
+  ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+  ivec2 size = imageSize(u_destination);
+  ivec2 sourceSize = SOURCE_SIZE;
+
+  if (any(greaterThanEqual(texel, size))) {
+    return;
+  }
+
+  // The last texel also takes an odd last row or column.
+  ivec2 last = min(2 * texel + 1
+                     + ivec2(equal(texel, size - 1)) * (sourceSize & 1),
+                   sourceSize - 1);
+  float depth = 0.0;
+
+  for (int y = 2 * texel.y; y <= last.y; ++y) {
+    for (int x = 2 * texel.x; x <= last.x; ++x) {
+      depth = max(depth, LOAD(ivec2(x, y)));
+    }
+  }
+
+  imageStore(u_destination, texel, vec4(depth));
+}
+)"};
+
+static const ShaderSource* const downsampleSources[]{&downsampleSource};
+
+static const ShaderFamily<DownsampleFeature> downsampleFamily{
+  {"hi-z-downsample",
+   430,
+   downsampleFeatures,
+   std::size(downsampleFeatures),
+   {},
+   {},
+   {downsampleSources, 1}}};
+
+constexpr GLuint GroupCount(GLsizei size) noexcept
+{
+  return (static_cast<GLuint>(size) + groupSize - 1) / groupSize;
+}
+
+bool HiZPyramid::Init() noexcept
+{
+  Release();
+
+  shaderLibrary.Prewarm(downsampleFamily);
+  m_pCopyProgram = shaderLibrary.Request(
+    downsampleFamily, {DownsampleFeature::fromDepth});
+  m_pReduceProgram = shaderLibrary.Request(downsampleFamily, {});
+  if (!m_pCopyProgram || m_pCopyProgram->Failed() || !m_pReduceProgram
+      || m_pReduceProgram->Failed()) {
+    Release();
+    return false;
+  }
+
+  return true;
+}
+
+void HiZPyramid::Release() noexcept
+{
+  // Deleting zero is silently ignored.
+  glDeleteTextures(1, &m_pyramid);
+  glDeleteTextures(1, &m_depth);
+
+  m_pCopyProgram   = nullptr;
+  m_pReduceProgram = nullptr;
+  m_depth          = 0;
+  m_pyramid        = 0;
+  m_width          = 0;
+  m_height         = 0;
+  m_levels         = 0;
+  m_bValid         = false;
+}
+
+bool HiZPyramid::Resize(GLsizei width, GLsizei height) noexcept
+{
+#if GL_DISPATCH_VERSION >= 43
+  glDeleteTextures(1, &m_pyramid);
+  glDeleteTextures(1, &m_depth);
+  m_pyramid = 0;
+  m_depth   = 0;
+  m_width   = 0;
+  m_height  = 0;
+  m_levels  = 0;
+
+  const auto levelWidth{std::max(width / 2, 1)};
+  const auto levelHeight{std::max(height / 2, 1)};
+  const auto levels{static_cast<GLint>(std::bit_width(
+    static_cast<unsigned>(std::max(levelWidth, levelHeight))))};
+
+  glActiveTexture(GL_TEXTURE0 + textureUnit);
+
+  glGenTextures(1, &m_depth);
+  glBindTexture(GL_TEXTURE_2D, m_depth);
+  glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+  glGenTextures(1, &m_pyramid);
+  glBindTexture(GL_TEXTURE_2D, m_pyramid);
+  glTexStorage2D(GL_TEXTURE_2D, levels, GL_R32F, levelWidth, levelHeight);
+  glTexParameteri(GL_TEXTURE_2D,
+                  GL_TEXTURE_MIN_FILTER,
+                  GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glActiveTexture(GL_TEXTURE0);
+
+  m_width  = width;
+  m_height = height;
+  m_levels = levels;
+
+  return true;
+#else
+  static_cast<void>(width);
+  static_cast<void>(height);
+  return false;
+#endif
+}
+
+void HiZPyramid::Capture(GLsizei width, GLsizei height) noexcept
+{
+#if GL_DISPATCH_VERSION >= 43
+  const auto copyProgram{m_pCopyProgram ? m_pCopyProgram->Poll() : 0};
+  const auto reduceProgram{m_pReduceProgram ? m_pReduceProgram->Poll() : 0};
+
+  if (!copyProgram || !reduceProgram || width <= 0 || height <= 0) {
+    return;
+  }
+
+  if ((width != m_width || height != m_height) && !Resize(width, height)) {
+    m_bValid = false;
+    return;
+  }
+
+  const GpuScope scope{"hi-z"};
+
+  // Depth formats cannot be images, so the depth buffer is copied into a
+  // depth texture first and downsampled from there into level zero.
+  glActiveTexture(GL_TEXTURE0 + textureUnit);
+  glBindTexture(GL_TEXTURE_2D, m_depth);
+  glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+
+  glUseProgram(copyProgram);
+  glBindImageTexture(0, m_pyramid, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+  glDispatchCompute(GroupCount(std::max(width / 2, 1)),
+                    GroupCount(std::max(height / 2, 1)),
+                    1);
+
+  glUseProgram(reduceProgram);
+  for (GLint level{1}; level < m_levels; ++level) {
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    glBindImageTexture(0,
+                       m_pyramid,
+                       level,
+                       GL_FALSE,
+                       0,
+                       GL_WRITE_ONLY,
+                       GL_R32F);
+    glBindImageTexture(1,
+                       m_pyramid,
+                       level - 1,
+                       GL_FALSE,
+                       0,
+                       GL_READ_ONLY,
+                       GL_R32F);
+    glDispatchCompute(GroupCount(std::max(width >> (level + 1), 1)),
+                      GroupCount(std::max(height >> (level + 1), 1)),
+                      1);
+  }
+
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glActiveTexture(GL_TEXTURE0);
+
+  m_bValid = true;
+#else
+  static_cast<void>(width);
+  static_cast<void>(height);
+#endif
+}
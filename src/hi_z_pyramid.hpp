@@ -0,0 +1,65 @@
+#pragma once
+
+#include "gl.hpp"
+#include "shader.hpp"
+
+// Hierarchical depth buffer for occlusion culling. Every level holds the
+// farthest depth of the 2x2 texels it covers in the level below, level
+// zero those of the depth buffer, so a few texel fetches bound the depth
+// behind any screen rectangle. Levels halve in size rounding down and an
+// odd last row or column folds into the texels next to it, so depth pixel
+// p is covered by texel min(p >> (level + 1), size - 1).
+class HiZPyramid {
+public:
+  // Unit the depth copy is sampled from while capturing, and the unit
+  // culling shaders are expected to bind the pyramid to.
+  static constexpr GLuint textureUnit{14};
+
+  HiZPyramid() noexcept = default;
+  HiZPyramid(const HiZPyramid&) = delete;
+  HiZPyramid& operator=(const HiZPyramid&) = delete;
+
+  // Needs OpenGL 4.3 for compute shaders. The programs build in the
+  // background, captures are skipped until they are linked.
+  bool Init() noexcept;
+  // Deletes the GL objects, needs the context to be current.
+  void Release() noexcept;
+
+  // Rebuilds the pyramid from the depth buffer of the read framebuffer,
+  // e.g. once a frame's draws were executed, for culling the next frame.
+  void Capture(GLsizei width, GLsizei height) noexcept;
+  bool Valid() const noexcept
+  {
+    return m_bValid;
+  }
+  // GL_R32F with Levels() levels, sample with texelFetch. Width and
+  // height are those of the depth buffer.
+  GLuint Texture() const noexcept
+  {
+    return m_pyramid;
+  }
+  GLsizei Width() const noexcept
+  {
+    return m_width;
+  }
+  GLsizei Height() const noexcept
+  {
+    return m_height;
+  }
+  GLint Levels() const noexcept
+  {
+    return m_levels;
+  }
+
+private:
+  bool Resize(GLsizei width, GLsizei height) noexcept;
+
+  AsyncProgram* m_pCopyProgram{nullptr}; // Owned by the shader library.
+  AsyncProgram* m_pReduceProgram{nullptr};
+  GLuint        m_depth{0};
+  GLuint        m_pyramid{0};
+  GLsizei       m_width{0};
+  GLsizei       m_height{0};
+  GLint         m_levels{0};
+  bool          m_bValid{false};
+};
@@ -0,0 +1,70 @@
+#include "histogram.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <iterator>
+
+void Histogram::Clear() noexcept
+{
+  std::fill(std::begin(m_buckets), std::end(m_buckets), 0);
+  m_count = 0;
+  m_max   = 0;
+}
+
+void Histogram::Add(std::uint64_t value) noexcept
+{
+  ++m_buckets[BucketOf(value)];
+  ++m_count;
+  m_max = std::max(m_max, value);
+}
+
+std::uint64_t Histogram::Percentile(double fraction) const noexcept
+{
+  if (0 == m_count) {
+    return 0;
+  }
+
+  const auto rank{std::max<std::uint64_t>(
+    1,
+    static_cast<std::uint64_t>(std::ceil(fraction * m_count)))};
+  std::uint64_t seen{0};
+
+  for (std::size_t i{0}; i < bucketCount; ++i) {
+    seen += m_buckets[i];
+    if (seen < rank) {
+      continue;
+    }
+
+    // Buckets below 16 hold one value each, all others cover 1/16 of
+    // their power of two.
+    constexpr std::size_t linear{std::size_t{1} << subBucketBits};
+    if (i < linear) {
+      return i;
+    }
+
+    const auto shift{static_cast<int>(i >> subBucketBits) - 1};
+    const auto lower{(linear + (i & (linear - 1))) << shift};
+
+    return std::min(lower + (std::uint64_t{1} << shift) / 2, m_max);
+  }
+
+  return m_max;
+}
+
+std::size_t Histogram::BucketOf(std::uint64_t value) noexcept
+{
+  constexpr std::uint64_t linear{std::uint64_t{1} << subBucketBits};
+
+  if (value < linear) {
+    return static_cast<std::size_t>(value);
+  }
+
+  value = std::min(value, (std::uint64_t{1} << maxExponent) - 1);
+
+  const auto exponent{std::bit_width(value) - 1};
+  const auto shift{exponent - subBucketBits};
+
+  return static_cast<std::size_t>(shift + 1) << subBucketBits
+         | static_cast<std::size_t>((value >> shift) & (linear - 1));
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Log-linear histogram of durations in nanoseconds: every power of two is
+// split into 16 linear buckets, so any percentile is off by at most 1/16
+// of its value while the whole range up to about 18 minutes fits in a few
+// kilobytes.
+class Histogram {
+public:
+  void Clear() noexcept;
+  void Add(std::uint64_t value) noexcept;
+
+  std::uint64_t Count() const noexcept
+  {
+    return m_count;
+  }
+  std::uint64_t Max() const noexcept
+  {
+    return m_max;
+  }
+
+  // Midpoint of the bucket holding the given fraction of all values, e.g.
+  // 0.99 for p99.
+  std::uint64_t Percentile(double fraction) const noexcept;
+
+private:
+  static constexpr int subBucketBits{4};
+  static constexpr int maxExponent{40};
+  static constexpr std::size_t bucketCount{
+    (maxExponent - subBucketBits + 1) << subBucketBits};
+
+  static std::size_t BucketOf(std::uint64_t value) noexcept;
+
+  std::uint64_t m_buckets[bucketCount]{};
+  std::uint64_t m_count{0};
+  std::uint64_t m_max{0};
+};
@@ -0,0 +1,312 @@
+#include "job_system.hpp"
+#include "log.hpp"
+#include "trace.hpp"
+
+#include <exception>
+
+JobSystem jobSystem;
+
+static thread_local void* pThreadState{nullptr};
+
+bool JobSystem::Start(unsigned workerCount) noexcept
+{
+  Stop();
+
+  if (!workerCount) {
+    workerCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+  }
+  workerCount = std::min<unsigned>(workerCount, maxThreads / 2);
+
+  m_bStop.store(false, std::memory_order_relaxed);
+
+  const std::lock_guard lock{m_mutex};
+
+  // The workers of an earlier Start left their states registered, they are
+  // restarted first so that Start and Stop cycles don't use up the slots.
+  const auto count{m_threadCount.load(std::memory_order_relaxed)};
+  m_workerCount = 0;
+
+  for (std::size_t i{0}; i < count && m_workerCount < workerCount; ++i) {
+    auto& state{*m_threads[i]};
+
+    if (!state.bWorker) {
+      continue;
+    }
+
+    // Jobs left over by Stop are not run.
+    while (state.deque.Pop()) {
+    }
+
+    try {
+      state.thread = std::thread{&JobSystem::WorkerMain, this, &state};
+    }
+    catch (const std::exception&) {
+      break;
+    }
+
+    ++m_workerCount;
+  }
+
+  for (; m_workerCount < workerCount; ++m_workerCount) {
+    const auto index{m_threadCount.load(std::memory_order_relaxed)};
+
+    if (maxThreads == index) {
+      break;
+    }
+
+    try {
+      m_threads[index]          = std::make_unique<ThreadState>();
+      m_threads[index]->random  = static_cast<std::uint32_t>(index + 1);
+      m_threads[index]->bWorker = true;
+      m_threads[index]->thread  = std::thread{&JobSystem::WorkerMain,
+                                             this,
+                                             m_threads[index].get()};
+    }
+    catch (const std::exception&) {
+      m_threads[index].reset();
+      break;
+    }
+
+    m_threadCount.store(index + 1, std::memory_order_release);
+  }
+
+  Log("job system: %u worker(s)", m_workerCount);
+
+  return 0 < m_workerCount;
+}
+
+void JobSystem::Stop() noexcept
+{
+  m_bStop.store(true, std::memory_order_relaxed);
+  m_wake.fetch_add(1, std::memory_order_seq_cst);
+  m_wake.notify_all();
+
+  const auto count{m_threadCount.load(std::memory_order_acquire)};
+  for (std::size_t i{0}; i < count; ++i) {
+    if (m_threads[i]->thread.joinable()) {
+      m_threads[i]->thread.join();
+    }
+  }
+
+  // Thread states stay registered, other threads may still refer to them.
+  m_workerCount = 0;
+}
+
+bool JobSystem::AddDependency(Job* pJob, Job* pDependency) noexcept
+{
+  if (!pJob || !pDependency
+      || Job::maxDependents == pDependency->dependentCount) {
+    return false;
+  }
+
+  pDependency->dependents[pDependency->dependentCount++] = pJob;
+  pJob->blockers.fetch_add(1, std::memory_order_relaxed);
+
+  return true;
+}
+
+void JobSystem::Run(Job* pJob) noexcept
+{
+  if (pJob) {
+    Release(pJob);
+  }
+}
+
+void JobSystem::Wait(const Job* pJob, JobWait wait) noexcept
+{
+  if (!pJob) {
+    return;
+  }
+
+  if (JobWait::block == wait) {
+    for (auto unfinished{pJob->unfinished.load(std::memory_order_acquire)};
+         unfinished;
+         unfinished = pJob->unfinished.load(std::memory_order_acquire)) {
+      pJob->unfinished.wait(unfinished, std::memory_order_acquire);
+    }
+    return;
+  }
+
+  const auto pState{GetThreadState()};
+
+  while (pJob->unfinished.load(std::memory_order_acquire)) {
+    if (const auto pNext{pState ? FindJob(*pState) : nullptr}) {
+      Execute(pNext);
+    }
+    else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+// Threads register on their first job, which takes a lock once per thread.
+JobSystem::ThreadState* JobSystem::GetThreadState() noexcept
+{
+  if (!pThreadState) {
+    const std::lock_guard lock{m_mutex};
+    const auto            index{m_threadCount.load(std::memory_order_relaxed)};
+
+    if (maxThreads == index) {
+      return nullptr;
+    }
+
+    try {
+      m_threads[index] = std::make_unique<ThreadState>();
+    }
+    catch (const std::bad_alloc&) {
+      return nullptr;
+    }
+
+    m_threads[index]->random = static_cast<std::uint32_t>(index + 1);
+    m_threadCount.store(index + 1, std::memory_order_release);
+    pThreadState = m_threads[index].get();
+  }
+
+  return static_cast<ThreadState*>(pThreadState);
+}
+
+Job* JobSystem::Allocate(const char* name, Job* pParent) noexcept
+{
+  const auto pState{GetThreadState()};
+  if (!pState) {
+    return nullptr;
+  }
+
+  auto& job{pState->jobs[pState->nextJob++ % jobPoolSize]};
+
+  job.name           = name;
+  job.pParent        = pParent;
+  job.dependentCount = 0;
+  job.unfinished.store(1, std::memory_order_relaxed);
+  job.blockers.store(1, std::memory_order_relaxed);
+
+  if (pParent) {
+    pParent->unfinished.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  return &job;
+}
+
+// The thread's own newest job first, which is still hot in its cache,
+// then the oldest job of a random other thread.
+Job* JobSystem::FindJob(ThreadState& state) noexcept
+{
+  if (const auto pJob{state.deque.Pop()}) {
+    return pJob;
+  }
+
+  const auto count{m_threadCount.load(std::memory_order_acquire)};
+
+  state.random ^= state.random << 13;
+  state.random ^= state.random >> 17;
+  state.random ^= state.random << 5;
+
+  for (std::size_t i{0}; i < count; ++i) {
+    auto& victim{*m_threads[(state.random + i) % count]};
+
+    if (&victim != &state) {
+      if (const auto pJob{victim.deque.Steal()}) {
+        return pJob;
+      }
+    }
+  }
+
+  return nullptr;
+}
+
+void JobSystem::Execute(Job* pJob) noexcept
+{
+  if (traceEnabled) {
+    const auto begin{TraceNow()};
+    pJob->pRun(*pJob);
+    RecordTraceZone(pJob->name, begin, TraceNow());
+  }
+  else {
+    pJob->pRun(*pJob);
+  }
+
+  Finish(pJob);
+}
+
+void JobSystem::Finish(Job* pJob) noexcept
+{
+  // Copy everything out before the decrement, a waiter may return and let
+  // the job be recycled as soon as it sees the job finished. Dependents
+  // and the parent are fixed once the job was run.
+  const auto pParent{pJob->pParent};
+  const auto dependentCount{pJob->dependentCount};
+  Job*       dependents[Job::maxDependents];
+
+  std::copy_n(pJob->dependents, dependentCount, dependents);
+
+  if (1 != pJob->unfinished.fetch_sub(1, std::memory_order_acq_rel)) {
+    return;
+  }
+
+  // Only the address is used from here on, a blocked waiter wakes up.
+  pJob->unfinished.notify_all();
+
+  for (std::uint32_t i{0}; i < dependentCount; ++i) {
+    Release(dependents[i]);
+  }
+
+  if (pParent) {
+    Finish(pParent);
+  }
+}
+
+void JobSystem::Release(Job* pJob) noexcept
+{
+  if (1 != pJob->blockers.fetch_sub(1, std::memory_order_acq_rel)) {
+    return;
+  }
+
+  const auto pState{GetThreadState()};
+  if (!pState || !pState->deque.Push(pJob)) {
+    Execute(pJob);
+    return;
+  }
+
+  m_wake.fetch_add(1, std::memory_order_seq_cst);
+  if (m_sleeping.load(std::memory_order_seq_cst)) {
+    m_wake.notify_one();
+  }
+}
+
+void JobSystem::WorkerMain(ThreadState* pState) noexcept
+{
+  constexpr int spins{64};
+
+  pThreadState = pState;
+  SetTraceThreadName("job worker");
+
+  for (auto idle{0}; !m_bStop.load(std::memory_order_relaxed);) {
+    if (const auto pJob{FindJob(*pState)}) {
+      Execute(pJob);
+      idle = 0;
+      continue;
+    }
+
+    if (++idle < spins) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    // Sleep until the next job is queued, checking once more after
+    // announcing the sleep so that no wake-up is missed.
+    m_sleeping.fetch_add(1, std::memory_order_seq_cst);
+
+    const auto wake{m_wake.load(std::memory_order_seq_cst)};
+    if (const auto pJob{FindJob(*pState)}) {
+      m_sleeping.fetch_sub(1, std::memory_order_relaxed);
+      Execute(pJob);
+      idle = 0;
+      continue;
+    }
+
+    if (!m_bStop.load(std::memory_order_relaxed)) {
+      m_wake.wait(wake, std::memory_order_seq_cst);
+    }
+    m_sleeping.fetch_sub(1, std::memory_order_relaxed);
+  }
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+
+#include "work_stealing_deque.hpp"
+
+// A unit of work. Jobs live in a per-thread pool and are recycled after
+// jobPoolSize more jobs were created on the same thread, so a job must not
+// be referred to past the frame that created it.
+struct alignas(64) Job {
+  static constexpr std::size_t maxDependents{4};
+  static constexpr std::size_t payloadSize{48};
+
+  void (*pRun)(Job& job) noexcept;
+  const char*                         name;
+  Job*                                pParent;
+  // Itself and its unfinished children.
+  std::atomic<std::int32_t> unfinished;
+  // Unfinished dependencies, plus one until the job is run.
+  std::atomic<std::int32_t>           blockers;
+  std::uint32_t                       dependentCount;
+  Job*                                dependents[maxDependents];
+  alignas(std::max_align_t) std::byte payload[payloadSize];
+};
+
+enum class JobWait { help, block };
+
+// Work-stealing scheduler. Every worker, and every other thread once it
+// creates a job, owns a Chase-Lev deque it pushes its jobs onto and pops
+// them from, while idle threads steal the oldest jobs of others. A job
+// finishes once it and all of its children have run, which releases the
+// jobs depending on it.
+class JobSystem {
+public:
+  static constexpr std::size_t maxThreads{64};
+  static constexpr std::size_t jobPoolSize{4096};
+
+  JobSystem() noexcept = default;
+  JobSystem(const JobSystem&) = delete;
+  JobSystem& operator=(const JobSystem&) = delete;
+  ~JobSystem()
+  {
+    Stop();
+  }
+
+  // Zero workers means one per core but the calling one.
+  bool Start(unsigned workerCount) noexcept;
+  // Waits for the workers to exit, jobs still queued are not run.
+  void Stop() noexcept;
+
+  unsigned WorkerCount() const noexcept
+  {
+    return m_workerCount;
+  }
+
+  // Children must be created before their parent finishes, e.g. by the
+  // parent itself. The function must be trivially destructible and small,
+  // e.g. a lambda capturing a few pointers.
+  template<typename Function>
+  Job* Create(const char* name,
+              const Function& function,
+              Job*            pParent = nullptr) noexcept
+  {
+    static_assert(std::is_trivially_destructible_v<Function>);
+    static_assert(sizeof(Function) <= Job::payloadSize);
+    static_assert(alignof(Function) <= alignof(std::max_align_t));
+
+    const auto pJob{Allocate(name, pParent)};
+    if (!pJob) {
+      return nullptr;
+    }
+
+    new (pJob->payload) Function{function};
+    pJob->pRun = [](Job& job) noexcept {
+      (*std::launder(reinterpret_cast<Function*>(job.payload)))();
+    };
+
+    return pJob;
+  }
+
+  // Makes the job wait for another one. Both must not have been run yet.
+  // False if the dependency has too many dependents already.
+  bool AddDependency(Job* pJob, Job* pDependency) noexcept;
+  // Queues the job, or runs it once its dependencies finished. Null jobs,
+  // which Create returns once the thread limit is reached, are ignored.
+  void Run(Job* pJob) noexcept;
+  // Helping runs other jobs meanwhile, blocking sleeps until the job
+  // finished.
+  void Wait(const Job* pJob, JobWait wait = JobWait::help) noexcept;
+
+  // Calls function(begin, end) on chunks of [0, count) of at least grain
+  // items in parallel and waits for all of them, helping.
+  template<typename Function>
+  void ParallelFor(const char*     name,
+                   std::size_t     count,
+                   std::size_t     grain,
+                   const Function& function) noexcept
+  {
+    const auto maxChunks{4 * (std::size_t{m_workerCount} + 1)};
+    const auto chunks{
+      std::min((count + grain - 1) / std::max<std::size_t>(grain, 1),
+               maxChunks)};
+
+    if (chunks <= 1) {
+      function(std::size_t{0}, count);
+      return;
+    }
+
+    const auto pRoot{Create(name, [] {})};
+    if (!pRoot) {
+      function(std::size_t{0}, count);
+      return;
+    }
+
+    const auto pFunction{&function};
+    const auto size{(count + chunks - 1) / chunks};
+
+    for (std::size_t begin{0}; begin < count; begin += size) {
+      const auto end{std::min(begin + size, count)};
+      const auto pChunk{Create(
+        name,
+        [pFunction, begin, end] { (*pFunction)(begin, end); },
+        pRoot)};
+
+      Run(pChunk);
+    }
+
+    Run(pRoot);
+    Wait(pRoot);
+  }
+
+private:
+  struct alignas(64) ThreadState {
+    WorkStealingDeque<Job, jobPoolSize> deque;
+    Job                                 jobs[jobPoolSize];
+    std::size_t                         nextJob{0};
+    std::uint32_t                       random{0};
+    std::thread                         thread;
+    // Started as a worker, parked slots are reused by the next Start.
+    bool bWorker{false};
+  };
+
+  ThreadState* GetThreadState() noexcept;
+  Job*         Allocate(const char* name, Job* pParent) noexcept;
+  Job*         FindJob(ThreadState& state) noexcept;
+  void         Execute(Job* pJob) noexcept;
+  void         Finish(Job* pJob) noexcept;
+  void         Release(Job* pJob) noexcept;
+  void         WorkerMain(ThreadState* pState) noexcept;
+
+  std::unique_ptr<ThreadState> m_threads[maxThreads];
+  std::atomic<std::size_t>     m_threadCount{0};
+  std::mutex                   m_mutex;
+  unsigned                     m_workerCount{0};
+  std::atomic<bool>            m_bStop{false};
+  // Bumped on every queued job, idle workers sleep on it.
+  std::atomic<std::uint32_t> m_wake{0};
+  std::atomic<std::uint32_t> m_sleeping{0};
+};
+
+extern JobSystem jobSystem;
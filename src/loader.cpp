@@ -0,0 +1,299 @@
+#include "loader.hpp"
+#include "log.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <system_error>
+
+Loader loader;
+
+bool Loader::Start(MakeLoaderCurrent makeCurrent) noexcept
+{
+  Stop();
+
+  if (!makeCurrent) {
+    return false;
+  }
+
+  m_bStop    = false;
+  m_bStarted = false;
+  m_bCurrent = false;
+
+  try {
+    m_thread = std::thread{&Loader::Run, this, makeCurrent};
+  }
+  catch (const std::system_error&) {
+    return false;
+  }
+
+  {
+    std::unique_lock lock{m_mutex};
+    m_finished.wait(lock, [this] { return m_bStarted; });
+  }
+
+  if (!m_bCurrent) {
+    m_thread.join();
+    Log("loader: disabled, its context cannot be made current");
+    return false;
+  }
+
+  m_bRunning = true;
+  Log("loader: running on a shared context");
+
+  return true;
+}
+
+void Loader::Stop() noexcept
+{
+  if (!m_thread.joinable()) {
+    return;
+  }
+
+  {
+    const std::lock_guard lock{m_mutex};
+    m_bStop = true;
+  }
+  m_wake.notify_one();
+
+  m_thread.join();
+  m_bRunning = false;
+
+  for (std::size_t slot{0}; slot < maxLoads; ++slot) {
+    if (const auto pLoad{m_loads.Get(slot)}) {
+      LoadTicket ticket{};
+
+      End(*pLoad, &ticket);
+    }
+  }
+}
+
+LoadTicket Loader::LoadBuffer(std::vector<std::byte> data,
+                              GLenum                 usage) noexcept
+{
+  return Submit(
+    "load buffer",
+    std::move(data),
+    [usage](const std::vector<std::byte>& bytes) noexcept -> GLuint {
+      GLuint buffer{0};
+
+      // The array buffer binding is not part of any vertex array.
+      glGenBuffers(1, &buffer);
+      glBindBuffer(GL_ARRAY_BUFFER, buffer);
+      glBufferData(GL_ARRAY_BUFFER,
+                   static_cast<GLsizeiptr>(bytes.size()),
+                   bytes.data(),
+                   usage);
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+      return buffer;
+    });
+}
+
+LoadTicket Loader::LoadTexture(const TextureDesc&     desc,
+                               std::vector<std::byte> pixels) noexcept
+{
+  return Submit(
+    "load texture",
+    std::move(pixels),
+    [desc](const std::vector<std::byte>& bytes) noexcept -> GLuint {
+      GLuint texture{0};
+
+      glGenTextures(1, &texture);
+      glBindTexture(GL_TEXTURE_2D, texture);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+#if GL_DISPATCH_VERSION >= 42
+      if (glVersion >= 42) {
+        glTexStorage2D(GL_TEXTURE_2D,
+                       desc.levels,
+                       desc.internalFormat,
+                       desc.width,
+                       desc.height);
+        glTexSubImage2D(GL_TEXTURE_2D,
+                        0,
+                        0,
+                        0,
+                        desc.width,
+                        desc.height,
+                        desc.format,
+                        desc.type,
+                        bytes.data());
+      }
+      else
+#endif
+      {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, desc.levels - 1);
+        glTexImage2D(GL_TEXTURE_2D,
+                     0,
+                     static_cast<GLint>(desc.internalFormat),
+                     desc.width,
+                     desc.height,
+                     0,
+                     desc.format,
+                     desc.type,
+                     bytes.data());
+      }
+      if (1 < desc.levels) {
+        glGenerateMipmap(GL_TEXTURE_2D);
+      }
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+      glBindTexture(GL_TEXTURE_2D, 0);
+
+      return texture;
+    });
+}
+
+bool Loader::Poll(LoadTicket* pTicket, GLuint* pObject) noexcept
+{
+  const auto pLoad{m_loads.Get(pTicket->slot)};
+
+  if (!pTicket->Valid() || !pLoad
+      || pLoad->generation != pTicket->generation) {
+    *pObject = 0;
+    return true;
+  }
+
+  auto& load{*pLoad};
+
+  if (!load.bDone.load(std::memory_order_acquire)) {
+    return false;
+  }
+
+  // The loader flushed its context, so the fence signals without help.
+  if (load.fence && GL_TIMEOUT_EXPIRED == glClientWaitSync(load.fence, 0, 0)) {
+    return false;
+  }
+
+  *pObject = End(load, pTicket);
+
+  return true;
+}
+
+GLuint Loader::Finish(LoadTicket* pTicket) noexcept
+{
+  const auto pLoad{m_loads.Get(pTicket->slot)};
+
+  if (!pTicket->Valid() || !pLoad
+      || pLoad->generation != pTicket->generation) {
+    return 0;
+  }
+
+  auto& load{*pLoad};
+
+  {
+    std::unique_lock lock{m_mutex};
+    m_finished.wait(lock, [&load] {
+      return load.bDone.load(std::memory_order_acquire);
+    });
+  }
+
+  return End(load, pTicket);
+}
+
+Load* Loader::Allocate(const char* name) noexcept
+{
+  if (!m_bRunning) {
+    return nullptr;
+  }
+
+  const auto pLoad{m_loads.Create()};
+  if (!pLoad) {
+    Log("loader: all %zu slots are in use", maxLoads);
+    return nullptr;
+  }
+
+  // Generation zero marks invalid tickets.
+  auto& generation{m_generations[m_loads.IndexOf(pLoad)]};
+
+  generation        = std::max(generation + 1, std::uint32_t{1});
+  pLoad->generation = generation;
+  pLoad->name       = name;
+
+  return pLoad;
+}
+
+LoadTicket Loader::Queue(Load& load) noexcept
+{
+  const auto slot{static_cast<std::uint32_t>(m_loads.IndexOf(&load))};
+
+  {
+    const std::lock_guard lock{m_mutex};
+    m_queue.push_back(slot);
+  }
+  m_wake.notify_one();
+
+  return {slot, load.generation};
+}
+
+GLuint Loader::End(Load& load, LoadTicket* pTicket) noexcept
+{
+  if (load.fence) {
+    GLenum result{GL_TIMEOUT_EXPIRED};
+
+    do {
+      result = glClientWaitSync(load.fence, 0, 100'000'000);
+    } while (GL_TIMEOUT_EXPIRED == result);
+
+    glDeleteSync(load.fence);
+  }
+
+  const auto object{load.object};
+
+  m_loads.Destroy(&load);
+  *pTicket = {};
+
+  return object;
+}
+
+void Loader::Run(MakeLoaderCurrent makeCurrent) noexcept
+{
+  std::vector<std::uint32_t> batch;
+
+  SetTraceThreadName("loader");
+
+  {
+    const std::lock_guard lock{m_mutex};
+    m_bCurrent = makeCurrent(true);
+    m_bStarted = true;
+  }
+  m_finished.notify_all();
+
+  if (!m_bCurrent) {
+    return;
+  }
+
+  std::unique_lock lock{m_mutex};
+
+  for (;;) {
+    m_wake.wait(lock, [this] { return m_bStop || !m_queue.empty(); });
+    // Queued loads still run when stopping, their owners wait for them.
+    if (m_queue.empty()) {
+      break;
+    }
+
+    batch.swap(m_queue);
+    lock.unlock();
+
+    for (const auto slot : batch) {
+      auto&           load{*m_loads.Get(slot)};
+      const TraceZone zone{load.name};
+
+      load.object = load.pRun(load);
+      load.fence  = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      // Without a flush the fence might never reach the GPU.
+      glFlush();
+      load.data = {};
+
+      {
+        const std::lock_guard doneLock{m_mutex};
+        load.bDone.store(true, std::memory_order_release);
+      }
+      m_finished.notify_all();
+    }
+
+    batch.clear();
+    lock.lock();
+  }
+
+  lock.unlock();
+  makeCurrent(false);
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "gl.hpp"
+#include "object_pool.hpp"
+
+// Makes the loader's context current on the calling thread, or releases
+// it. Provided by the platform, which creates that context sharing
+// objects with the render thread's.
+using MakeLoaderCurrent = bool (*)(bool bCurrent);
+
+// A load in flight, zero for none.
+struct LoadTicket {
+  std::uint32_t slot{0};
+  std::uint32_t generation{0};
+
+  bool Valid() const noexcept
+  {
+    return 0 != generation;
+  }
+};
+
+// A load in a loader slot. The function runs on the loader's context with
+// the data the load owns and returns the object it made, zero if it
+// failed. Lives in the loader's pool from Submit until it ends.
+struct Load {
+  static constexpr std::size_t payloadSize{48};
+
+  GLuint (*pRun)(Load& load) noexcept;
+  const char*            name;
+  std::vector<std::byte> data; // Freed once the function ran.
+  GLuint                 object;
+  GLsync                 fence;
+  std::uint32_t          generation;
+  // Set by the loader once object and fence are.
+  std::atomic<bool>                   bDone;
+  alignas(std::max_align_t) std::byte payload[payloadSize];
+};
+
+// Level zero of a 2D texture, the other levels are generated if there are
+// more.
+struct TextureDesc {
+  GLenum  internalFormat;
+  GLsizei width;
+  GLsizei height;
+  GLsizei levels;
+  GLenum  format; // Of the pixels, e.g. GL_RGBA.
+  GLenum  type;   // E.g. GL_UNSIGNED_BYTE.
+};
+
+// Runs uploads and shader builds on a thread with a context of its own
+// that shares objects with the render thread's, so that big uploads and
+// blocking compiles stall neither frames nor the driver's render thread.
+// A load makes its object on the loader's context and fences it, and the
+// render thread only takes the object once the fence signaled, which
+// makes the contents visible to its context; it must bind the object
+// again afterwards. Loads are submitted, polled and finished on the
+// render thread, which owns the objects from then on.
+class Loader {
+public:
+  static constexpr std::size_t maxLoads{256};
+
+  Loader() noexcept = default;
+  Loader(const Loader&) = delete;
+  Loader& operator=(const Loader&) = delete;
+  ~Loader()
+  {
+    Stop();
+  }
+
+  // Starts the thread, false if it cannot make its context current.
+  bool Start(MakeLoaderCurrent makeCurrent) noexcept;
+  // Runs the queued loads and waits for the thread to exit. Loads that
+  // were never taken lose their objects, needs the render thread's
+  // context to be current.
+  void Stop() noexcept;
+
+  bool Running() const noexcept
+  {
+    return m_bRunning;
+  }
+
+  // Queues a load, an invalid ticket if the loader does not run or all
+  // slots are in use, in which case the caller does the work itself. The
+  // function takes the data and returns the object, e.g.
+  // [](const std::vector<std::byte>& data) noexcept -> GLuint { ... }, and
+  // must be trivially destructible and small.
+  template<typename Function>
+  LoadTicket Submit(const char*            name,
+                    std::vector<std::byte> data,
+                    const Function&        function) noexcept
+  {
+    static_assert(std::is_trivially_destructible_v<Function>);
+    static_assert(sizeof(Function) <= Load::payloadSize);
+    static_assert(alignof(Function) <= alignof(std::max_align_t));
+
+    const auto pLoad{Allocate(name)};
+    if (!pLoad) {
+      return {};
+    }
+
+    pLoad->data = std::move(data);
+    new (pLoad->payload) Function{function};
+    pLoad->pRun = [](Load& load) noexcept -> GLuint {
+      return (*std::launder(reinterpret_cast<Function*>(load.payload)))(
+        load.data);
+    };
+
+    return Queue(*pLoad);
+  }
+
+  // A buffer with a copy of the data, e.g. for GL_ARRAY_BUFFER.
+  LoadTicket LoadBuffer(std::vector<std::byte> data, GLenum usage) noexcept;
+  // A texture with immutable storage if OpenGL 4.2 is there.
+  LoadTicket LoadTexture(const TextureDesc&     desc,
+                         std::vector<std::byte> pixels) noexcept;
+
+  // True once the load's fence signaled, with its object, zero if it
+  // failed. That ends the load and invalidates the ticket.
+  bool Poll(LoadTicket* pTicket, GLuint* pObject) noexcept;
+  // Waits for the load and ends it, e.g. to delete its object.
+  GLuint Finish(LoadTicket* pTicket) noexcept;
+
+private:
+  Load*      Allocate(const char* name) noexcept;
+  LoadTicket Queue(Load& load) noexcept;
+  GLuint     End(Load& load, LoadTicket* pTicket) noexcept;
+  void       Run(MakeLoaderCurrent makeCurrent) noexcept;
+
+  // The loader thread only reaches loads by the slots it was queued, which
+  // stay put until the load ends.
+  ObjectPool<Load, maxLoads> m_loads;
+  // Of the last load in every slot, outliving the loads so that tickets
+  // of ended loads stay invalid when the slot is reused.
+  std::uint32_t m_generations[maxLoads]{};
+  bool                       m_bRunning{false};
+  std::thread                m_thread;
+  std::mutex                 m_mutex;
+  std::condition_variable    m_wake;     // Loads queued or stop.
+  std::condition_variable    m_finished; // Loads done or the thread ready.
+  std::vector<std::uint32_t> m_queue;
+  bool                       m_bStop{false};
+  bool                       m_bStarted{false};
+  bool                       m_bCurrent{false};
+};
+
+extern Loader loader;
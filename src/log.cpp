@@ -0,0 +1,36 @@
+#include "log.hpp"
+
+#include <cstdarg>
+#include <cstdio>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#endif
+
+void Log(const char* format, ...) noexcept
+{
+  char    buffer[1024];
+  va_list args;
+
+  va_start(args, format);
+  const auto n{std::vsnprintf(buffer, sizeof buffer - 1, format, args)};
+  va_end(args);
+
+  if (n < 0) {
+    return;
+  }
+
+  // Terminate every message with a line break, truncated or not.
+  const auto length{static_cast<std::size_t>(n) < sizeof buffer - 1
+                      ? static_cast<std::size_t>(n)
+                      : sizeof buffer - 2};
+  buffer[length]     = '\n';
+  buffer[length + 1] = '\0';
+
+#ifdef _WIN32
+  OutputDebugStringA(buffer);
+#else
+  std::fputs(buffer, stderr);
+#endif
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+// printf-style diagnostics. They go to the debugger on Windows, where the
+// application has no console, and to stderr elsewhere.
+void Log(const char* format, ...) noexcept;
@@ -1,13 +1,36 @@
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
 #include <cstring>
 
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
+#include <shellapi.h>
+#include <strsafe.h>
 
 // OpenGL headers.
 #include <GL/glcorearb.h>
 #include <GL/wglext.h>
 
+#include "context_cache.hpp"
+#include "extensions.hpp"
+#include "frame_arena.hpp"
+#include "frame_pacer.hpp"
+#include "frame_stats.hpp"
+#include "gl.hpp"
+#include "gpu_profiler.hpp"
+#include "heap_counter.hpp"
+#include "job_system.hpp"
+#include "loader.hpp"
+#include "log.hpp"
+#include "pixel_format.hpp"
+#include "renderer.hpp"
+#include "spsc_queue.hpp"
+#include "state_cache.hpp"
+#include "trace.hpp"
+
+static ExtensionSet wglExtensions;
+
 #ifdef WGL_ARB_extensions_string
 static PFNWGLGETEXTENSIONSSTRINGARBPROC pfnwglGetExtensionsStringARB{NULL};
 #endif
@@ -15,6 +38,8 @@ static PFNWGLGETEXTENSIONSSTRINGARBPROC pfnwglGetExtensionsStringARB{NULL};
 #ifdef WGL_ARB_pixel_format
 static BOOL                           hasWGL_ARB_pixel_format{FALSE};
 static PFNWGLCHOOSEPIXELFORMATARBPROC pfnwglChoosePixelFormatARB{NULL};
+static PFNWGLGETPIXELFORMATATTRIBIVARBPROC
+  pfnwglGetPixelFormatAttribivARB{NULL};
 #endif
 
 #ifdef WGL_ARB_multisample
@@ -39,28 +64,6 @@ static PFNWGLSWAPINTERVALEXTPROC pfnwglSwapIntervalEXT{NULL};
 static BOOL hasWGL_EXT_swap_control_tear{FALSE};
 #endif
 
-static PFNGLCLEARCOLORPROC glClearColor{NULL};
-static PFNGLCLEARPROC      glClear{NULL};
-static PFNGLGETSTRINGIPROC glGetStringi{NULL};
-
-static BOOL HasExtension(const char*       extensionsString,
-                         const char* const extension) noexcept
-{
-  const auto n{std::strlen(extension)};
-
-  while (*extensionsString) {
-    const auto i{std::strcspn(extensionsString, " ")};
-
-    if (i == n && 0 == std::strncmp(extensionsString, extension, n)) {
-      return TRUE;
-    }
-
-    extensionsString += i + 1;
-  }
-
-  return FALSE;
-}
-
 static BOOL LoadWglExtensions(HINSTANCE hInstance, LPCWSTR lpClassName) noexcept
 {
   HWND        hWnd{NULL};
@@ -111,22 +114,27 @@ static BOOL LoadWglExtensions(HINSTANCE hInstance, LPCWSTR lpClassName) noexcept
   }
 #endif
 
+  wglExtensions.Clear();
+  if (!wglExtensions.InsertAll(extensionsString)) {
+    dwErrCode = ERROR_INVALID_DATA;
+    goto destroy_window;
+  }
+
 #ifdef WGL_ARB_pixel_format
-  hasWGL_ARB_pixel_format =
-    HasExtension(extensionsString, "WGL_ARB_pixel_format");
+  hasWGL_ARB_pixel_format = wglExtensions.Contains("WGL_ARB_pixel_format"_ext);
   if (hasWGL_ARB_pixel_format) {
+    GPA(wglGetPixelFormatAttribivARB);
     GPA(wglChoosePixelFormatARB);
   }
 #endif
 
 #ifdef WGL_ARB_multisample
-  hasWGL_ARB_multisample =
-    HasExtension(extensionsString, "WGL_ARB_multisample");
+  hasWGL_ARB_multisample = wglExtensions.Contains("WGL_ARB_multisample"_ext);
 #endif
 
 #ifdef WGL_ARB_create_context
   hasWGL_ARB_create_context =
-    HasExtension(extensionsString, "WGL_ARB_create_context");
+    wglExtensions.Contains("WGL_ARB_create_context"_ext);
   if (hasWGL_ARB_create_context) {
     GPA(wglCreateContextAttribsARB);
   }
@@ -134,12 +142,11 @@ static BOOL LoadWglExtensions(HINSTANCE hInstance, LPCWSTR lpClassName) noexcept
 
 #ifdef WGL_ARB_create_context_profile
   hasWGL_ARB_create_context_profile =
-    HasExtension(extensionsString, "WGL_ARB_create_context_profile");
+    wglExtensions.Contains("WGL_ARB_create_context_profile"_ext);
 #endif
 
 #ifdef WGL_EXT_swap_control
-  hasWGL_EXT_swap_control =
-    HasExtension(extensionsString, "WGL_EXT_swap_control");
+  hasWGL_EXT_swap_control = wglExtensions.Contains("WGL_EXT_swap_control"_ext);
   if (hasWGL_EXT_swap_control) {
     GPA(wglSwapIntervalEXT);
   }
@@ -147,7 +154,7 @@ static BOOL LoadWglExtensions(HINSTANCE hInstance, LPCWSTR lpClassName) noexcept
 
 #ifdef WGL_EXT_swap_control_tear
   hasWGL_EXT_swap_control_tear =
-    HasExtension(extensionsString, "WGL_EXT_swap_control_tear");
+    wglExtensions.Contains("WGL_EXT_swap_control_tear"_ext);
 #endif
 
 #undef GPA
@@ -168,38 +175,114 @@ end:
   return bRet;
 }
 
-static BOOL LoadGl() noexcept
+static GlProc GetGlProcAddress(const char* name) noexcept
 {
+  auto    proc{wglGetProcAddress(name)};
   HMODULE hOpengl32{NULL};
 
-  if (!GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
-                          L"opengl32",
-                          &hOpengl32)) {
-    return FALSE;
+  // wglGetProcAddress doesn't resolve OpenGL 1.1 functions and some drivers
+  // return small sentinel values instead of NULL.
+  switch (reinterpret_cast<INT_PTR>(proc)) {
+  case -1:
+  case 0:
+  case 1:
+  case 2:
+  case 3:
+    proc = NULL;
+    if (GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+                           L"opengl32",
+                           &hOpengl32)) {
+      proc = GetProcAddress(hOpengl32, name);
+    }
+    break;
+
+  default:
+    break;
   }
-  else {
-#define GPA(fn) \
-  fn = reinterpret_cast<decltype(fn)>(GetProcAddress(hOpengl32, #fn))
 
-    GPA(glClearColor);
-    GPA(glClear);
+  return reinterpret_cast<GlProc>(proc);
+}
 
-#undef GPA
+#ifdef WGL_ARB_pixel_format
+static BOOL GetPixelFormatTraits(HDC                hDC,
+                                 int                format,
+                                 PixelFormatTraits* pTraits) noexcept
+{
+  int  iAttributes[]{WGL_COLOR_BITS_ARB,
+                     WGL_ALPHA_BITS_ARB,
+                     WGL_ACCUM_BITS_ARB,
+                     WGL_DEPTH_BITS_ARB,
+                     WGL_STENCIL_BITS_ARB,
+                     WGL_AUX_BUFFERS_ARB,
+                     0};
+  int  iValues[ARRAYSIZE(iAttributes)]{};
+  UINT nAttributes{ARRAYSIZE(iAttributes) - 1};
 
-#define GPA(fn) fn = reinterpret_cast<decltype(fn)>(wglGetProcAddress(#fn))
+#ifdef WGL_ARB_multisample
+  if (hasWGL_ARB_multisample) {
+    iAttributes[nAttributes++] = WGL_SAMPLES_ARB;
+  }
+#endif
 
-    GPA(glGetStringi);
+  if (!pfnwglGetPixelFormatAttribivARB(hDC,
+                                       format,
+                                       0,
+                                       nAttributes,
+                                       iAttributes,
+                                       iValues)) {
+    return FALSE;
+  }
 
-#undef GPA
+  *pTraits = {.colorBits   = iValues[0],
+              .alphaBits   = iValues[1],
+              .accumBits   = iValues[2],
+              .depthBits   = iValues[3],
+              .stencilBits = iValues[4],
+              .auxBuffers  = iValues[5],
+              .samples     = iValues[6]};
 
-    return TRUE;
+  return TRUE;
+}
+#endif
+
+// Identifies the monitor the window of the device context is on, pixel
+// formats differ between adapters.
+static BOOL GetDisplayKey(HDC hDC, char* display, int cbDisplay) noexcept
+{
+  const auto      hMonitor{
+    MonitorFromWindow(WindowFromDC(hDC), MONITOR_DEFAULTTOPRIMARY)};
+  MONITORINFOEXW  mi{};
+  DISPLAY_DEVICEW dd{.cb = sizeof(DISPLAY_DEVICEW)};
+  WCHAR           szKey[ARRAYSIZE(mi.szDevice) + ARRAYSIZE(dd.DeviceID) + 1];
+
+  mi.cbSize = sizeof mi;
+  if (!GetMonitorInfoW(hMonitor, &mi)
+      || !EnumDisplayDevicesW(mi.szDevice, 0, &dd, 0)) {
+    return FALSE;
   }
+
+  if (FAILED(StringCchPrintfW(szKey,
+                              ARRAYSIZE(szKey),
+                              L"%s|%s",
+                              mi.szDevice,
+                              dd.DeviceID))) {
+    return FALSE;
+  }
+
+  return 0 < WideCharToMultiByte(CP_UTF8,
+                                 0,
+                                 szKey,
+                                 -1,
+                                 display,
+                                 cbDisplay,
+                                 NULL,
+                                 NULL);
 }
 
 static BOOL SetupPixelFormat(HDC  hDC,
                              BYTE cColorBits    = 24,
                              BYTE cAlphaBits    = 8,
-                             BYTE cAccumBits    = 24,
+                             BYTE cAccumBits    = 0,
                              BYTE cDepthBits    = 16,
                              BYTE cStencilBits  = 8,
                              BYTE cAuxBuffers   = 0,
@@ -261,8 +344,20 @@ static BOOL SetupPixelFormat(HDC  hDC,
                       0,
                       0,
                       0};
-  int  iFormats[8]{};
-  UINT nNumFormats{0};
+  int               iFormats[64]{};
+  UINT              nNumFormats{0};
+  PixelFormatTraits required{.colorBits   = cColorBits,
+                             .alphaBits   = cAlphaBits,
+                             .accumBits   = cAccumBits,
+                             .depthBits   = cDepthBits,
+                             .stencilBits = cStencilBits,
+                             .auxBuffers  = cAuxBuffers,
+                             .samples     = 0};
+  PixelFormatTraits cached;
+  PixelFormatTraits traits;
+  char              display[512];
+  auto              bHasDisplay{FALSE};
+  auto              bestScore{-1L};
 
   if (hasWGL_ARB_pixel_format) {
 #ifdef WGL_ARB_multisample
@@ -271,17 +366,61 @@ static BOOL SetupPixelFormat(HDC  hDC,
       iAttribIList[21] = sampleBuffers;
       iAttribIList[22] = WGL_SAMPLES_ARB;
       iAttribIList[23] = samples;
+
+      required.samples = sampleBuffers > 0 ? samples : 0;
     }
 #endif
 
-    if (pfnwglChoosePixelFormatARB(hDC,
-                                   iAttribIList,
-                                   NULL,
-                                   ARRAYSIZE(iFormats),
-                                   iFormats,
-                                   &nNumFormats)
-        && nNumFormats > 0) {
-      format = iFormats[0];
+    // Reuse the format chosen for this display before unless the driver
+    // renumbered its formats since.
+    bHasDisplay = GetDisplayKey(hDC, display, sizeof display);
+    if (bHasDisplay
+        && LoadPixelFormatCache("pixel-format-wgl.cache",
+                                display,
+                                &format,
+                                &cached)
+        && GetPixelFormatTraits(hDC, format, &traits) && traits == cached
+        && 0 <= ScorePixelFormat(traits, required)) {
+      Log("pixel format: %d from cache", format);
+    }
+    else {
+      format = 0;
+
+      // The attributes are minimums, rank the matches by the memory
+      // bandwidth their buffers cost instead of taking the first one.
+      if (pfnwglChoosePixelFormatARB(hDC,
+                                     iAttribIList,
+                                     NULL,
+                                     ARRAYSIZE(iFormats),
+                                     iFormats,
+                                     &nNumFormats)) {
+        for (UINT i{0}; i < nNumFormats && i < ARRAYSIZE(iFormats); ++i) {
+          if (GetPixelFormatTraits(hDC, iFormats[i], &traits)) {
+            const auto score{ScorePixelFormat(traits, required)};
+
+            if (0 <= score && (0 == format || score < bestScore)) {
+              format    = iFormats[i];
+              cached    = traits;
+              bestScore = score;
+            }
+          }
+        }
+      }
+
+      if (0 != format) {
+        Log("pixel format: %d of %u candidates, score %ld",
+            format,
+            nNumFormats,
+            bestScore);
+
+        // The next launch scores again if storing fails.
+        if (bHasDisplay) {
+          StorePixelFormatCache("pixel-format-wgl.cache",
+                                display,
+                                format,
+                                cached);
+        }
+      }
     }
   }
   else
@@ -294,12 +433,42 @@ static BOOL SetupPixelFormat(HDC  hDC,
          && SetPixelFormat(hDC, format, &pfd);
 }
 
+// Queries the driver behind the context, which must not be current on
+// another thread.
+static BOOL
+QueryContextDriver(HDC   hDC,
+                   HGLRC hRC,
+                   char (&driver)[sizeof ContextCacheEntry::driver]) noexcept
+{
+  const auto hPrevDC{wglGetCurrentDC()};
+  const auto hPrevRC{wglGetCurrentContext()};
+  BOOL       bRet{FALSE};
+
+  if (!wglMakeCurrent(hDC, hRC)) {
+    return FALSE;
+  }
+
+  bRet = QueryDriver(&GetGlProcAddress, driver);
+
+  if (!wglMakeCurrent(hPrevDC, hPrevRC)) {
+    // Ignore error.
+  }
+
+  return bRet;
+}
+
 static HGLRC CreateContext(HDC hDC, HGLRC hShareContext = NULL) noexcept
 {
   HGLRC hRC{NULL};
 
 #ifdef WGL_ARB_create_context
   if (hasWGL_ARB_create_context) {
+    const auto        start{std::chrono::steady_clock::now()};
+    ContextCacheEntry cached;
+    ContextCacheEntry probed;
+    auto              nAttempts{0};
+    auto              bCacheHit{false};
+
     int attribList[]{WGL_CONTEXT_MAJOR_VERSION_ARB,
                      0,
                      WGL_CONTEXT_MINOR_VERSION_ARB,
@@ -320,19 +489,63 @@ static HGLRC CreateContext(HDC hDC, HGLRC hShareContext = NULL) noexcept
     }
 #endif
 
-    const int glVersions[]{46, 45, 44, 43, 42, 41, 40, 33, 32, 31, 30};
-
-    for (auto version : glVersions) {
-      const auto dv{std::div(version, 10)};
+    // Go straight to the version that worked last time as long as the
+    // driver is still the same, otherwise probe the versions in turn.
+    if (LoadContextCache("context-wgl.cache", &cached)
+        && cached.flags == attribList[5]
+        && cached.profileMask == attribList[7]) {
+      const auto dv{std::div(cached.version, 10)};
 
       attribList[1] = dv.quot;
       attribList[3] = dv.rem;
 
+      ++nAttempts;
       hRC = pfnwglCreateContextAttribsARB(hDC, hShareContext, attribList);
-      if (hRC) {
-        return hRC;
+      if (hRC
+          && (!QueryContextDriver(hDC, hRC, probed.driver)
+              || 0 != std::strcmp(cached.driver, probed.driver))) {
+        if (!wglDeleteContext(hRC)) {
+          // Ignore error.
+        }
+        hRC = NULL;
+      }
+      bCacheHit = NULL != hRC;
+    }
+
+    if (!hRC) {
+      const int glVersions[]{46, 45, 44, 43, 42, 41, 40, 33, 32, 31, 30};
+
+      for (auto version : glVersions) {
+        const auto dv{std::div(version, 10)};
+
+        attribList[1] = dv.quot;
+        attribList[3] = dv.rem;
+
+        ++nAttempts;
+        hRC = pfnwglCreateContextAttribsARB(hDC, hShareContext, attribList);
+        if (hRC) {
+          probed.version     = version;
+          probed.profileMask = attribList[7];
+          probed.flags       = attribList[5];
+          // The next launch probes again if storing fails.
+          if (QueryContextDriver(hDC, hRC, probed.driver)) {
+            StoreContextCache("context-wgl.cache", probed);
+          }
+          break;
+        }
       }
     }
+
+    const std::chrono::duration<double, std::milli> elapsed{
+      std::chrono::steady_clock::now() - start};
+
+    Log("context probe: %s OpenGL %d.%d, %d attempt(s), %.3f ms, cache %s",
+        hRC ? "created" : "failed to create",
+        attribList[1],
+        attribList[3],
+        nAttempts,
+        elapsed.count(),
+        bCacheHit ? "hit" : "miss");
   }
   else
 #endif
@@ -353,6 +566,297 @@ static HGLRC CreateContext(HDC hDC, HGLRC hShareContext = NULL) noexcept
   return hRC;
 }
 
+// Window messages forwarded from the pump thread to the render thread.
+struct RenderEvent {
+  UINT   uMsg;
+  WPARAM wParam;
+  LPARAM lParam;
+};
+
+static SpscQueue<RenderEvent, 1024> renderEvents;
+static HWND                         hRenderWnd{NULL};
+static std::atomic<bool>            bRenderThreadRuns{false};
+static FrameStats                   frameStats;
+static WCHAR                        szFrameStatsPath[MAX_PATH]{};
+static HDC                          hLoaderDC{NULL};
+static HGLRC                        hLoaderRC{NULL};
+
+// Called on the loader's thread, its context uses the window's device
+// context like the render thread's.
+static bool MakeLoaderContextCurrent(bool bCurrent) noexcept
+{
+  return bCurrent ? wglMakeCurrent(hLoaderDC, hLoaderRC)
+                  : wglMakeCurrent(NULL, NULL);
+}
+
+static void PostRenderEvent(UINT uMsg, WPARAM wParam, LPARAM lParam) noexcept
+{
+  // The render thread drains the queue every frame, so wait for room rather
+  // than lose an event. Give up once the render thread is gone.
+  while (!renderEvents.TryPush({uMsg, wParam, lParam})) {
+    if (!bRenderThreadRuns.load(std::memory_order_acquire)) {
+      break;
+    }
+    SwitchToThread();
+  }
+}
+
+static DWORD WINAPI RenderThreadProc(LPVOID lpParameter) noexcept
+{
+  const auto  hWnd{static_cast<HWND>(lpParameter)};
+  const auto  hDC{reinterpret_cast<HDC>(GetWindowLongPtrW(hWnd, 0))};
+  const auto  hRC{
+    reinterpret_cast<HGLRC>(GetWindowLongPtrW(hWnd, sizeof(HDC)))};
+  DWORD       dwErrCode{ERROR_SUCCESS};
+  auto        bRuns{true};
+  auto        bVsync{false};
+  auto        refreshRate{0};
+  FramePacer  pacer;
+  RECT        rect{};
+  RenderEvent event{};
+
+  SetTraceThreadName("render");
+
+  if (!wglMakeCurrent(hDC, hRC)) {
+    dwErrCode = GetLastError();
+    goto end;
+  }
+
+  if (!LoadGl(&GetGlProcAddress)) {
+    dwErrCode = GetLastError();
+    goto make_no_longer_current;
+  }
+
+  InstallStateCache();
+
+  // The loader's context shares objects with the render thread's.
+  hLoaderDC = hDC;
+  hLoaderRC = CreateContext(hDC, hRC);
+  if (!hLoaderRC) {
+    Log("loader: disabled, there is no shared context");
+  }
+  else {
+    loader.Start(&MakeLoaderContextCurrent);
+  }
+
+  if (!InitRenderer()) {
+    dwErrCode = ERROR_NOT_SUPPORTED;
+    goto make_no_longer_current;
+  }
+
+#ifdef WGL_EXT_swap_control
+  if (hasWGL_EXT_swap_control) {
+    auto interval{1};
+
+#ifdef WGL_EXT_swap_control_tear
+    if (hasWGL_EXT_swap_control_tear) {
+      interval = -1;
+    }
+#endif
+
+    bVsync = pfnwglSwapIntervalEXT(interval);
+  }
+#endif
+
+  // Without vsync pace to the display's refresh rate rather than render
+  // as fast as possible.
+  refreshRate = bVsync ? 0 : GetDeviceCaps(hDC, VREFRESH);
+  if (!bVsync && refreshRate <= 1) {
+    refreshRate = 60;
+  }
+
+  if (!pacer.Init(2,
+                  refreshRate ? std::chrono::nanoseconds{1'000'000'000}
+                                  / refreshRate
+                              : std::chrono::nanoseconds{0})) {
+    dwErrCode = ERROR_OUTOFMEMORY;
+    goto release_renderer;
+  }
+
+  if (!gpuProfiler.Init()) {
+    dwErrCode = ERROR_OUTOFMEMORY;
+    goto release_renderer;
+  }
+
+  if (!frameArena.Init(FrameArena::defaultBytesPerFrame,
+                       pacer.FramesInFlight())) {
+    dwErrCode = ERROR_OUTOFMEMORY;
+    goto release_renderer;
+  }
+
+  if (!frameStats.Start(szFrameStatsPath)) {
+    Log("failed to start the frame statistics writer");
+  }
+
+  // The render thread helps while it waits for jobs, so it is not counted.
+  if (!jobSystem.Start(0)) {
+    Log("failed to start the job workers");
+  }
+
+  // Resizes before the window was handed over are not in the queue.
+  if (GetClientRect(hWnd, &rect)) {
+    ResizeRenderer(rect.right - rect.left, rect.bottom - rect.top);
+  }
+
+  while (bRuns) {
+    const TraceZone frameZone{"frame"};
+
+    {
+      const TraceZone waitZone{"wait"};
+      pacer.Wait();
+    }
+
+    const auto begin{FrameStats::Clock::now()};
+    const auto heapAllocations{ThreadHeapAllocations()};
+
+    frameArena.BeginFrame();
+    gpuProfiler.BeginFrame();
+
+    {
+      const TraceZone updateZone{"update"};
+
+      while (renderEvents.TryPop(&event)) {
+        switch (event.uMsg) {
+        case WM_SIZE:
+          ResizeRenderer(LOWORD(event.lParam), HIWORD(event.lParam));
+          break;
+
+        case WM_QUIT:
+          bRuns = false;
+          break;
+
+        default:
+          break;
+        }
+      }
+    }
+
+    if (!bRuns) {
+      break;
+    }
+
+    {
+      const TraceZone submitZone{"submit"};
+      RenderFrame();
+    }
+
+    const auto submitted{FrameStats::Clock::now()};
+
+    {
+      const TraceZone swapZone{"swap"};
+
+      if (!SwapBuffers(hDC)) {
+        dwErrCode = GetLastError();
+        break;
+      }
+
+      pacer.Submit();
+    }
+
+    auto timing{
+      frameStats.Measure(begin, submitted, FrameStats::Clock::now())};
+    const auto stateStats{TakeStateCacheStats()};
+
+    timing.stateIssued     = stateStats.issued;
+    timing.stateElided     = stateStats.elided;
+    timing.arenaBytes      = frameArena.Usage().bytes;
+    timing.heapAllocations = static_cast<std::uint32_t>(
+      ThreadHeapAllocations() - heapAllocations);
+    if (gpuProfiler.Merge(&timing)) {
+      frameStats.Record(timing);
+    }
+  }
+
+  // Include the frames still in flight in the statistics.
+  glFinish();
+  for (FrameTiming timing{}; gpuProfiler.Drain(&timing);) {
+    frameStats.Record(timing);
+  }
+  jobSystem.Stop();
+  frameStats.Stop();
+
+  Log("%zu of %zu GL entry points resolved", GlResolvedCount(), glDispatchSize);
+
+  // Counted builds check that frames in steady state stay off the heap.
+  if (heapAllocationsCounted && frameStats.SteadyHeapAllocations()) {
+    Log("frames after the warm-up allocated on the heap");
+    dwErrCode = ERROR_ASSERTION_FAILURE;
+  }
+
+  // Everything released here is safe to release without having been
+  // initialized.
+release_renderer:
+  frameArena.Release();
+  ReleaseRenderer();
+  gpuProfiler.Release();
+  pacer.Release();
+
+make_no_longer_current:
+  loader.Stop();
+  if (hLoaderRC) {
+    if (!wglDeleteContext(hLoaderRC)) {
+      // Ignore error.
+    }
+    hLoaderRC = NULL;
+  }
+
+  if (!wglMakeCurrent(NULL, NULL)) {
+    dwErrCode = GetLastError();
+  }
+
+end:
+  bRenderThreadRuns.store(false, std::memory_order_release);
+
+  // Ask the pump thread to quit if rendering stopped on its own.
+  if (bRuns) {
+    [[maybe_unused]] const auto bPosted{PostMessageW(hWnd, WM_CLOSE, 0, 0)};
+  }
+
+  return dwErrCode;
+}
+
+// Parses the switches in lpCmdLine, --trace <file> and --frame-stats
+// <file>, into buffers of MAX_PATH characters.
+static BOOL ParseCommandLine(LPCWSTR lpCmdLine,
+                             LPWSTR  lpszTracePath,
+                             LPWSTR  lpszFrameStatsPath) noexcept
+{
+  int     argc{0};
+  LPWSTR* argv{NULL};
+  BOOL    bRet{TRUE};
+
+  // CommandLineToArgvW returns the path of the executable for an empty
+  // command line.
+  if (!lpCmdLine[0]) {
+    return TRUE;
+  }
+
+  argv = CommandLineToArgvW(lpCmdLine, &argc);
+  if (!argv) {
+    return FALSE;
+  }
+
+  for (auto i{0}; bRet && i < argc; ++i) {
+    if (0 == lstrcmpW(argv[i], L"--trace") && i + 1 < argc) {
+      bRet = SUCCEEDED(StringCchCopyW(lpszTracePath, MAX_PATH, argv[++i]));
+    }
+    else if (0 == lstrcmpW(argv[i], L"--frame-stats") && i + 1 < argc) {
+      bRet = SUCCEEDED(
+        StringCchCopyW(lpszFrameStatsPath, MAX_PATH, argv[++i]));
+    }
+    else {
+      SetLastError(ERROR_INVALID_PARAMETER);
+      bRet = FALSE;
+    }
+  }
+
+  if (LocalFree(argv)) {
+    // Ignore error.
+  }
+
+  return bRet;
+}
+
 static LRESULT CALLBACK WndProc(HWND   hWnd,
                                 UINT   uMsg,
                                 WPARAM wParam,
@@ -433,11 +937,22 @@ static LRESULT CALLBACK WndProc(HWND   hWnd,
     }
     break;
 
+  case WM_SIZE:
+    if (hWnd == hRenderWnd) {
+      PostRenderEvent(uMsg, wParam, lParam);
+    }
+    break;
+
   case WM_CLOSE:
     PostQuitMessage(0);
     break;
 
   default:
+    if (hWnd == hRenderWnd
+        && ((WM_KEYFIRST <= uMsg && uMsg <= WM_KEYLAST)
+            || (WM_MOUSEFIRST <= uMsg && uMsg <= WM_MOUSELAST))) {
+      PostRenderEvent(uMsg, wParam, lParam);
+    }
     lRes = DefWindowProcW(hWnd, uMsg, wParam, lParam);
     break;
   }
@@ -447,11 +962,12 @@ static LRESULT CALLBACK WndProc(HWND   hWnd,
 
 int WINAPI wWinMain(HINSTANCE                  hInstance,
                     [[maybe_unused]] HINSTANCE hPrevInstance,
-                    [[maybe_unused]] LPWSTR    lpCmdLine,
+                    LPWSTR                     lpCmdLine,
                     int                        nShowCmd)
 {
   int               nExitCode{0};
   DWORD             dwErrCode{ERROR_SUCCESS};
+  DWORD             dwRenderErrCode{ERROR_SUCCESS};
   const WNDCLASSEXW wcx{.cbSize        = sizeof(WNDCLASSEXW),
                         .style         = CS_OWNDC,
                         .lpfnWndProc   = &WndProc,
@@ -466,9 +982,22 @@ int WINAPI wWinMain(HINSTANCE                  hInstance,
                         .hIconSm       = NULL};
   auto              atom{INVALID_ATOM};
   HWND              hWnd{NULL};
-  auto              bRuns{true};
   HDC               hDC{NULL};
+  HANDLE            hRenderThread{NULL};
   BOOL              bWasVisible{FALSE};
+  MSG               msg{};
+  BOOL              bRet{FALSE};
+  WCHAR             szTracePath[MAX_PATH]{};
+
+  if (!ParseCommandLine(lpCmdLine, szTracePath, szFrameStatsPath)) {
+    dwErrCode = GetLastError();
+    goto end;
+  }
+
+  if (szTracePath[0]) {
+    StartTrace();
+    SetTraceThreadName("pump");
+  }
 
   atom = RegisterClassExW(&wcx);
   if (INVALID_ATOM == atom) {
@@ -498,49 +1027,57 @@ int WINAPI wWinMain(HINSTANCE                  hInstance,
     goto unregister_class;
   }
 
-  if (!LoadGl()) {
+  // The render thread owns the context from here on, so the pump thread
+  // never waits for a frame and a slow frame never delays input.
+  if (!wglMakeCurrent(NULL, NULL)) {
     dwErrCode = GetLastError();
     goto destroy_window;
   }
 
-#ifdef WGL_EXT_swap_control
-  if (hasWGL_EXT_swap_control) {
-    auto interval{1};
-
-#ifdef WGL_EXT_swap_control
-    if (hasWGL_EXT_swap_control_tear) {
-      interval = -1;
-    }
-#endif
+  hRenderWnd = hWnd;
+  bRenderThreadRuns.store(true, std::memory_order_release);
 
-    if (!pfnwglSwapIntervalEXT(interval)) {
-      // Ignore error.
-    }
+  hRenderThread = CreateThread(NULL, 0, &RenderThreadProc, hWnd, 0, NULL);
+  if (!hRenderThread) {
+    dwErrCode = GetLastError();
+    bRenderThreadRuns.store(false, std::memory_order_release);
+    goto destroy_window;
   }
-#endif
 
   bWasVisible = ShowWindow(hWnd, nShowCmd);
 
-  glClearColor(0.25, 0.5, 1.0, 1.0);
+  while (0 < (bRet = GetMessageW(&msg, NULL, 0, 0))) {
+    const TraceZone             pumpZone{"pump"};
+    [[maybe_unused]] const auto bWasTranslated{TranslateMessage(&msg)};
+    [[maybe_unused]] const auto lRes{DispatchMessageW(&msg)};
+  }
 
-  while (bRuns) {
-    MSG msg;
-    while (PeekMessageW(&msg, NULL, 0, 0, PM_REMOVE)) {
-      [[maybe_unused]] const auto bWasTranslated{TranslateMessage(&msg)};
-      [[maybe_unused]] const auto lRes{DispatchMessageW(&msg)};
-
-      if (WM_QUIT == msg.message) {
-        bRuns     = false;
-        nExitCode = static_cast<int>(msg.wParam);
-      }
-    }
+  if (-1 == bRet) {
+    dwErrCode = GetLastError();
+  }
+  else {
+    nExitCode = static_cast<int>(msg.wParam);
+  }
 
-    glClear(GL_COLOR_BUFFER_BIT);
+  PostRenderEvent(WM_QUIT, 0, 0);
 
-    if (!SwapBuffers(hDC)) {
-      dwErrCode = GetLastError();
-      goto destroy_window;
-    }
+  if (WAIT_FAILED == WaitForSingleObject(hRenderThread, INFINITE)) {
+    dwErrCode = GetLastError();
+  }
+  // A render thread that failed fails the process.
+  else if (GetExitCodeThread(hRenderThread, &dwRenderErrCode)
+           && ERROR_SUCCESS != dwRenderErrCode && !nExitCode) {
+    nExitCode = static_cast<int>(dwRenderErrCode);
+  }
+
+  if (!CloseHandle(hRenderThread)) {
+    dwErrCode = GetLastError();
+  }
+  hRenderThread = NULL;
+  hRenderWnd    = NULL;
+
+  if (szTracePath[0] && !WriteTrace(szTracePath)) {
+    Log("failed to write the trace");
   }
 
 destroy_window:
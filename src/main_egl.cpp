@@ -0,0 +1,668 @@
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+
+// OpenGL headers.
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/glcorearb.h>
+
+#include "context_cache.hpp"
+#include "extensions.hpp"
+#include "frame_arena.hpp"
+#include "frame_pacer.hpp"
+#include "frame_stats.hpp"
+#include "gl.hpp"
+#include "gpu_profiler.hpp"
+#include "heap_counter.hpp"
+#include "job_system.hpp"
+#include "loader.hpp"
+#include "log.hpp"
+#include "pixel_format.hpp"
+#include "renderer.hpp"
+#include "state_cache.hpp"
+#include "trace.hpp"
+
+static volatile std::sig_atomic_t bRuns{1};
+
+static ExtensionSet eglClientExtensions;
+static ExtensionSet eglExtensions;
+static FrameStats   frameStats;
+static EGLDisplay   loaderDisplay{EGL_NO_DISPLAY};
+static EGLContext   loaderContext{EGL_NO_CONTEXT};
+
+static void OnSignal([[maybe_unused]] int sig) noexcept
+{
+  bRuns = 0;
+}
+
+static GlProc GetGlProcAddress(const char* name) noexcept
+{
+  return reinterpret_cast<GlProc>(eglGetProcAddress(name));
+}
+
+// Called on the loader's thread, whose context needs no surface. The
+// client API is bound per thread.
+static bool MakeLoaderContextCurrent(bool bCurrent) noexcept
+{
+  return eglBindAPI(EGL_OPENGL_API)
+         && eglMakeCurrent(loaderDisplay,
+                           EGL_NO_SURFACE,
+                           EGL_NO_SURFACE,
+                           bCurrent ? loaderContext : EGL_NO_CONTEXT);
+}
+
+static EGLDisplay GetDisplay() noexcept
+{
+  // Client extensions are unavailable before EGL 1.5 or without
+  // EGL_EXT_client_extensions, in which case the set stays empty.
+  eglClientExtensions.Clear();
+  eglClientExtensions.InsertAll(eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS));
+
+#if defined(EGL_EXT_platform_base) && defined(EGL_MESA_platform_surfaceless)
+  // Prefer the surfaceless platform as it needs neither a window system
+  // nor a DRM device, e.g. Mesa llvmpipe on a render farm node.
+  if (eglClientExtensions.Contains("EGL_EXT_platform_base"_ext)
+      && eglClientExtensions.Contains("EGL_MESA_platform_surfaceless"_ext)) {
+    const auto pfneglGetPlatformDisplayEXT{
+      reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+        eglGetProcAddress("eglGetPlatformDisplayEXT"))};
+
+    if (pfneglGetPlatformDisplayEXT) {
+      return pfneglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA,
+                                         EGL_DEFAULT_DISPLAY,
+                                         NULL);
+    }
+  }
+#endif
+
+  return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+static bool ChooseConfig(EGLDisplay display,
+                         bool       bPbuffer,
+                         EGLConfig* pConfig,
+                         EGLint     cRedBits     = 8,
+                         EGLint     cGreenBits   = 8,
+                         EGLint     cBlueBits    = 8,
+                         EGLint     cAlphaBits   = 8,
+                         EGLint     cDepthBits   = 16,
+                         EGLint     cStencilBits = 8) noexcept
+{
+  const EGLint attribList[]{EGL_SURFACE_TYPE,
+                            bPbuffer ? EGL_PBUFFER_BIT : 0,
+                            EGL_RENDERABLE_TYPE,
+                            EGL_OPENGL_BIT,
+                            EGL_RED_SIZE,
+                            cRedBits,
+                            EGL_GREEN_SIZE,
+                            cGreenBits,
+                            EGL_BLUE_SIZE,
+                            cBlueBits,
+                            EGL_ALPHA_SIZE,
+                            cAlphaBits,
+                            EGL_DEPTH_SIZE,
+                            cDepthBits,
+                            EGL_STENCIL_SIZE,
+                            cStencilBits,
+                            EGL_NONE};
+  const PixelFormatTraits required{.colorBits   = cRedBits + cGreenBits
+                                                 + cBlueBits,
+                                   .alphaBits   = cAlphaBits,
+                                   .accumBits   = 0,
+                                   .depthBits   = cDepthBits,
+                                   .stencilBits = cStencilBits,
+                                   .auxBuffers  = 0,
+                                   .samples     = 0};
+  EGLConfig               configs[64]{};
+  EGLint                  nNumConfigs{0};
+  auto                    bestScore{-1L};
+
+  if (!eglChooseConfig(display,
+                       attribList,
+                       configs,
+                       static_cast<EGLint>(std::size(configs)),
+                       &nNumConfigs)) {
+    return false;
+  }
+
+  // The attributes are minimums, rank the matches by the memory bandwidth
+  // their buffers cost instead of taking EGL's sort order.
+  for (EGLint i{0}; i < nNumConfigs; ++i) {
+    const EGLint attributes[]{EGL_RED_SIZE,
+                              EGL_GREEN_SIZE,
+                              EGL_BLUE_SIZE,
+                              EGL_ALPHA_SIZE,
+                              EGL_DEPTH_SIZE,
+                              EGL_STENCIL_SIZE,
+                              EGL_SAMPLES};
+    EGLint       values[std::size(attributes)]{};
+    auto         bHasValues{true};
+
+    for (std::size_t j{0}; bHasValues && j < std::size(attributes); ++j) {
+      bHasValues = EGL_TRUE
+                   == eglGetConfigAttrib(display,
+                                         configs[i],
+                                         attributes[j],
+                                         &values[j]);
+    }
+
+    if (!bHasValues) {
+      continue;
+    }
+
+    const PixelFormatTraits traits{.colorBits = values[0] + values[1]
+                                                + values[2],
+                                   .alphaBits   = values[3],
+                                   .accumBits   = 0,
+                                   .depthBits   = values[4],
+                                   .stencilBits = values[5],
+                                   .auxBuffers  = 0,
+                                   .samples     = values[6]};
+    const auto              score{ScorePixelFormat(traits, required)};
+
+    if (0 <= score && (bestScore < 0 || score < bestScore)) {
+      *pConfig  = configs[i];
+      bestScore = score;
+    }
+  }
+
+  return 0 <= bestScore;
+}
+
+// Queries the driver behind the context, which must not be current on
+// another thread. Needs EGL_KHR_surfaceless_context.
+static bool
+QueryContextDriver(EGLDisplay display,
+                   EGLContext context,
+                   char (&driver)[sizeof ContextCacheEntry::driver]) noexcept
+{
+  const auto prevDraw{eglGetCurrentSurface(EGL_DRAW)};
+  const auto prevRead{eglGetCurrentSurface(EGL_READ)};
+  const auto prevContext{eglGetCurrentContext()};
+  auto       bRet{false};
+
+  if (!eglExtensions.Contains("EGL_KHR_surfaceless_context"_ext)
+      || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+    return false;
+  }
+
+  bRet = QueryDriver(&GetGlProcAddress, driver);
+
+  if (!eglMakeCurrent(display, prevDraw, prevRead, prevContext)) {
+    // Ignore error.
+  }
+
+  return bRet;
+}
+
+static EGLContext
+CreateContext(EGLDisplay display,
+              EGLConfig  config,
+              EGLContext shareContext = EGL_NO_CONTEXT) noexcept
+{
+  EGLContext context{EGL_NO_CONTEXT};
+
+  if (!eglBindAPI(EGL_OPENGL_API)) {
+    return EGL_NO_CONTEXT;
+  }
+
+#ifdef EGL_KHR_create_context
+  if (eglExtensions.Contains("EGL_KHR_create_context"_ext)) {
+    const auto        start{std::chrono::steady_clock::now()};
+    ContextCacheEntry cached;
+    ContextCacheEntry probed;
+    auto              nAttempts{0};
+    auto              bCacheHit{false};
+
+    EGLint attribList[]{EGL_CONTEXT_MAJOR_VERSION_KHR,
+                        0,
+                        EGL_CONTEXT_MINOR_VERSION_KHR,
+                        0,
+                        EGL_CONTEXT_FLAGS_KHR,
+#ifndef NDEBUG
+                        EGL_CONTEXT_OPENGL_DEBUG_BIT_KHR |
+#endif
+                          EGL_CONTEXT_OPENGL_FORWARD_COMPATIBLE_BIT_KHR,
+                        EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR,
+                        EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+                        EGL_NONE};
+
+    // Go straight to the version that worked last time as long as the
+    // driver is still the same, otherwise probe the versions in turn.
+    if (LoadContextCache("context-egl.cache", &cached)
+        && cached.flags == attribList[5]
+        && cached.profileMask == attribList[7]) {
+      const auto dv{std::div(cached.version, 10)};
+
+      attribList[1] = dv.quot;
+      attribList[3] = dv.rem;
+
+      ++nAttempts;
+      context = eglCreateContext(display, config, shareContext, attribList);
+      if (EGL_NO_CONTEXT != context
+          && (!QueryContextDriver(display, context, probed.driver)
+              || 0 != std::strcmp(cached.driver, probed.driver))) {
+        if (!eglDestroyContext(display, context)) {
+          // Ignore error.
+        }
+        context = EGL_NO_CONTEXT;
+      }
+      bCacheHit = EGL_NO_CONTEXT != context;
+    }
+
+    if (EGL_NO_CONTEXT == context) {
+      const int glVersions[]{46, 45, 44, 43, 42, 41, 40, 33, 32, 31, 30};
+
+      for (auto version : glVersions) {
+        const auto dv{std::div(version, 10)};
+
+        attribList[1] = dv.quot;
+        attribList[3] = dv.rem;
+
+        ++nAttempts;
+        context = eglCreateContext(display, config, shareContext, attribList);
+        if (EGL_NO_CONTEXT != context) {
+          probed.version     = version;
+          probed.profileMask = attribList[7];
+          probed.flags       = attribList[5];
+          // The next launch probes again if storing fails.
+          if (QueryContextDriver(display, context, probed.driver)) {
+            StoreContextCache("context-egl.cache", probed);
+          }
+          break;
+        }
+      }
+    }
+
+    const std::chrono::duration<double, std::milli> elapsed{
+      std::chrono::steady_clock::now() - start};
+
+    Log("context probe: %s OpenGL %d.%d, %d attempt(s), %.3f ms, cache %s",
+        EGL_NO_CONTEXT != context ? "created" : "failed to create",
+        attribList[1],
+        attribList[3],
+        nAttempts,
+        elapsed.count(),
+        bCacheHit ? "hit" : "miss");
+  }
+  else
+#endif
+  {
+    context = eglCreateContext(display, config, shareContext, NULL);
+  }
+
+  return context;
+}
+
+// Without a surface the default framebuffer is incomplete, so surfaceless
+// rendering goes to an offscreen framebuffer of the requested size instead.
+static bool CreateFramebuffer(GLsizei width,
+                              GLsizei height,
+                              GLuint* pFramebuffer,
+                              GLuint  renderbuffers[2]) noexcept
+{
+  if (!glGenFramebuffers || !glGenRenderbuffers) {
+    return false;
+  }
+
+  glGenRenderbuffers(2, renderbuffers);
+  glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glGenFramebuffers(1, pFramebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, *pFramebuffer);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER,
+                            GL_COLOR_ATTACHMENT0,
+                            GL_RENDERBUFFER,
+                            renderbuffers[0]);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER,
+                            GL_DEPTH_STENCIL_ATTACHMENT,
+                            GL_RENDERBUFFER,
+                            renderbuffers[1]);
+
+  return GL_FRAMEBUFFER_COMPLETE == glCheckFramebufferStatus(GL_FRAMEBUFFER);
+}
+
+int main(int argc, char* argv[])
+{
+  int        nExitCode{EXIT_FAILURE};
+  EGLint     eglErrCode{EGL_SUCCESS};
+  EGLDisplay display{EGL_NO_DISPLAY};
+  EGLint     major{0};
+  EGLint     minor{0};
+  EGLConfig  config{NULL};
+  EGLContext context{EGL_NO_CONTEXT};
+  EGLSurface surface{EGL_NO_SURFACE};
+  GLuint     framebuffer{0};
+  GLuint     renderbuffers[2]{};
+  GLsizei    width{1280};
+  GLsizei    height{720};
+  long       nFrames{0};
+  long       nObjects{1024};
+  auto       framesInFlight{2};
+  double     targetFps{0.0};
+  auto       bSurfaceless{false};
+  FramePacer pacer;
+  auto       frameStatsPath{""};
+  auto       tracePath{""};
+  long       frame{0};
+
+  for (auto i{1}; i < argc; ++i) {
+    if (0 == std::strcmp(argv[i], "--frames") && i + 1 < argc) {
+      nFrames = std::strtol(argv[++i], NULL, 10);
+    }
+    else if (0 == std::strcmp(argv[i], "--objects") && i + 1 < argc) {
+      nObjects = std::strtol(argv[++i], NULL, 10);
+    }
+    else if (0 == std::strcmp(argv[i], "--width") && i + 1 < argc) {
+      width = static_cast<GLsizei>(std::strtol(argv[++i], NULL, 10));
+    }
+    else if (0 == std::strcmp(argv[i], "--height") && i + 1 < argc) {
+      height = static_cast<GLsizei>(std::strtol(argv[++i], NULL, 10));
+    }
+    else if (0 == std::strcmp(argv[i], "--frames-in-flight") && i + 1 < argc) {
+      framesInFlight = static_cast<int>(std::strtol(argv[++i], NULL, 10));
+    }
+    else if (0 == std::strcmp(argv[i], "--target-fps") && i + 1 < argc) {
+      targetFps = std::strtod(argv[++i], NULL);
+    }
+    else if (0 == std::strcmp(argv[i], "--frame-stats") && i + 1 < argc) {
+      frameStatsPath = argv[++i];
+    }
+    else if (0 == std::strcmp(argv[i], "--trace") && i + 1 < argc) {
+      tracePath = argv[++i];
+    }
+    else if (0 == std::strcmp(argv[i], "--surfaceless")) {
+      bSurfaceless = true;
+    }
+    else {
+      std::fprintf(stderr,
+                   "usage: %s [--frames n] [--objects n] [--width w] "
+                   "[--height h] [--frames-in-flight n] [--target-fps f] "
+                   "[--frame-stats file] [--trace file] [--surfaceless]\n",
+                   argv[0]);
+      goto end;
+    }
+  }
+
+  if (nObjects < 0) {
+    std::fprintf(stderr, "invalid object count %ld\n", nObjects);
+    goto end;
+  }
+
+  if (width <= 0 || height <= 0) {
+    std::fprintf(stderr, "invalid framebuffer size %dx%d\n", width, height);
+    goto end;
+  }
+
+  if (tracePath[0]) {
+    StartTrace();
+    SetTraceThreadName("render");
+  }
+
+  std::signal(SIGINT, &OnSignal);
+  std::signal(SIGTERM, &OnSignal);
+
+  display = GetDisplay();
+  if (EGL_NO_DISPLAY == display || !eglInitialize(display, &major, &minor)) {
+    eglErrCode = eglGetError();
+    goto end;
+  }
+
+  eglExtensions.Clear();
+  if (!eglExtensions.InsertAll(eglQueryString(display, EGL_EXTENSIONS))) {
+    eglErrCode = EGL_BAD_ALLOC;
+    goto terminate;
+  }
+
+  // Fall back to surfaceless rendering when the display has no pbuffer
+  // configurations, which is the case for llvmpipe on the surfaceless
+  // platform.
+  if (bSurfaceless || !ChooseConfig(display, true, &config)) {
+    bSurfaceless = true;
+
+    if (!eglExtensions.Contains("EGL_KHR_surfaceless_context"_ext)) {
+      eglErrCode = EGL_BAD_MATCH;
+      goto terminate;
+    }
+
+#ifdef EGL_KHR_no_config_context
+    if (!ChooseConfig(display, false, &config)
+        && eglExtensions.Contains("EGL_KHR_no_config_context"_ext)) {
+      config = EGL_NO_CONFIG_KHR;
+    }
+#else
+    if (!ChooseConfig(display, false, &config)) {
+      eglErrCode = eglGetError();
+      goto terminate;
+    }
+#endif
+  }
+
+  context = CreateContext(display, config);
+  if (EGL_NO_CONTEXT == context) {
+    eglErrCode = eglGetError();
+    goto terminate;
+  }
+
+  if (!bSurfaceless) {
+    const EGLint attribList[]{EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE};
+
+    surface = eglCreatePbufferSurface(display, config, attribList);
+    if (EGL_NO_SURFACE == surface) {
+      eglErrCode = eglGetError();
+      goto destroy_context;
+    }
+  }
+
+  if (!eglMakeCurrent(display, surface, surface, context)) {
+    eglErrCode = eglGetError();
+    goto destroy_surface;
+  }
+
+  if (!LoadGl(&GetGlProcAddress)) {
+    std::fprintf(stderr, "failed to load OpenGL\n");
+    goto make_no_longer_current;
+  }
+
+  InstallStateCache();
+
+  // The loader's context shares objects with the render thread's.
+  if (eglExtensions.Contains("EGL_KHR_surfaceless_context"_ext)) {
+    loaderDisplay = display;
+    loaderContext = CreateContext(display, config, context);
+  }
+  if (EGL_NO_CONTEXT == loaderContext) {
+    Log("loader: disabled, there is no shared context");
+  }
+  else {
+    loader.Start(&MakeLoaderContextCurrent);
+  }
+
+  if (bSurfaceless
+      && !CreateFramebuffer(width, height, &framebuffer, renderbuffers)) {
+    std::fprintf(stderr, "failed to create the offscreen framebuffer\n");
+    goto delete_framebuffer;
+  }
+
+  if (!InitRenderer(static_cast<std::size_t>(nObjects))) {
+    goto delete_framebuffer;
+  }
+
+  ResizeRenderer(width, height);
+
+  if (!pacer.Init(framesInFlight,
+                  targetFps > 0
+                    ? std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::duration<double>{1.0 / targetFps})
+                    : std::chrono::nanoseconds{0})) {
+    goto release_renderer;
+  }
+
+  if (!gpuProfiler.Init()) {
+    goto release_renderer;
+  }
+
+  if (!frameArena.Init(FrameArena::defaultBytesPerFrame,
+                       pacer.FramesInFlight())) {
+    std::fprintf(stderr, "failed to allocate the frame arena\n");
+    goto release_renderer;
+  }
+
+  if (!frameStats.Start(frameStatsPath)) {
+    Log("failed to start the frame statistics writer");
+  }
+
+  // The main thread helps while it waits for jobs, so it is not counted.
+  if (!jobSystem.Start(0)) {
+    Log("failed to start the job workers");
+  }
+
+  {
+    const auto start{std::chrono::steady_clock::now()};
+
+    while (bRuns && (nFrames <= 0 || frame < nFrames)) {
+      const TraceZone frameZone{"frame"};
+
+      {
+        const TraceZone waitZone{"wait"};
+        pacer.Wait();
+      }
+
+      const auto begin{FrameStats::Clock::now()};
+      const auto heapAllocations{ThreadHeapAllocations()};
+
+      frameArena.BeginFrame();
+      gpuProfiler.BeginFrame();
+
+      {
+        const TraceZone submitZone{"submit"};
+        RenderFrame();
+      }
+
+      const auto submitted{FrameStats::Clock::now()};
+
+      // Swapping a pbuffer has no effect, the fences alone bound how far
+      // the CPU runs ahead.
+      {
+        const TraceZone swapZone{"swap"};
+        pacer.Submit();
+      }
+
+      auto timing{
+        frameStats.Measure(begin, submitted, FrameStats::Clock::now())};
+      const auto stateStats{TakeStateCacheStats()};
+
+      timing.stateIssued     = stateStats.issued;
+      timing.stateElided     = stateStats.elided;
+      timing.arenaBytes      = frameArena.Usage().bytes;
+      timing.heapAllocations = static_cast<std::uint32_t>(
+        ThreadHeapAllocations() - heapAllocations);
+      if (gpuProfiler.Merge(&timing)) {
+        frameStats.Record(timing);
+      }
+      ++frame;
+    }
+
+    // Include the frames still in flight in the measurement and the
+    // statistics.
+    glFinish();
+    for (FrameTiming timing{}; gpuProfiler.Drain(&timing);) {
+      frameStats.Record(timing);
+    }
+    jobSystem.Stop();
+    frameStats.Stop();
+
+    const std::chrono::duration<double> elapsed{
+      std::chrono::steady_clock::now() - start};
+
+    std::printf("%ld frames in %.3f s (%.1f fps)\n",
+                frame,
+                elapsed.count(),
+                elapsed.count() > 0 ? frame / elapsed.count() : 0.0);
+    Log("%zu of %zu GL entry points resolved",
+        GlResolvedCount(),
+        glDispatchSize);
+
+    if (tracePath[0] && !WriteTrace(tracePath)) {
+      std::fprintf(stderr, "failed to write the trace\n");
+    }
+
+    // Counted builds check that frames in steady state stay off the heap.
+    if (heapAllocationsCounted && frameStats.SteadyHeapAllocations()) {
+      std::fprintf(stderr, "frames after the warm-up allocated on the heap\n");
+      goto release_renderer;
+    }
+  }
+
+  nExitCode = EXIT_SUCCESS;
+
+  // Everything released here is safe to release without having been
+  // initialized.
+release_renderer:
+  frameArena.Release();
+  ReleaseRenderer();
+  gpuProfiler.Release();
+  pacer.Release();
+
+delete_framebuffer:
+  loader.Stop();
+  if (EGL_NO_CONTEXT != loaderContext) {
+    if (!eglDestroyContext(display, loaderContext)) {
+      eglErrCode = eglGetError();
+    }
+    loaderContext = EGL_NO_CONTEXT;
+  }
+
+  if (framebuffer) {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(2, renderbuffers);
+    framebuffer = 0;
+  }
+
+make_no_longer_current:
+  if (!eglMakeCurrent(display,
+                      EGL_NO_SURFACE,
+                      EGL_NO_SURFACE,
+                      EGL_NO_CONTEXT)) {
+    eglErrCode = eglGetError();
+  }
+
+destroy_surface:
+  if (EGL_NO_SURFACE != surface) {
+    if (!eglDestroySurface(display, surface)) {
+      eglErrCode = eglGetError();
+    }
+    surface = EGL_NO_SURFACE;
+  }
+
+destroy_context:
+  if (!eglDestroyContext(display, context)) {
+    eglErrCode = eglGetError();
+  }
+  context = EGL_NO_CONTEXT;
+
+terminate:
+  if (!eglTerminate(display)) {
+    eglErrCode = eglGetError();
+  }
+  display = EGL_NO_DISPLAY;
+
+end:
+  if (EGL_SUCCESS != eglErrCode) {
+    std::fprintf(stderr,
+                 "EGL error 0x%04X\n",
+                 static_cast<unsigned>(eglErrCode));
+    nExitCode = EXIT_FAILURE;
+  }
+
+  return nExitCode;
+}
@@ -0,0 +1,1043 @@
+#include "mesh_batcher.hpp"
+#include "frame_arena.hpp"
+#include "frustum_culling.hpp"
+#include "gpu_profiler.hpp"
+#include "loader.hpp"
+#include "log.hpp"
+#include "shader_library.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <new>
+#include <utility>
+
+namespace {
+
+// Layout of glMultiDrawElementsIndirect commands.
+struct DrawElementsIndirectCommand {
+  GLuint count;
+  GLuint instanceCount;
+  GLuint firstIndex;
+  GLint  baseVertex;
+  GLuint baseInstance;
+};
+
+// The Frame uniform block, std140.
+struct FrameUniforms {
+  GLfloat viewProjection[16];
+  GLfloat hiZViewProjection[16];
+  GLfloat planes[6][4]; // Frustum planes, normals pointing inside.
+  GLint   hiZ[4];       // Width, height, levels and whether it is valid.
+  GLuint  counts[4];    // Instances, draws and the batch's first instance.
+};
+
+// Per draw input of the culling pass, std430. The command covers all
+// instances of the mesh.
+struct CullDraw {
+  DrawElementsIndirectCommand command;
+  GLfloat                     radius;
+  GLuint                      padding[2];
+};
+
+// Features of the drawing and the compaction programs.
+enum class DrawFeature : std::uint8_t { multiDraw };
+enum class CompactFeature : std::uint8_t { drawCount };
+
+} // namespace
+
+static_assert(sizeof(FrameUniforms) == 256);
+static_assert(sizeof(CullDraw) == 32);
+
+// Uniform buffer binding of the Frame block.
+constexpr GLuint frameBinding{0};
+
+// Texture unit the buffer texture stays bound to, one that the minimum
+// of 16 vertex shader units always covers.
+constexpr GLuint instanceTextureUnit{15};
+
+constexpr ShaderFeature drawFeatures[]{{"MULTI_DRAW", 430}};
+// Without a draw count from the GPU, empty draws stay in place.
+constexpr ShaderFeature compactFeatures[]{{"DRAW_COUNT", 430}};
+
+// The GPU-written part of the draw buffer, per batch: the draw count, the
+// visible instances of every draw, then the compacted indirect commands.
+// Batches are a multiple of 256 bytes apart, the largest storage buffer
+// offset alignment an implementation may require.
+constexpr GLintptr drawCountOffset{0};
+constexpr GLintptr visibleCountsOffset{sizeof(GLuint)};
+constexpr GLintptr commandsOffset{
+  visibleCountsOffset + MeshBatcher::maxMeshes * sizeof(GLuint)};
+constexpr GLintptr drawBatchStride{2048};
+
+static_assert(commandsOffset
+                + MeshBatcher::maxMeshes * sizeof(DrawElementsIndirectCommand)
+              <= drawBatchStride);
+static_assert(0 == drawBatchStride % 256);
+
+// The compaction pass runs one invocation per mesh in a single group, and
+// the culling shader samples the pyramid from its unit.
+static_assert(64 == MeshBatcher::maxMeshes);
+static_assert(14 == HiZPyramid::textureUnit);
+
+static const ShaderSource frameBlockSource{"frame_block.glsl", R"(
+layout(std140) uniform Frame {
+  mat4  u_viewProjection;
+  mat4  u_hiZViewProjection;
+  vec4  u_planes[6];
+  ivec4 u_hiZ;
+  uvec4 u_counts;
+};
+)"};
+
+// Instanced attributes honour the base instance of indirect draws, so a
+// buffer of ascending ids turns it into the instance index without
+// needing gl_DrawID or gl_BaseInstance, which take OpenGL 4.6. Without
+// multi-draw the instances come from a buffer texture.
+static const ShaderSource vertexSource{"mesh.vert", R"(
+layout(location = 0) in vec2 a_position;
+
+out vec4 v_color;
+
+#ifdef MULTI_DRAW
+layout(location = 1) in uint a_instance;
+
+struct Instance {
+  vec4 transform;
+  vec4 color;
+};
+
+layout(std430, binding = 0) readonly buffer Instances {
+  Instance instances[];
+};
+
+void main()
+{
+  Instance instance = instances[a_instance];
+  vec4     transform = instance.transform;
+
+  gl_Position = u_viewProjection
+                * vec4(a_position * transform.w + transform.xy,
+                       transform.z,
+                       1.0);
+  v_color = instance.color;
+}
+#else
+uniform samplerBuffer u_instances;
+uniform int           u_firstInstance;
+
+void main()
+{
+  int  texel = 2 * (u_firstInstance + gl_InstanceID);
+  vec4 transform = texelFetch(u_instances, texel);
+
+  gl_Position = u_viewProjection
+                * vec4(a_position * transform.w + transform.xy,
+                       transform.z,
+                       1.0);
+  v_color = texelFetch(u_instances, texel + 1);
+}
+#endif
+)"};
+
+static const ShaderSource fragmentSource{"mesh.frag", R"(
+in vec4 v_color;
+
+out vec4 o_color;
+
+void main()
+{
+  o_color = v_color;
+}
+)"};
+
+// Stands in for mesh.frag while the drawing program builds, in a flat
+// colour that is cheap to compile and shows that the real one is pending.
+static const ShaderSource fallbackFragmentSource{"mesh_fallback.frag", R"(
+out vec4 o_color;
+
+void main()
+{
+  o_color = vec4(0.5, 0.5, 0.5, 1.0);
+}
+)"};
+
+static const ShaderSource cullCommonSource{"cull_common.glsl", R"(
+struct Instance {
+  vec4 transform;
+  vec4 color;
+};
+
+struct DrawCommand {
+  uint count;
+  uint instanceCount;
+  uint firstIndex;
+  int  baseVertex;
+  uint baseInstance;
+};
+
+struct CullDraw {
+  DrawCommand command;
+  float       radius;
+  uint        padding[2];
+};
+
+layout(std430, binding = 0) readonly buffer Instances {
+  Instance instances[];
+};
+
+layout(std430, binding = 1) readonly buffer CullDraws {
+  CullDraw draws[];
+};
+
+layout(std430, binding = 2) writeonly buffer Visible {
+  Instance visible[];
+};
+
+layout(std430, binding = 3) buffer Draws {
+  uint        drawCount;
+  uint        visibleCounts[64];
+  DrawCommand commands[64];
+};
+
+layout(local_size_x = 64) in;
+)"};
+
+static const ShaderSource cullSource{"cull.comp", R"(
+layout(binding = 14) uniform sampler2D u_hiZPyramid;
+
+bool InFrustum(vec3 center, float radius)
+{
+  for (int i = 0; i < 6; ++i) {
+    if (dot(u_planes[i].xyz, center) + u_planes[i].w < -radius) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Projects the corners of the bounding cube with the camera of the
+// pyramid and compares their nearest depth with the farthest depth behind
+// their screen rectangle, at the level where it spans at most 2x2 texels.
+bool Occluded(vec3 center, float radius)
+{
+  vec2  low = vec2(1.0);
+  vec2  high = vec2(-1.0);
+  float nearest = 1.0;
+
+  if (0 == u_hiZ.w) {
+    return false;
+  }
+
+  for (int i = 0; i < 8; ++i) {
+    vec3 corner = center + radius * vec3((i & 1) != 0 ? 1.0 : -1.0,
+                                         (i & 2) != 0 ? 1.0 : -1.0,
+                                         (i & 4) != 0 ? 1.0 : -1.0);
+    vec4 clip = u_hiZViewProjection * vec4(corner, 1.0);
+
+    if (clip.w <= 0.0) {
+      return false;
+    }
+
+    vec3 ndc = clip.xyz / clip.w;
+
+    low = min(low, ndc.xy);
+    high = max(high, ndc.xy);
+    nearest = min(nearest, ndc.z * 0.5 + 0.5);
+  }
+
+  // Nothing is known about what was off screen.
+  if (any(lessThan(low, vec2(-1.0))) || any(greaterThan(high, vec2(1.0)))) {
+    return false;
+  }
+
+  ivec2 size = u_hiZ.xy;
+  ivec2 first = clamp(ivec2((low * 0.5 + 0.5) * vec2(size)),
+                      ivec2(0),
+                      size - 1);
+  ivec2 last = clamp(ivec2((high * 0.5 + 0.5) * vec2(size)),
+                     ivec2(0),
+                     size - 1);
+  int   extent = max(last.x - first.x, last.y - first.y);
+  int   level = min(0 < extent ? findMSB(extent) : 0, u_hiZ.z - 1);
+  ivec2 levelLast = max(size >> (level + 1), 1) - 1;
+
+  first = min(first >> (level + 1), levelLast);
+  last = min(last >> (level + 1), levelLast);
+
+  float farthest =
+    max(max(texelFetch(u_hiZPyramid, first, level).r,
+            texelFetch(u_hiZPyramid, ivec2(last.x, first.y), level).r),
+        max(texelFetch(u_hiZPyramid, ivec2(first.x, last.y), level).r,
+            texelFetch(u_hiZPyramid, last, level).r));
+
+  return nearest > farthest;
+}
+
+void main()
+{
+  uint index = gl_GlobalInvocationID.x;
+
+  if (index >= u_counts.x) {
+    return;
+  }
+
+  // The last draw starting at or before the instance.
+  uint draw = 0;
+  for (uint count = u_counts.y; count > 1;) {
+    uint middle = count / 2;
+
+    if (draws[draw + middle].command.baseInstance <= index) {
+      draw += middle;
+    }
+    count -= middle;
+  }
+
+  Instance instance = instances[index];
+  vec3     center = instance.transform.xyz;
+  float    radius = instance.transform.w * draws[draw].radius;
+
+  if (InFrustum(center, radius) && !Occluded(center, radius)) {
+    uint slot = atomicAdd(visibleCounts[draw], 1u);
+
+    visible[u_counts.z + draws[draw].command.baseInstance + slot] = instance;
+  }
+}
+)"};
+
+static const ShaderSource compactSource{"compact.comp", R"(
+void main()
+{
+  uint draw = gl_LocalInvocationID.x;
+
+  if (draw >= u_counts.y) {
+    return;
+  }
+
+  DrawCommand command = draws[draw].command;
+
+  command.instanceCount = visibleCounts[draw];
+  command.baseInstance += u_counts.z;
+#ifdef DRAW_COUNT
+  if (0 != command.instanceCount) {
+    commands[atomicAdd(drawCount, 1u)] = command;
+  }
+#else
+  commands[draw] = command;
+#endif
+}
+)"};
+
+static const ShaderSource* const drawVertexSources[]{&frameBlockSource,
+                                                     &vertexSource};
+static const ShaderSource* const drawFragmentSources[]{&fragmentSource};
+static const ShaderSource* const fallbackFragmentSources[]{
+  &fallbackFragmentSource};
+static const ShaderSource* const cullSources[]{
+  &frameBlockSource, &cullCommonSource, &cullSource};
+static const ShaderSource* const compactSources[]{
+  &frameBlockSource, &cullCommonSource, &compactSource};
+
+static const ShaderFamily<DrawFeature> drawFamily{
+  {"mesh-draw",
+   330,
+   drawFeatures,
+   std::size(drawFeatures),
+   {drawVertexSources, 2},
+   {drawFragmentSources, 1},
+   {}}};
+static const ShaderFamily<NoShaderFeature> cullFamily{
+  {"mesh-cull", 430, nullptr, 0, {}, {}, {cullSources, 3}}};
+static const ShaderFamily<CompactFeature> compactFamily{
+  {"mesh-compact",
+   430,
+   compactFeatures,
+   std::size(compactFeatures),
+   {},
+   {},
+   {compactSources, 3}}};
+
+static void BindFrameBlock(GLuint program) noexcept
+{
+  const auto index{glGetUniformBlockIndex(program, "Frame")};
+
+  if (GL_INVALID_INDEX != index) {
+    glUniformBlockBinding(program, index, frameBinding);
+  }
+}
+
+// Gribb and Hartmann: every plane is the sum or difference of the last
+// row of the matrix and another row, normalised so that dot products give
+// distances.
+static void ExtractFrustumPlanes(const GLfloat (&matrix)[16],
+                                 GLfloat (&planes)[6][4]) noexcept
+{
+  for (auto i{0}; i < 6; ++i) {
+    const auto row{i / 2};
+    const auto sign{0 == i % 2 ? 1.0f : -1.0f};
+    auto       length{0.0f};
+
+    for (auto column{0}; column < 4; ++column) {
+      planes[i][column] = matrix[4 * column + 3]
+                          + sign * matrix[4 * column + row];
+    }
+
+    length = std::sqrt(planes[i][0] * planes[i][0]
+                       + planes[i][1] * planes[i][1]
+                       + planes[i][2] * planes[i][2]);
+    if (length > 0.0f) {
+      for (auto& value : planes[i]) {
+        value /= length;
+      }
+    }
+  }
+}
+
+// A buffer of the ascending ids of the instances.
+static GLuint CreateInstanceIds(std::size_t count) noexcept
+{
+  const auto size{static_cast<GLsizeiptr>(count * sizeof(std::uint32_t))};
+  GLuint     buffer{0};
+
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STATIC_DRAW);
+  if (const auto pIds{static_cast<std::uint32_t*>(glMapBufferRange(
+        GL_ARRAY_BUFFER,
+        0,
+        size,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT))}) {
+    for (std::size_t i{0}; i < count; ++i) {
+      pIds[i] = static_cast<std::uint32_t>(i);
+    }
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  return buffer;
+}
+
+bool MeshBatcher::Init(const StreamBuffer& stream,
+                       std::size_t         maxVertices,
+                       std::size_t         maxIndices,
+                       std::size_t         maxInstances,
+                       MeshDrawPath        path) noexcept
+{
+  Release();
+
+  if (glVersion < 33 || !stream.Name()) {
+    Log("mesh batcher: disabled, needs OpenGL 3.3 and a stream buffer");
+    return false;
+  }
+
+  m_bMultiDraw = MeshDrawPath::multiDraw == path && GL_DISPATCH_VERSION >= 43
+                 && glVersion >= 43;
+  m_bPerInstance = MeshDrawPath::perInstance == path;
+
+  m_queue.reset(new (std::nothrow) QueuedInstance[maxInstances]);
+  if (!m_bMultiDraw) {
+    m_bounds.reset(new (std::nothrow) GLfloat[4 * maxInstances]);
+  }
+  if (!m_queue || (!m_bMultiDraw && !m_bounds)) {
+    Release();
+    return false;
+  }
+
+  m_bDrawCount   = m_bMultiDraw && CanDrawIndirectCount();
+  m_maxVertices  = maxVertices;
+  m_maxIndices   = maxIndices;
+  m_maxInstances = maxInstances;
+
+  const auto features{
+    FeatureSet<DrawFeature>{}.With(DrawFeature::multiDraw, m_bMultiDraw)};
+
+  // All builds are handed to the driver before any is waited for.
+  shaderLibrary.Prewarm(drawFamily);
+  m_pDrawBuild = shaderLibrary.Request(drawFamily, features);
+  if (!m_pDrawBuild || m_pDrawBuild->Failed()) {
+    Release();
+    return false;
+  }
+
+  if (m_bMultiDraw) {
+    shaderLibrary.Prewarm(cullFamily);
+    shaderLibrary.Prewarm(compactFamily);
+    m_pCullBuild    = shaderLibrary.Request(cullFamily, {});
+    m_pCompactBuild = shaderLibrary.Request(
+      compactFamily,
+      FeatureSet<CompactFeature>{}.With(CompactFeature::drawCount,
+                                        m_bDrawCount));
+
+    if (!m_pCullBuild || m_pCullBuild->Failed() || !m_pCompactBuild
+        || m_pCompactBuild->Failed() || !m_hiZ.Init()) {
+      Release();
+      return false;
+    }
+  }
+
+  // Usually the program cache had the drawing program. Otherwise a
+  // fallback is built right away, without which the instances are
+  // dropped until the drawing program is linked.
+  if (const auto program{m_pDrawBuild->Poll()}) {
+    UseDrawProgram(program);
+  }
+  else {
+    m_fallbackProgram = shaderLibrary.BuildFallback(
+      drawFamily, features, {fallbackFragmentSources, 1});
+    if (m_fallbackProgram) {
+      UseDrawProgram(m_fallbackProgram);
+    }
+    else {
+      Log("mesh batcher: the fallback program failed, nothing is drawn "
+          "until the mesh program is linked");
+    }
+  }
+
+  glGenVertexArrays(1, &m_vertexArray);
+  glBindVertexArray(m_vertexArray);
+
+  glGenBuffers(1, &m_vertexBuffer);
+  glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+  glBufferData(GL_ARRAY_BUFFER,
+               static_cast<GLsizeiptr>(maxVertices * sizeof(MeshVertex)),
+               nullptr,
+               GL_STATIC_DRAW);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), 0);
+  glEnableVertexAttribArray(0);
+
+  glGenBuffers(1, &m_indexBuffer);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+               static_cast<GLsizeiptr>(maxIndices * sizeof(std::uint32_t)),
+               nullptr,
+               GL_STATIC_DRAW);
+
+  if (m_bMultiDraw) {
+    // Megabytes for many instances, written on the loader if it runs.
+    m_instanceIdsLoad = loader.Submit(
+      "instance ids",
+      {},
+      [maxInstances](const std::vector<std::byte>&) noexcept {
+        return CreateInstanceIds(maxInstances);
+      });
+    if (!m_instanceIdsLoad.Valid()) {
+      m_instanceIds = CreateInstanceIds(maxInstances);
+      AttachInstanceIds();
+    }
+
+    // Only ever written by the GPU.
+    glGenBuffers(1, &m_visibleBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_visibleBuffer);
+    glBufferData(
+      GL_ARRAY_BUFFER,
+      static_cast<GLsizeiptr>(maxInstances * sizeof(MeshInstance)),
+      nullptr,
+      GL_DYNAMIC_COPY);
+
+    glGenBuffers(1, &m_drawBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_drawBuffer);
+    glBufferData(GL_ARRAY_BUFFER,
+                 static_cast<GLsizeiptr>(maxBatches * drawBatchStride),
+                 nullptr,
+                 GL_DYNAMIC_COPY);
+  }
+  else {
+    // The buffer texture follows the stream buffer through orphaning, it
+    // names the buffer object rather than its storage.
+    glGenTextures(1, &m_instanceTexture);
+    glActiveTexture(GL_TEXTURE0 + instanceTextureUnit);
+    glBindTexture(GL_TEXTURE_BUFFER, m_instanceTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, stream.Name());
+    glActiveTexture(GL_TEXTURE0);
+  }
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  if (m_bMultiDraw) {
+    Log("mesh batcher: %s, up to %zu instance(s)",
+        m_bDrawCount ? "multi-draw indirect, culled and counted on the GPU"
+                     : "multi-draw indirect, culled on the GPU",
+        maxInstances);
+  }
+  else {
+    Log("mesh batcher: %s, culled on the CPU with %s, up to %zu "
+        "instance(s)",
+        m_bPerInstance ? "a draw per instance" : "instanced draws",
+        CullingIsaName(DetectCullingIsa()),
+        maxInstances);
+  }
+
+  return true;
+}
+
+void MeshBatcher::Release() noexcept
+{
+  m_hiZ.Release();
+
+  // Deleting zero is silently ignored.
+  glDeleteTextures(1, &m_instanceTexture);
+  glDeleteBuffers(1, &m_drawBuffer);
+  glDeleteBuffers(1, &m_visibleBuffer);
+  if (m_instanceIdsLoad.Valid()) {
+    m_instanceIds = loader.Finish(&m_instanceIdsLoad);
+  }
+  glDeleteBuffers(1, &m_instanceIds);
+  glDeleteBuffers(1, &m_indexBuffer);
+  glDeleteBuffers(1, &m_vertexBuffer);
+  glDeleteVertexArrays(1, &m_vertexArray);
+  glDeleteProgram(m_fallbackProgram);
+
+  m_pDrawBuild           = nullptr;
+  m_pCullBuild           = nullptr;
+  m_pCompactBuild        = nullptr;
+  m_program              = 0;
+  m_fallbackProgram      = 0;
+  m_cullProgram          = 0;
+  m_compactProgram       = 0;
+  m_firstInstanceUniform = -1;
+  m_vertexArray          = 0;
+  m_vertexBuffer         = 0;
+  m_indexBuffer          = 0;
+  m_instanceIds          = 0;
+  m_instanceTexture      = 0;
+  m_visibleBuffer        = 0;
+  m_drawBuffer           = 0;
+  m_vertexCount          = 0;
+  m_indexCount           = 0;
+  m_meshCount            = 0;
+  m_queue.reset();
+  m_bounds.reset();
+
+  std::fill(std::begin(m_cullBatches), std::end(m_cullBatches), CullBatch{});
+}
+
+int MeshBatcher::AddMesh(const MeshVertex*    pVertices,
+                         std::size_t          vertexCount,
+                         const std::uint32_t* pIndices,
+                         std::size_t          indexCount) noexcept
+{
+  GLfloat radius{0.0f};
+
+  if (!m_vertexArray || maxMeshes == m_meshCount
+      || m_maxVertices - m_vertexCount < vertexCount
+      || m_maxIndices - m_indexCount < indexCount) {
+    return -1;
+  }
+
+  for (std::size_t i{0}; i < vertexCount; ++i) {
+    radius = std::max(radius, std::hypot(pVertices[i].x, pVertices[i].y));
+  }
+
+  // The element array buffer binding belongs to the vertex array.
+  glBindVertexArray(m_vertexArray);
+  glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+  glBufferSubData(GL_ARRAY_BUFFER,
+                  static_cast<GLintptr>(m_vertexCount * sizeof(MeshVertex)),
+                  static_cast<GLsizeiptr>(vertexCount * sizeof(MeshVertex)),
+                  pVertices);
+  glBufferSubData(
+    GL_ELEMENT_ARRAY_BUFFER,
+    static_cast<GLintptr>(m_indexCount * sizeof(std::uint32_t)),
+    static_cast<GLsizeiptr>(indexCount * sizeof(std::uint32_t)),
+    pIndices);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindVertexArray(0);
+
+  m_meshes[m_meshCount] = {static_cast<GLuint>(m_indexCount),
+                           static_cast<GLsizei>(indexCount),
+                           static_cast<GLint>(m_vertexCount),
+                           radius};
+  m_vertexCount += vertexCount;
+  m_indexCount  += indexCount;
+
+  return static_cast<int>(m_meshCount++);
+}
+
+void MeshBatcher::AttachInstanceIds() noexcept
+{
+  glBindVertexArray(m_vertexArray);
+  glBindBuffer(GL_ARRAY_BUFFER, m_instanceIds);
+  glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, 0, nullptr);
+  glVertexAttribDivisor(1, 1);
+  glEnableVertexAttribArray(1);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindVertexArray(0);
+}
+
+void MeshBatcher::UseDrawProgram(GLuint program) noexcept
+{
+  m_program = program;
+  BindFrameBlock(m_program);
+  if (!m_bMultiDraw) {
+    glUseProgram(m_program);
+    glUniform1i(glGetUniformLocation(m_program, "u_instances"),
+                instanceTextureUnit);
+    glUseProgram(0);
+    m_firstInstanceUniform = glGetUniformLocation(m_program,
+                                                  "u_firstInstance");
+  }
+}
+
+void MeshBatcher::BeginFrame() noexcept
+{
+  if (m_instanceIdsLoad.Valid()
+      && loader.Poll(&m_instanceIdsLoad, &m_instanceIds) && m_instanceIds) {
+    AttachInstanceIds();
+  }
+
+  // Programs also change when the shader library reloads them.
+  const auto program{m_pDrawBuild ? m_pDrawBuild->Poll() : 0};
+  const auto cullProgram{m_pCullBuild ? m_pCullBuild->Poll() : 0};
+  const auto compactProgram{m_pCompactBuild ? m_pCompactBuild->Poll() : 0};
+
+  if (program && program != m_program) {
+    UseDrawProgram(program);
+  }
+
+  if (cullProgram && cullProgram != m_cullProgram) {
+    m_cullProgram = cullProgram;
+    BindFrameBlock(m_cullProgram);
+  }
+  if (compactProgram && compactProgram != m_compactProgram) {
+    m_compactProgram = compactProgram;
+    BindFrameBlock(m_compactProgram);
+  }
+}
+
+void MeshBatcher::SetCamera(const GLfloat (&viewProjection)[16]) noexcept
+{
+  std::memcpy(m_viewProjection, viewProjection, sizeof m_viewProjection);
+}
+
+bool MeshBatcher::Add(std::size_t         index,
+                      int                 mesh,
+                      const MeshInstance& instance) noexcept
+{
+  if (index >= m_maxInstances) {
+    return false;
+  }
+
+  const auto bValid{0 <= mesh && static_cast<std::size_t>(mesh) < m_meshCount};
+
+  if (m_bounds) {
+    const auto pBounds{m_bounds.get() + index};
+
+    pBounds[0]                  = instance.x;
+    pBounds[m_maxInstances]     = instance.y;
+    pBounds[2 * m_maxInstances] = instance.z;
+    pBounds[3 * m_maxInstances] =
+      bValid ? instance.scale * m_meshes[mesh].radius : 0.0f;
+  }
+
+  m_queue[index] = {static_cast<std::uint32_t>(bValid ? mesh : maxMeshes),
+                    instance};
+
+  return bValid;
+}
+
+void MeshBatcher::Submit(StreamBuffer& stream,
+                         CommandList&  commands,
+                         std::uint64_t key,
+                         std::size_t   batch,
+                         std::size_t   first,
+                         std::size_t   count) noexcept
+{
+  std::size_t          firstInstances[maxMeshes]{};
+  std::size_t          cursors[maxMeshes]{};
+  std::size_t          drawCount{0};
+  std::size_t          instances{0};
+  GLfloat              planes[6][4]{};
+  const std::uint32_t* pVisible{nullptr};
+  auto                 visible{count};
+
+  if (!count || maxBatches <= batch || m_maxInstances < first
+      || m_maxInstances - first < count || !m_program
+      || (m_bMultiDraw && !m_instanceIds)) {
+    return;
+  }
+
+  const auto pQueue{m_queue.get() + first};
+
+  ExtractFrustumPlanes(m_viewProjection, planes);
+
+  // Unculled if the frame arena is exhausted.
+  if (m_bounds) {
+    if (const auto pIndices{frameArena.Allocate<std::uint32_t>(count)}) {
+      visible  = CullSpheres({m_bounds.get() + first,
+                              m_bounds.get() + m_maxInstances + first,
+                              m_bounds.get() + 2 * m_maxInstances + first,
+                              m_bounds.get() + 3 * m_maxInstances + first,
+                              count},
+                             planes,
+                             pIndices);
+      pVisible = pIndices;
+    }
+    if (!visible) {
+      return;
+    }
+  }
+
+  // Counting sort by mesh, straight into the stream buffer. Buffer
+  // texture texels need the instances aligned to their own size.
+  for (std::size_t i{0}; i < visible; ++i) {
+    const auto mesh{pQueue[pVisible ? pVisible[i] : i].mesh};
+
+    if (maxMeshes != mesh) {
+      ++cursors[mesh];
+    }
+  }
+  for (std::size_t mesh{0}; mesh < m_meshCount; ++mesh) {
+    firstInstances[mesh] = instances;
+    drawCount           += 0 < cursors[mesh];
+    instances           += std::exchange(cursors[mesh], instances);
+  }
+  if (!instances) {
+    return;
+  }
+
+  const auto alignment{stream.OffsetAlignment()};
+  const auto frame{stream.Allocate(sizeof(FrameUniforms), alignment)};
+  const auto storage{
+    stream.Allocate(instances * sizeof(MeshInstance),
+                    m_bMultiDraw ? alignment : sizeof(MeshInstance))};
+  const auto cull{m_bMultiDraw
+                    ? stream.Allocate(drawCount * sizeof(CullDraw), alignment)
+                    : StreamAllocation{}};
+  if (!frame.pData || !storage.pData || (m_bMultiDraw && !cull.pData)) {
+    Log("mesh batcher: the stream buffer is full");
+    return;
+  }
+
+  const auto pFrame{static_cast<FrameUniforms*>(frame.pData)};
+  std::memcpy(pFrame->viewProjection,
+              m_viewProjection,
+              sizeof m_viewProjection);
+  std::memcpy(pFrame->hiZViewProjection,
+              m_hiZViewProjection,
+              sizeof m_hiZViewProjection);
+  std::memcpy(pFrame->planes, planes, sizeof planes);
+  pFrame->hiZ[0]    = m_hiZ.Width();
+  pFrame->hiZ[1]    = m_hiZ.Height();
+  pFrame->hiZ[2]    = m_hiZ.Levels();
+  pFrame->hiZ[3]    = m_hiZ.Valid();
+  pFrame->counts[0] = static_cast<GLuint>(instances);
+  pFrame->counts[1] = static_cast<GLuint>(drawCount);
+  pFrame->counts[2] = static_cast<GLuint>(first);
+
+  const auto pInstances{static_cast<MeshInstance*>(storage.pData)};
+  for (std::size_t i{0}; i < visible; ++i) {
+    const auto& queuedInstance{pQueue[pVisible ? pVisible[i] : i]};
+
+    if (maxMeshes != queuedInstance.mesh) {
+      pInstances[cursors[queuedInstance.mesh]++] = queuedInstance.instance;
+    }
+  }
+
+  commands.Record(key,
+                  BindBufferCommand{GL_UNIFORM_BUFFER,
+                                    frameBinding,
+                                    stream.Name(),
+                                    frame.offset,
+                                    sizeof(FrameUniforms)});
+
+  if (m_bMultiDraw) {
+    const auto pDraws{static_cast<CullDraw*>(cull.pData)};
+    std::size_t draw{0};
+
+    for (std::size_t mesh{0}; mesh < m_meshCount; ++mesh) {
+      if (const auto meshInstances{cursors[mesh] - firstInstances[mesh]}) {
+        pDraws[draw++] = {{static_cast<GLuint>(m_meshes[mesh].indexCount),
+                           static_cast<GLuint>(meshInstances),
+                           m_meshes[mesh].firstIndex,
+                           m_meshes[mesh].baseVertex,
+                           static_cast<GLuint>(firstInstances[mesh])},
+                          m_meshes[mesh].radius,
+                          {}};
+      }
+    }
+
+    // Until the culling programs are linked, the culling input itself
+    // draws every instance straight from the stream buffer.
+    if (!m_cullProgram || !m_compactProgram) {
+      commands.Record(
+        key,
+        MultiDrawCommand{
+          .program         = m_program,
+          .vertexArray     = m_vertexArray,
+          .state           = drawStateDepthTest,
+          .mode            = GL_TRIANGLES,
+          .indexType       = GL_UNSIGNED_INT,
+          .indirectBuffer  = stream.Name(),
+          .indirectOffset  = cull.offset,
+          .stride          = sizeof(CullDraw),
+          .drawCount       = static_cast<GLsizei>(drawCount),
+          .parameterBuffer = 0,
+          .parameterOffset = 0,
+          .storageBuffer   = stream.Name(),
+          .storageOffset   = storage.offset,
+          .storageSize =
+            static_cast<GLsizeiptr>(instances * sizeof(MeshInstance))});
+      return;
+    }
+
+    // Culling runs once the stream buffer is committed. The culled
+    // instances of the batch keep its range of the visible buffer.
+    const auto drawOffset{static_cast<GLintptr>(batch * drawBatchStride)};
+
+    m_cullBatches[batch] = {stream.Name(),
+                            frame.offset,
+                            storage.offset,
+                            cull.offset,
+                            instances,
+                            drawCount};
+
+    commands.Record(
+      key,
+      MultiDrawCommand{
+        .program         = m_program,
+        .vertexArray     = m_vertexArray,
+        .state           = drawStateDepthTest,
+        .mode            = GL_TRIANGLES,
+        .indexType       = GL_UNSIGNED_INT,
+        .indirectBuffer  = m_drawBuffer,
+        .indirectOffset  = drawOffset + commandsOffset,
+        .stride          = 0,
+        .drawCount       = static_cast<GLsizei>(drawCount),
+        .parameterBuffer = m_bDrawCount ? m_drawBuffer : 0,
+        .parameterOffset = drawOffset + drawCountOffset,
+        .storageBuffer   = m_visibleBuffer,
+        .storageOffset   = 0,
+        .storageSize     = static_cast<GLsizeiptr>((first + instances)
+                                               * sizeof(MeshInstance))});
+    return;
+  }
+
+  const auto firstTexelInstance{
+    static_cast<GLint>(storage.offset / sizeof(MeshInstance))};
+
+  for (std::size_t mesh{0}; mesh < m_meshCount; ++mesh) {
+    const auto meshInstances{cursors[mesh] - firstInstances[mesh]};
+    const auto drawInstances{m_bPerInstance ? 1 : meshInstances};
+
+    for (std::size_t i{0}; i < meshInstances; i += drawInstances) {
+      commands.Record(
+        key,
+        DrawCommand{.program       = m_program,
+                    .vertexArray   = m_vertexArray,
+                    .state         = drawStateDepthTest,
+                    .mode          = GL_TRIANGLES,
+                    .indexType     = GL_UNSIGNED_INT,
+                    .first         = static_cast<GLint>(
+                      m_meshes[mesh].firstIndex),
+                    .count         = m_meshes[mesh].indexCount,
+                    .instanceCount = static_cast<GLsizei>(drawInstances),
+                    .baseVertex    = m_meshes[mesh].baseVertex,
+                    .firstInstanceUniform = m_firstInstanceUniform,
+                    .firstInstance        = firstTexelInstance
+                                     + static_cast<GLint>(
+                                         firstInstances[mesh] + i)});
+    }
+  }
+}
+
+// All batches are culled before any is compacted, which saves a barrier
+// per batch.
+void MeshBatcher::Cull() noexcept
+{
+#if GL_DISPATCH_VERSION >= 43
+  auto bCulled{false};
+
+  for (const auto& batch : m_cullBatches) {
+    bCulled = bCulled || 0 < batch.instances;
+  }
+  if (!bCulled) {
+    return;
+  }
+
+  const GpuScope scope{"culling"};
+
+  // Zero the draw counts and the visible counts.
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_drawBuffer);
+  for (std::size_t batch{0}; batch < maxBatches; ++batch) {
+    if (m_cullBatches[batch].instances) {
+      glClearBufferSubData(
+        GL_SHADER_STORAGE_BUFFER,
+        GL_R32UI,
+        static_cast<GLintptr>(batch * drawBatchStride) + drawCountOffset,
+        commandsOffset,
+        GL_RED_INTEGER,
+        GL_UNSIGNED_INT,
+        nullptr);
+    }
+  }
+
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_visibleBuffer);
+
+  glActiveTexture(GL_TEXTURE0 + HiZPyramid::textureUnit);
+  glBindTexture(GL_TEXTURE_2D, m_hiZ.Texture());
+  glActiveTexture(GL_TEXTURE0);
+
+  // The compaction pass reads the frame block, the draws and their
+  // counts of the batch too.
+  const auto bindBatch{[this](std::size_t batch) noexcept {
+    const auto& cull{m_cullBatches[batch]};
+
+    glBindBufferRange(GL_UNIFORM_BUFFER,
+                      frameBinding,
+                      cull.stream,
+                      cull.frameOffset,
+                      sizeof(FrameUniforms));
+    glBindBufferRange(
+      GL_SHADER_STORAGE_BUFFER,
+      0,
+      cull.stream,
+      cull.instanceOffset,
+      static_cast<GLsizeiptr>(cull.instances * sizeof(MeshInstance)));
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER,
+                      1,
+                      cull.stream,
+                      cull.drawOffset,
+                      static_cast<GLsizeiptr>(cull.draws * sizeof(CullDraw)));
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER,
+                      3,
+                      m_drawBuffer,
+                      static_cast<GLintptr>(batch * drawBatchStride),
+                      drawBatchStride);
+  }};
+
+  glUseProgram(m_cullProgram);
+  for (std::size_t batch{0}; batch < maxBatches; ++batch) {
+    if (const auto instances{m_cullBatches[batch].instances}) {
+      bindBatch(batch);
+      glDispatchCompute(static_cast<GLuint>((instances + 63) / 64), 1, 1);
+    }
+  }
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+  glUseProgram(m_compactProgram);
+  for (std::size_t batch{0}; batch < maxBatches; ++batch) {
+    if (m_cullBatches[batch].instances) {
+      bindBatch(batch);
+      glDispatchCompute(1, 1, 1);
+    }
+  }
+  glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+  std::fill(std::begin(m_cullBatches), std::end(m_cullBatches), CullBatch{});
+#endif
+}
+
+void MeshBatcher::CaptureDepth(GLsizei width, GLsizei height) noexcept
+{
+  if (!m_bMultiDraw) {
+    return;
+  }
+
+  m_hiZ.Capture(width, height);
+  std::memcpy(m_hiZViewProjection,
+              m_viewProjection,
+              sizeof m_hiZViewProjection);
+}
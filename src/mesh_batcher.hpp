@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "command_buffer.hpp"
+#include "gl.hpp"
+#include "hi_z_pyramid.hpp"
+#include "loader.hpp"
+#include "shader.hpp"
+#include "stream_buffer.hpp"
+
+struct MeshVertex {
+  GLfloat x;
+  GLfloat y;
+};
+
+// World position and uniform scale, then the colour.
+struct MeshInstance {
+  GLfloat x;
+  GLfloat y;
+  GLfloat z;
+  GLfloat scale;
+  GLfloat color[4];
+};
+
+// How instances are drawn, from the fewest calls to the most. Multi-draw
+// needs OpenGL 4.3 and falls back to instanced draws. A draw per instance
+// is there to measure the others against.
+enum class MeshDrawPath : std::uint8_t { multiDraw, instanced, perInstance };
+
+// Draws many instances of a few meshes with a handful of calls. All meshes
+// share one vertex and one index buffer and the instances of a frame are
+// grouped by mesh in the stream buffer. With OpenGL 4.3 a frame is a
+// single glMultiDrawElementsIndirect reading the instances from a shader
+// storage buffer, older contexts draw every mesh instanced, reading them
+// from a buffer texture.
+//
+// The multi-draw path also culls on the GPU: a compute pass tests the
+// bounding sphere of every instance against the view frustum and against
+// a hierarchical depth buffer of the previous frame, then compacts the
+// visible instances and the non-empty draws. The CPU never learns which
+// instances are visible. Without compute shaders the CPU culls against
+// the frustum alone, on bounding spheres kept in structure-of-arrays
+// layout, and only the visible instances are streamed.
+//
+// A frame is queued and submitted in batches, disjoint ranges of the
+// queue that different threads may fill and submit in parallel, each into
+// its own command list. Every batch is culled and drawn on its own.
+//
+// Programs build in the background and the buffer of instance ids is
+// written on the loader if it runs. Until the culling programs are linked
+// every instance is drawn. Until the drawing program is linked, which it
+// is at Init if the program cache had it, a fallback built there draws
+// them in a flat colour. Until the ids are there they are dropped.
+class MeshBatcher {
+public:
+  static constexpr std::size_t maxMeshes{64};
+  static constexpr std::size_t maxBatches{16};
+
+  MeshBatcher() noexcept = default;
+  MeshBatcher(const MeshBatcher&) = delete;
+  MeshBatcher& operator=(const MeshBatcher&) = delete;
+
+  // Instances are streamed through the given buffer, which must outlive
+  // the batcher.
+  bool Init(const StreamBuffer& stream,
+            std::size_t         maxVertices,
+            std::size_t         maxIndices,
+            std::size_t         maxInstances,
+            MeshDrawPath        path = MeshDrawPath::multiDraw) noexcept;
+  // Deletes the GL objects, needs the context to be current.
+  void Release() noexcept;
+
+  // Copies a mesh into the shared buffers, at load time. Returns its
+  // index, -1 if the buffers are full.
+  int AddMesh(const MeshVertex*    pVertices,
+              std::size_t          vertexCount,
+              const std::uint32_t* pIndices,
+              std::size_t          indexCount) noexcept;
+
+  // Column-major view-projection matrix of the coming frame, with the
+  // usual OpenGL clip space.
+  void SetCamera(const GLfloat (&viewProjection)[16]) noexcept;
+
+  // Sets up the programs and buffers that finished loading, on the
+  // rendering thread before the frame is queued.
+  void BeginFrame() noexcept;
+
+  // Queues an instance at the given index of this frame, below the
+  // maximum given to Init. An invalid mesh leaves the index empty.
+  bool Add(std::size_t index, int mesh, const MeshInstance& instance) noexcept;
+
+  // Writes the instances queued at [first, first + count) into the stream
+  // buffer and records their draws as the given batch. Every index of the
+  // range must have been queued this frame. Batches may be submitted from
+  // different threads in parallel, between StreamBuffer::BeginFrame and
+  // Commit.
+  void Submit(StreamBuffer& stream,
+              CommandList&  commands,
+              std::uint64_t key,
+              std::size_t   batch,
+              std::size_t   first,
+              std::size_t   count) noexcept;
+  // Runs the culling pass of the submitted batches, after
+  // StreamBuffer::Commit and before the draws are executed.
+  void Cull() noexcept;
+  // Keeps the depth of the executed frame for culling the next one.
+  void CaptureDepth(GLsizei width, GLsizei height) noexcept;
+
+  // The fallback while the program builds, zero if that failed too.
+  GLuint Program() const noexcept
+  {
+    return m_program;
+  }
+
+private:
+  struct Mesh {
+    GLuint  firstIndex;
+    GLsizei indexCount;
+    GLint   baseVertex;
+    GLfloat radius; // Of the bounding sphere around the origin.
+  };
+
+  struct QueuedInstance {
+    std::uint32_t mesh; // maxMeshes if the index is empty.
+    MeshInstance  instance;
+  };
+
+  // A batch's culling input in the stream buffer.
+  struct CullBatch {
+    GLuint      stream;
+    GLintptr    frameOffset;
+    GLintptr    instanceOffset;
+    GLintptr    drawOffset;
+    std::size_t instances;
+    std::size_t draws;
+  };
+
+  void AttachInstanceIds() noexcept;
+  void UseDrawProgram(GLuint program) noexcept;
+
+  bool                              m_bMultiDraw{false};
+  bool                              m_bDrawCount{false};
+  bool                              m_bPerInstance{false};
+  GLuint                            m_program{0};
+  GLuint                            m_fallbackProgram{0};
+  GLuint                            m_cullProgram{0};
+  GLuint                            m_compactProgram{0};
+  GLint                             m_firstInstanceUniform{-1};
+  GLuint                            m_vertexArray{0};
+  GLuint                            m_vertexBuffer{0};
+  GLuint                            m_indexBuffer{0};
+  GLuint                            m_instanceIds{0};
+  GLuint                            m_instanceTexture{0};
+  GLuint                            m_visibleBuffer{0};
+  GLuint                            m_drawBuffer{0};
+  std::size_t                       m_maxVertices{0};
+  std::size_t                       m_maxIndices{0};
+  std::size_t                       m_vertexCount{0};
+  std::size_t                       m_indexCount{0};
+  Mesh                              m_meshes[maxMeshes]{};
+  std::size_t                       m_meshCount{0};
+  std::unique_ptr<QueuedInstance[]> m_queue;
+  std::size_t                       m_maxInstances{0};
+  HiZPyramid                        m_hiZ;
+  GLfloat                           m_viewProjection[16]{};
+  GLfloat                           m_hiZViewProjection[16]{}; // Pyramid's.
+
+  // Bounding spheres of the queue for culling on the CPU: all x, then all
+  // y, z and radii.
+  std::unique_ptr<GLfloat[]> m_bounds;
+
+  LoadTicket m_instanceIdsLoad;
+
+  // Owned by the shader library.
+  AsyncProgram* m_pDrawBuild{nullptr};
+  AsyncProgram* m_pCullBuild{nullptr};
+  AsyncProgram* m_pCompactBuild{nullptr};
+
+  // Of this frame, no instances if the batch is not culled.
+  CullBatch m_cullBatches[maxBatches]{};
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Fixed number of objects of one type for long-lived renderer objects, so
+// creating and destroying them never touches the heap. Free slots form an
+// intrusive list. Objects keep their slot index for their lifetime, so
+// that they can be named by index, e.g. across threads. Not thread-safe.
+template<typename T, std::size_t Capacity>
+class ObjectPool {
+public:
+  ObjectPool() noexcept = default;
+  ObjectPool(const ObjectPool&) = delete;
+  ObjectPool& operator=(const ObjectPool&) = delete;
+  ~ObjectPool()
+  {
+    for (std::size_t i{0}; i < m_untouched; ++i) {
+      Destroy(Get(i));
+    }
+  }
+
+  // Null if the pool is full.
+  template<typename... Args>
+  T* Create(Args&&... args) noexcept
+  {
+    static_assert(std::is_nothrow_constructible_v<T, Args...>);
+
+    Slot* pSlot{nullptr};
+    if (m_pFree) {
+      pSlot   = m_pFree;
+      m_pFree = m_pFree->pNext;
+    }
+    else if (m_untouched < Capacity) {
+      pSlot = &m_slots[m_untouched++];
+    }
+    else {
+      return nullptr;
+    }
+
+    ++m_count;
+    m_bLive[pSlot - m_slots] = true;
+
+    return new (pSlot->storage) T(std::forward<Args>(args)...);
+  }
+
+  void Destroy(T* pObject) noexcept
+  {
+    if (!pObject) {
+      return;
+    }
+
+    pObject->~T();
+
+    const auto pSlot{reinterpret_cast<Slot*>(pObject)};
+    m_bLive[pSlot - m_slots] = false;
+    pSlot->pNext             = m_pFree;
+    m_pFree                  = pSlot;
+    --m_count;
+  }
+
+  // The object in the slot, null if the slot is free or out of range.
+  T* Get(std::size_t index) noexcept
+  {
+    if (Capacity <= index || !m_bLive[index]) {
+      return nullptr;
+    }
+
+    return std::launder(reinterpret_cast<T*>(m_slots[index].storage));
+  }
+  std::size_t IndexOf(const T* pObject) const noexcept
+  {
+    return static_cast<std::size_t>(
+      reinterpret_cast<const Slot*>(pObject) - m_slots);
+  }
+
+  std::size_t Count() const noexcept
+  {
+    return m_count;
+  }
+
+private:
+  union Slot {
+    Slot*                pNext;
+    alignas(T) std::byte storage[sizeof(T)];
+  };
+
+  Slot        m_slots[Capacity];
+  bool        m_bLive[Capacity]{};
+  Slot*       m_pFree{nullptr};
+  std::size_t m_untouched{0}; // Slots never handed out yet.
+  std::size_t m_count{0};
+};
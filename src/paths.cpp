@@ -0,0 +1,90 @@
+#include "paths.hpp"
+
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <string>
+#include <system_error>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
+
+std::filesystem::path GetCacheDirectory() noexcept
+{
+  std::filesystem::path directory;
+  std::error_code       ec;
+
+  if (const auto cacheDir{std::getenv("POLYCHROME_CACHE_DIR")}) {
+    directory = cacheDir;
+  }
+#ifdef _WIN32
+  else if (const auto localAppData{std::getenv("LOCALAPPDATA")}) {
+    directory = std::filesystem::path{localAppData} / "Polychrome";
+  }
+#else
+  else if (const auto xdgCacheHome{std::getenv("XDG_CACHE_HOME")}) {
+    directory = std::filesystem::path{xdgCacheHome} / "polychrome";
+  }
+  else if (const auto home{std::getenv("HOME")}) {
+    directory = std::filesystem::path{home} / ".cache" / "polychrome";
+  }
+#endif
+  else {
+    return {};
+  }
+
+  std::filesystem::create_directories(directory, ec);
+  if (ec) {
+    return {};
+  }
+
+  return directory;
+}
+
+bool WriteFileAtomically(const std::filesystem::path& path,
+                         const void*                  data,
+                         std::size_t                  size) noexcept
+{
+#ifdef _WIN32
+  const auto pid{static_cast<unsigned long>(GetCurrentProcessId())};
+#else
+  const auto pid{static_cast<unsigned long>(getpid())};
+#endif
+  std::error_code ec;
+
+  // Copying the path and building the name allocate.
+  try {
+    auto tempPath{path};
+
+    // One piece at a time, GCC 12 warns about overlapping copies in the
+    // inlined concatenation of temporaries otherwise.
+    tempPath += ".";
+    tempPath += std::to_string(pid);
+    tempPath += ".tmp";
+
+    std::ofstream file{tempPath, std::ios::binary | std::ios::trunc};
+
+    file.write(static_cast<const char*>(data),
+               static_cast<std::streamsize>(size));
+    file.close();
+    if (!file) {
+      std::filesystem::remove(tempPath, ec);
+      return false;
+    }
+
+    std::filesystem::rename(tempPath, path, ec);
+    if (ec) {
+      std::filesystem::remove(tempPath, ec);
+      return false;
+    }
+  }
+  catch (const std::exception&) {
+    return false;
+  }
+
+  return true;
+}
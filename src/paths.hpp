@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+
+// Directory for caches that persist across launches, created on demand:
+// %LOCALAPPDATA%\Polychrome on Windows and $XDG_CACHE_HOME/polychrome or
+// ~/.cache/polychrome elsewhere. POLYCHROME_CACHE_DIR overrides both. Empty
+// if there is none.
+std::filesystem::path GetCacheDirectory() noexcept;
+
+// Replaces the file through a temporary file and a rename, so concurrent
+// readers, including other processes, never see a partially written file.
+bool WriteFileAtomically(const std::filesystem::path& path,
+                         const void*                  data,
+                         std::size_t                  size) noexcept;
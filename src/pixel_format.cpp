@@ -0,0 +1,124 @@
+#include "pixel_format.hpp"
+#include "paths.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+static constexpr char magic[]{"polychrome-pixel-format-cache 1"};
+
+long ScorePixelFormat(const PixelFormatTraits& candidate,
+                      const PixelFormatTraits& required) noexcept
+{
+  if (candidate.colorBits < required.colorBits
+      || candidate.alphaBits < required.alphaBits
+      || candidate.accumBits < required.accumBits
+      || candidate.depthBits < required.depthBits
+      || candidate.stencilBits < required.stencilBits
+      || candidate.auxBuffers < required.auxBuffers
+      || candidate.samples < required.samples) {
+    return -1;
+  }
+
+  const long samples{std::max(candidate.samples, 1)};
+  const long colorBits{candidate.colorBits + candidate.alphaBits};
+
+  // Every sample of the color, depth and stencil buffers, all auxiliary
+  // buffers and the accumulation buffer cost memory bandwidth each frame.
+  return (colorBits * (1 + candidate.auxBuffers) + candidate.depthBits
+          + candidate.stencilBits)
+           * samples
+         + candidate.accumBits;
+}
+
+static bool ParseEntry(const std::string& line,
+                       const char*        display,
+                       int*               pFormat,
+                       PixelFormatTraits* pTraits) noexcept
+{
+  const auto tab{line.find('\t')};
+
+  if (std::string::npos == tab || 0 != line.compare(0, tab, display)) {
+    return false;
+  }
+
+  return 8
+         == std::sscanf(line.c_str() + tab + 1,
+                        "%d %d %d %d %d %d %d %d",
+                        pFormat,
+                        &pTraits->colorBits,
+                        &pTraits->alphaBits,
+                        &pTraits->accumBits,
+                        &pTraits->depthBits,
+                        &pTraits->stencilBits,
+                        &pTraits->auxBuffers,
+                        &pTraits->samples);
+}
+
+bool LoadPixelFormatCache(const char*        name,
+                          const char*        display,
+                          int*               pFormat,
+                          PixelFormatTraits* pTraits) noexcept
+{
+  const auto directory{GetCacheDirectory()};
+
+  if (directory.empty()) {
+    return false;
+  }
+
+  std::ifstream file{directory / name};
+  std::string   line;
+
+  if (!std::getline(file, line) || line != magic) {
+    return false;
+  }
+
+  while (std::getline(file, line)) {
+    if (ParseEntry(line, display, pFormat, pTraits)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool StorePixelFormatCache(const char*              name,
+                           const char*              display,
+                           int                      format,
+                           const PixelFormatTraits& traits) noexcept
+{
+  const auto         directory{GetCacheDirectory()};
+  std::ostringstream contents;
+  std::string        line;
+  int                otherFormat{0};
+  PixelFormatTraits  otherTraits;
+
+  if (directory.empty()) {
+    return false;
+  }
+
+  contents << magic << '\n'
+           << display << '\t' << format << ' ' << traits.colorBits << ' '
+           << traits.alphaBits << ' ' << traits.accumBits << ' '
+           << traits.depthBits << ' ' << traits.stencilBits << ' '
+           << traits.auxBuffers << ' ' << traits.samples << '\n';
+
+  // Keep the entries of all other displays.
+  std::ifstream file{directory / name};
+
+  if (std::getline(file, line) && line == magic) {
+    while (std::getline(file, line)) {
+      if (!ParseEntry(line, display, &otherFormat, &otherTraits)
+          && std::string::npos != line.find('\t')) {
+        contents << line << '\n';
+      }
+    }
+  }
+  file.close();
+
+  const auto text{contents.str()};
+
+  return WriteFileAtomically(directory / name, text.data(), text.size());
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+// Buffer sizes of a pixel format or EGL configuration. Color bits exclude
+// alpha, samples is zero for single-sampled formats.
+struct PixelFormatTraits {
+  int colorBits{0};
+  int alphaBits{0};
+  int accumBits{0};
+  int depthBits{0};
+  int stencilBits{0};
+  int auxBuffers{0};
+  int samples{0};
+
+  bool operator==(const PixelFormatTraits&) const = default;
+};
+
+// Estimates the bits a frame touches per pixel in the candidate's buffers,
+// so lower is cheaper. Negative if the candidate lacks a required buffer.
+long ScorePixelFormat(const PixelFormatTraits& candidate,
+                      const PixelFormatTraits& required) noexcept;
+
+// Chosen pixel format per display, e.g. the monitor and adapter a window is
+// on, persisted in the cache directory.
+bool LoadPixelFormatCache(const char*        name,
+                          const char*        display,
+                          int*               pFormat,
+                          PixelFormatTraits* pTraits) noexcept;
+bool StorePixelFormatCache(const char*              name,
+                           const char*              display,
+                           int                      format,
+                           const PixelFormatTraits& traits) noexcept;
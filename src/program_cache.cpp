@@ -0,0 +1,507 @@
+#include "program_cache.hpp"
+#include "log.hpp"
+#include "paths.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+ProgramCache programCache;
+
+// Bumped whenever the layout of the pack changes.
+constexpr std::uint32_t packVersion{2};
+constexpr char          packMagic[8]{"PCPROGS"};
+
+constexpr std::uint64_t fnvOffsetBasis{0xcbf29ce484222325};
+
+// The pack starts with the header, followed by the entries sorted by key
+// and then the binaries.
+struct PackHeader {
+  char          magic[8];
+  std::uint32_t version;
+  std::uint32_t entryCount;
+  std::uint64_t driver;   // Hash of the driver strings.
+  std::uint64_t checksum; // Of the entries.
+};
+
+struct ProgramPackEntry {
+  std::uint64_t key;
+  std::uint64_t offset; // Of the binary, from the start of the pack.
+  std::uint64_t checksum;
+  std::uint32_t size;
+  std::uint32_t format;
+  std::uint32_t unusedRewrites; // In a row, since it was last loaded.
+  std::uint32_t reserved;
+};
+
+static_assert(sizeof(PackHeader) == 32);
+static_assert(sizeof(ProgramPackEntry) == 40);
+
+// 64-bit FNV-1a, continuing from the given hash.
+static std::uint64_t Fnv1a(const void*   pData,
+                           std::size_t   size,
+                           std::uint64_t hash = fnvOffsetBasis) noexcept
+{
+  const auto pBytes{static_cast<const unsigned char*>(pData)};
+
+  for (std::size_t i{0}; i < size; ++i) {
+    hash ^= pBytes[i];
+    hash *= 0x100000001b3;
+  }
+
+  return hash;
+}
+
+static std::uint64_t HashDriver() noexcept
+{
+  auto hash{fnvOffsetBasis};
+
+  for (const GLenum name :
+       {GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION}) {
+    if (const auto pString{
+          reinterpret_cast<const char*>(glGetString(name))}) {
+      // The terminator keeps the strings apart.
+      hash = Fnv1a(pString, std::strlen(pString) + 1, hash);
+    }
+  }
+
+  return hash;
+}
+
+// Read-only and private, null if the file is missing or empty.
+static const std::byte* MapFile(const std::filesystem::path& path,
+                                std::size_t*                 pSize) noexcept
+{
+  const void* pView{nullptr};
+
+  *pSize = 0;
+
+#ifdef _WIN32
+  LARGE_INTEGER size{};
+  HANDLE        hMapping{NULL};
+
+  // Sharing deletion lets another process replace the pack meanwhile.
+  const auto hFile{CreateFileW(path.c_str(),
+                               GENERIC_READ,
+                               FILE_SHARE_READ | FILE_SHARE_DELETE,
+                               NULL,
+                               OPEN_EXISTING,
+                               FILE_ATTRIBUTE_NORMAL,
+                               NULL)};
+  if (INVALID_HANDLE_VALUE == hFile) {
+    return nullptr;
+  }
+
+  if (GetFileSizeEx(hFile, &size) && 0 < size.QuadPart) {
+    hMapping = CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+  }
+  if (hMapping) {
+    pView = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(hMapping);
+  }
+  CloseHandle(hFile);
+
+  if (pView) {
+    *pSize = static_cast<std::size_t>(size.QuadPart);
+  }
+#else
+  struct stat status{};
+
+  const auto fd{open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  if (0 == fstat(fd, &status) && 0 < status.st_size) {
+    const auto size{static_cast<std::size_t>(status.st_size)};
+    const auto p{mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0)};
+
+    if (MAP_FAILED != p) {
+      pView  = p;
+      *pSize = size;
+    }
+  }
+  close(fd);
+#endif
+
+  return static_cast<const std::byte*>(pView);
+}
+
+static void UnmapFile(const std::byte* pView, std::size_t size) noexcept
+{
+  if (!pView) {
+    return;
+  }
+
+#ifdef _WIN32
+  static_cast<void>(size);
+  UnmapViewOfFile(pView);
+#else
+  munmap(const_cast<std::byte*>(pView), size);
+#endif
+}
+
+void ProgramKey::AddShader(GLenum             type,
+                           const char* const* sources,
+                           GLsizei            count) noexcept
+{
+  std::uint64_t length{0};
+
+  Add(&type, sizeof type);
+  for (GLsizei i{0}; i < count; ++i) {
+    const auto size{std::strlen(sources[i])};
+
+    Add(sources[i], size);
+    length += size;
+  }
+  // Where this stage's sources end.
+  Add(&length, sizeof length);
+}
+
+void ProgramKey::Add(const void* pData, std::size_t size) noexcept
+{
+  m_hash = Fnv1a(pData, size, m_hash);
+}
+
+bool ProgramCache::Open(const char* name) noexcept
+{
+  PackHeader  header{};
+  const char* pProblem{nullptr};
+  GLint       formats{0};
+
+  Close();
+
+  if (GL_DISPATCH_VERSION >= 41 && glVersion >= 41) {
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  }
+  if (formats <= 0) {
+    Log("program cache: disabled, needs OpenGL 4.1 and a binary format");
+    return false;
+  }
+
+  const auto directory{GetCacheDirectory()};
+  if (directory.empty()) {
+    Log("program cache: disabled, there is no cache directory");
+    return false;
+  }
+
+  m_bEnabled = true;
+  m_path     = directory / name;
+  m_driver   = HashDriver();
+  m_pPack    = MapFile(m_path, &m_packSize);
+  if (!m_pPack) {
+    Log("program cache: empty");
+    return true;
+  }
+
+  // Everything read from the pack is checked before it is trusted, the
+  // binaries themselves when they are loaded.
+  if (m_packSize >= sizeof header) {
+    std::memcpy(&header, m_pPack, sizeof header);
+  }
+
+  const auto pEntries{
+    reinterpret_cast<const ProgramPackEntry*>(m_pPack + sizeof header)};
+  const auto entriesSize{std::size_t{header.entryCount} * sizeof *pEntries};
+
+  if (m_packSize < sizeof header
+      || 0 != std::memcmp(header.magic, packMagic, sizeof packMagic)
+      || packVersion != header.version) {
+    pProblem = "is not a pack of this version";
+  }
+  else if (m_driver != header.driver) {
+    pProblem = "was written by another driver";
+  }
+  else if (m_packSize - sizeof header < entriesSize
+           || header.checksum != Fnv1a(pEntries, entriesSize)
+           || std::adjacent_find(pEntries,
+                                 pEntries + header.entryCount,
+                                 [](const auto& a, const auto& b) {
+                                   return a.key >= b.key;
+                                 })
+                != pEntries + header.entryCount) {
+    pProblem = "is corrupt";
+  }
+
+  if (pProblem) {
+    Log("program cache: %s %s, starting over",
+        m_path.string().c_str(),
+        pProblem);
+    UnmapFile(m_pPack, m_packSize);
+    m_pPack    = nullptr;
+    m_packSize = 0;
+    m_bDirty   = true;
+    return true;
+  }
+
+  m_pEntries   = pEntries;
+  m_entryCount = header.entryCount;
+  m_states.assign(m_entryCount, EntryState::unused);
+
+  Log("program cache: %u program(s) in %s",
+      m_entryCount,
+      m_path.string().c_str());
+
+  return true;
+}
+
+// Rewrites the pack from the entries that are still valid and the new
+// ones. The old pack is unmapped first, Windows cannot replace a mapped
+// file.
+void ProgramCache::Close() noexcept
+{
+  if (!m_bEnabled) {
+    return;
+  }
+
+  std::vector<std::byte> pack;
+
+  if (m_bDirty) {
+    std::vector<ProgramPackEntry> entries;
+    std::vector<const std::byte*> binaries;
+    PackHeader                    header{};
+    std::size_t                   offset{0};
+
+    // A new binary replaces an old one of the same key, e.g. one that
+    // failed to load, keys must stay unique.
+    for (const auto& entry : m_newEntries) {
+      const auto pEnd{m_pEntries + m_entryCount};
+      const auto pEntry{std::lower_bound(
+        m_pEntries,
+        pEnd,
+        entry.key,
+        [](const ProgramPackEntry& packEntry, std::uint64_t value) {
+          return packEntry.key < value;
+        })};
+
+      if (pEnd != pEntry && entry.key == pEntry->key) {
+        m_states[static_cast<std::size_t>(pEntry - m_pEntries)] =
+          EntryState::dropped;
+      }
+    }
+
+    // Unloaded binaries are only checked for lying within the pack, the
+    // launch that loads them checks them in full.
+    for (std::uint32_t i{0}; i < m_entryCount; ++i) {
+      auto entry{m_pEntries[i]};
+
+      if (EntryState::used == m_states[i]) {
+        entry.unusedRewrites = 0;
+      }
+      else if (EntryState::dropped == m_states[i]
+               || maxUnusedRewrites <= entry.unusedRewrites
+               || entry.offset > m_packSize
+               || m_packSize - entry.offset < entry.size) {
+        continue;
+      }
+      else {
+        ++entry.unusedRewrites;
+      }
+
+      entries.push_back(entry);
+      binaries.push_back(m_pPack + m_pEntries[i].offset);
+    }
+    for (const auto& entry : m_newEntries) {
+      entries.push_back({entry.key,
+                         0,
+                         Fnv1a(entry.binary.data(), entry.binary.size()),
+                         static_cast<std::uint32_t>(entry.binary.size()),
+                         entry.format,
+                         0,
+                         0});
+      binaries.push_back(entry.binary.data());
+    }
+
+    offset = sizeof header + entries.size() * sizeof(ProgramPackEntry);
+    for (auto& entry : entries) {
+      entry.offset  = offset;
+      offset       += entry.size;
+    }
+
+    // Sorting the indices keeps every binary next to its entry.
+    std::vector<std::size_t> order(entries.size());
+    for (std::size_t i{0}; i < order.size(); ++i) {
+      order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+      return entries[a].key < entries[b].key;
+    });
+
+    pack.resize(offset);
+    for (std::size_t i{0}; i < order.size(); ++i) {
+      const auto& entry{entries[order[i]]};
+
+      std::memcpy(pack.data() + sizeof header + i * sizeof entry,
+                  &entry,
+                  sizeof entry);
+      std::memcpy(pack.data() + entry.offset,
+                  binaries[order[i]],
+                  entry.size);
+    }
+
+    std::memcpy(header.magic, packMagic, sizeof packMagic);
+    header.version    = packVersion;
+    header.entryCount = static_cast<std::uint32_t>(entries.size());
+    header.driver     = m_driver;
+    header.checksum   = Fnv1a(pack.data() + sizeof header,
+                            entries.size() * sizeof(ProgramPackEntry));
+    std::memcpy(pack.data(), &header, sizeof header);
+  }
+
+  UnmapFile(m_pPack, m_packSize);
+
+  if (m_bDirty && !WriteFileAtomically(m_path, pack.data(), pack.size())) {
+    Log("program cache: failed to write %s", m_path.string().c_str());
+  }
+
+  Log("program cache: %u hit(s) loaded in %.1f ms, %u miss(es) compiled in "
+      "%.1f ms, %u binary(ies) rejected",
+      m_hits,
+      m_loadNs / 1e6,
+      m_misses,
+      m_compileNs / 1e6,
+      m_rejected);
+
+  m_bEnabled   = false;
+  m_bDirty     = false;
+  m_pPack      = nullptr;
+  m_packSize   = 0;
+  m_pEntries   = nullptr;
+  m_entryCount = 0;
+  m_hits       = 0;
+  m_misses     = 0;
+  m_rejected   = 0;
+  m_loadNs     = 0;
+  m_compileNs  = 0;
+  m_states.clear();
+  m_newEntries.clear();
+}
+
+GLuint ProgramCache::Load(std::uint64_t key) noexcept
+{
+  if (!m_bEnabled) {
+    return 0;
+  }
+
+#if GL_DISPATCH_VERSION >= 41
+  GLint bLinked{GL_FALSE};
+
+  const auto start{std::chrono::steady_clock::now()};
+  const auto pEnd{m_pEntries + m_entryCount};
+  const auto pEntry{std::lower_bound(
+    m_pEntries,
+    pEnd,
+    key,
+    [](const ProgramPackEntry& entry, std::uint64_t value) {
+      return entry.key < value;
+    })};
+
+  if (pEnd == pEntry || key != pEntry->key) {
+    ++m_misses;
+    return 0;
+  }
+
+  const auto index{static_cast<std::size_t>(pEntry - m_pEntries)};
+  const auto pBinary{m_pPack + pEntry->offset};
+
+  // A rejected binary is compiled again and replaced when the pack is
+  // written.
+  if (pEntry->offset > m_packSize || m_packSize - pEntry->offset < pEntry->size
+      || pEntry->checksum != Fnv1a(pBinary, pEntry->size)) {
+    Log("program cache: binary %016llx is corrupt",
+        static_cast<unsigned long long>(key));
+    m_states[index] = EntryState::dropped;
+    ++m_rejected;
+    ++m_misses;
+    m_bDirty = true;
+    return 0;
+  }
+
+  auto program{glCreateProgram()};
+  if (!program) {
+    return 0;
+  }
+
+  glProgramBinary(program,
+                  pEntry->format,
+                  pBinary,
+                  static_cast<GLsizei>(pEntry->size));
+  glGetProgramiv(program, GL_LINK_STATUS, &bLinked);
+  if (!bLinked) {
+    glDeleteProgram(program);
+    m_states[index] = EntryState::dropped;
+    ++m_rejected;
+    ++m_misses;
+    m_bDirty = true;
+    return 0;
+  }
+
+  const auto loaded{std::chrono::steady_clock::now()};
+
+  m_states[index]  = EntryState::used;
+  m_loadNs        += std::chrono::nanoseconds{loaded - start}.count();
+  ++m_hits;
+
+  return program;
+#else
+  static_cast<void>(key);
+  return 0;
+#endif
+}
+
+void ProgramCache::Store(std::uint64_t key,
+                         GLuint        program,
+                         std::int64_t  compileNs) noexcept
+{
+  if (!m_bEnabled) {
+    return;
+  }
+
+#if GL_DISPATCH_VERSION >= 41
+  GLint  length{0};
+  GLenum format{0};
+
+  m_compileNs += compileNs;
+
+  // Programs created twice in a launch are stored once.
+  if (std::any_of(m_newEntries.begin(),
+                  m_newEntries.end(),
+                  [key](const NewEntry& entry) { return key == entry.key; })) {
+    return;
+  }
+
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return;
+  }
+
+  NewEntry entry{
+    key, 0, std::vector<std::byte>(static_cast<std::size_t>(length))};
+
+  glGetProgramBinary(program, length, &length, &format, entry.binary.data());
+  if (length <= 0) {
+    return;
+  }
+
+  entry.format = format;
+  entry.binary.resize(static_cast<std::size_t>(length));
+  m_newEntries.push_back(std::move(entry));
+  m_bDirty = true;
+#else
+  static_cast<void>(key);
+  static_cast<void>(program);
+  static_cast<void>(compileNs);
+#endif
+}
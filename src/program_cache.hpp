@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "gl.hpp"
+
+struct ProgramPackEntry;
+
+// Identifies a program by the types and sources of its shaders. Defines
+// are source parts, so they are covered as well.
+class ProgramKey {
+public:
+  void AddShader(GLenum             type,
+                 const char* const* sources,
+                 GLsizei            count) noexcept;
+
+  std::uint64_t Value() const noexcept
+  {
+    return m_hash;
+  }
+
+private:
+  void Add(const void* pData, std::size_t size) noexcept;
+
+  std::uint64_t m_hash{0xcbf29ce484222325}; // 64-bit FNV-1a.
+};
+
+// Linked program binaries from glGetProgramBinary, kept across launches in
+// one pack file in the cache directory that is memory mapped while the
+// cache is open. The pack belongs to the driver that wrote it: a
+// different vendor, renderer or version string discards it, and binaries
+// that fail their checksum or that the driver rejects are dropped. New
+// binaries are written back on Close together with the valid ones, also
+// those this launch did not load, e.g. of another renderer configuration.
+// A binary that several rewrites in a row did not load falls out of the
+// pack, which is how programs whose sources changed leave it.
+class ProgramCache {
+public:
+  // Rewrites a binary may go without being loaded before it is dropped.
+  static constexpr std::uint32_t maxUnusedRewrites{8};
+
+  ProgramCache() noexcept = default;
+  ProgramCache(const ProgramCache&) = delete;
+  ProgramCache& operator=(const ProgramCache&) = delete;
+  ~ProgramCache()
+  {
+    Close();
+  }
+
+  // Needs a current OpenGL 4.1 context that supports a binary format,
+  // otherwise the cache stays disabled.
+  bool Open(const char* name) noexcept;
+  // Writes the pack if it changed, logs the statistics and unmaps it.
+  void Close() noexcept;
+
+  bool Enabled() const noexcept
+  {
+    return m_bEnabled;
+  }
+
+  // A program linked from the cached binary, zero on a miss.
+  GLuint Load(std::uint64_t key) noexcept;
+  // Keeps the binary of a program linked after a miss, which took
+  // compileNs to compile and link.
+  void Store(std::uint64_t key,
+             GLuint        program,
+             std::int64_t  compileNs) noexcept;
+
+private:
+  enum class EntryState : std::uint8_t { unused, used, dropped };
+
+  struct NewEntry {
+    std::uint64_t          key;
+    GLenum                 format;
+    std::vector<std::byte> binary;
+  };
+
+  bool                    m_bEnabled{false};
+  bool                    m_bDirty{false};
+  std::filesystem::path   m_path;
+  std::uint64_t           m_driver{0};
+  const std::byte*        m_pPack{nullptr};
+  std::size_t             m_packSize{0};
+  const ProgramPackEntry* m_pEntries{nullptr};
+  std::uint32_t           m_entryCount{0};
+  std::vector<EntryState> m_states; // Per pack entry.
+  std::vector<NewEntry>   m_newEntries;
+  std::uint32_t           m_hits{0};
+  std::uint32_t           m_misses{0};
+  std::uint32_t           m_rejected{0};
+  std::int64_t            m_loadNs{0};
+  std::int64_t            m_compileNs{0};
+};
+
+extern ProgramCache programCache;
@@ -0,0 +1,233 @@
+#include "renderer.hpp"
+#include "command_buffer.hpp"
+#include "gl.hpp"
+#include "gpu_profiler.hpp"
+#include "job_system.hpp"
+#include "log.hpp"
+#include "mesh_batcher.hpp"
+#include "program_cache.hpp"
+#include "shader.hpp"
+#include "shader_library.hpp"
+#include "stream_buffer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+
+// Per frame, enough for the dynamic geometry and uniforms of a frame.
+constexpr std::size_t streamBytesPerFrame{std::size_t{1} << 22};
+constexpr int         streamRegions{3};
+// Half the side of the square the objects are spread over, the screen
+// being two high.
+constexpr float worldSize{4.0f};
+
+static CommandBuffer commandBuffer;
+static StreamBuffer  streamBuffer;
+static MeshBatcher   batcher;
+static int           meshes[3]{-1, -1, -1};
+static std::size_t   objectCount{0};
+static std::uint32_t frameIndex{0};
+static GLsizei       viewportWidth{0};
+static GLsizei       viewportHeight{0};
+
+// Appends a regular polygon around the origin as a triangle fan.
+static int AddPolygon(int sides) noexcept
+{
+  MeshVertex    vertices[8]{};
+  std::uint32_t indices[3 * 6]{};
+
+  for (auto i{0}; i < sides; ++i) {
+    const auto angle{6.2831853f * static_cast<float>(i)
+                     / static_cast<float>(sides)};
+
+    vertices[i] = {std::cos(angle), std::sin(angle)};
+  }
+  for (auto i{0}; i < sides - 2; ++i) {
+    indices[3 * i]     = 0;
+    indices[3 * i + 1] = static_cast<std::uint32_t>(i + 1);
+    indices[3 * i + 2] = static_cast<std::uint32_t>(i + 2);
+  }
+
+  return batcher.AddMesh(vertices,
+                         static_cast<std::size_t>(sides),
+                         indices,
+                         static_cast<std::size_t>(3 * (sides - 2)));
+}
+
+bool InitRenderer(std::size_t objects) noexcept
+{
+  commandBuffer.Reset();
+
+  // Before the first program is created. Without it every program is
+  // compiled.
+  programCache.Open("programs.pack");
+  EnableParallelShaderCompile();
+  shaderLibrary.Open("shaders.prewarm");
+
+  if (!streamBuffer.Init(streamBytesPerFrame, streamRegions)) {
+    shaderLibrary.Close();
+    programCache.Close();
+    return false;
+  }
+
+  // Without the batcher frames are only cleared.
+  objectCount = 0;
+  if (objects) {
+    if (batcher.Init(streamBuffer, 1024, 1024, objects)) {
+      meshes[0]   = AddPolygon(3);
+      meshes[1]   = AddPolygon(4);
+      meshes[2]   = AddPolygon(6);
+      objectCount = objects;
+    }
+    else {
+      Log("renderer: the mesh batcher failed, no objects are drawn");
+    }
+  }
+
+  return true;
+}
+
+void ReleaseRenderer() noexcept
+{
+  batcher.Release();
+  streamBuffer.Release();
+  shaderLibrary.Close();
+  programCache.Close();
+}
+
+void ResizeRenderer(int width, int height) noexcept
+{
+  viewportWidth  = width;
+  viewportHeight = height;
+}
+
+// Orthographic camera circling over the world, which is several screens
+// wide so that most objects are off screen.
+static void SetCamera(float time) noexcept
+{
+  const auto halfHeight{1.0f};
+  const auto halfWidth{
+    0 < viewportHeight ? halfHeight * static_cast<float>(viewportWidth)
+                           / static_cast<float>(viewportHeight)
+                       : halfHeight};
+  const auto x{0.5f * worldSize * std::cos(0.2f * time)};
+  const auto y{0.5f * worldSize * std::sin(0.2f * time)};
+
+  // Column-major, depth zero to one mapped to the near and far planes.
+  const GLfloat viewProjection[16]{1.0f / halfWidth,
+                                   0.0f,
+                                   0.0f,
+                                   0.0f,
+                                   0.0f,
+                                   1.0f / halfHeight,
+                                   0.0f,
+                                   0.0f,
+                                   0.0f,
+                                   0.0f,
+                                   2.0f,
+                                   0.0f,
+                                   -x / halfWidth,
+                                   -y / halfHeight,
+                                   -1.0f,
+                                   1.0f};
+
+  batcher.SetCamera(viewProjection);
+}
+
+// Spreads the objects over a square grid, pulsing. Every seventh one is
+// a large occluder in front of the others. Queues [first, first + count).
+static void AddObjects(float       time,
+                       std::size_t first,
+                       std::size_t count) noexcept
+{
+  const auto columns{static_cast<std::size_t>(
+    std::ceil(std::sqrt(static_cast<float>(objectCount))))};
+  const auto cell{2.0f * worldSize / static_cast<float>(columns)};
+
+  for (auto i{first}; i < first + count; ++i) {
+    const auto column{static_cast<float>(i % columns)};
+    const auto row{static_cast<float>(i / columns)};
+    const auto phase{static_cast<float>(i) * 0.37f};
+    const auto bOccluder{0 == i % 7};
+    const auto depth{bOccluder ? 0.1f
+                               : 0.3f + 0.6f * (phase - std::floor(phase))};
+    const auto scale{bOccluder
+                       ? 3.0f
+                       : 0.3f + 0.1f * std::sin(time * 2.0f + phase)};
+
+    batcher.Add(
+      i,
+      meshes[i % std::size(meshes)],
+      MeshInstance{-worldSize + (column + 0.5f) * cell,
+                   -worldSize + (row + 0.5f) * cell,
+                   depth,
+                   cell * scale,
+                   {0.5f + 0.5f * std::sin(phase),
+                    0.5f + 0.5f * std::sin(phase + 2.1f),
+                    0.5f + 0.5f * std::sin(phase + 4.2f),
+                    1.0f}});
+  }
+}
+
+void RenderFrame() noexcept
+{
+  const GpuScope frameScope{"frame"};
+
+  // Between frames, so that no recorded command uses a replaced program.
+  shaderLibrary.Update();
+  streamBuffer.BeginFrame();
+
+  auto& commands{commandBuffer.List(0)};
+
+  commands.Record(MakeSortKey(RenderPass::clear, 0, 0, 0),
+                  ViewportCommand{0, 0, viewportWidth, viewportHeight});
+  commands.Record(MakeSortKey(RenderPass::clear, 0, 0, 1),
+                  ClearCommand{GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT,
+                               {0.25f, 0.5f, 1.0f, 1.0f},
+                               1.0,
+                               0});
+
+  if (objectCount) {
+    const auto time{static_cast<float>(frameIndex) / 60.0f};
+    // A batch of objects per thread, recorded into the list after the
+    // render thread's one. Which list a batch goes to doesn't depend on
+    // the thread that records it, so neither does the merged stream.
+    const auto batches{std::min<std::size_t>({MeshBatcher::maxBatches,
+                                              CommandBuffer::maxLists - 1,
+                                              jobSystem.WorkerCount() + 1,
+                                              objectCount})};
+
+    SetCamera(time);
+    batcher.BeginFrame();
+
+    const auto key{MakeSortKey(RenderPass::opaque, batcher.Program(), 0, 0)};
+
+    jobSystem.ParallelFor(
+      "record",
+      batches,
+      1,
+      [time, batches, key](std::size_t begin, std::size_t end) noexcept {
+        for (auto batch{begin}; batch < end; ++batch) {
+          const auto first{objectCount * batch / batches};
+          const auto count{objectCount * (batch + 1) / batches - first};
+
+          AddObjects(time, first, count);
+          batcher.Submit(streamBuffer,
+                         commandBuffer.List(1 + batch),
+                         key,
+                         batch,
+                         first,
+                         count);
+        }
+      });
+  }
+
+  streamBuffer.Commit();
+  batcher.Cull();
+  commandBuffer.Execute();
+  batcher.CaptureDepth(viewportWidth, viewportHeight);
+  streamBuffer.EndFrame();
+
+  ++frameIndex;
+}
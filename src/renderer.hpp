@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+
+// Frame code shared by the WGL and EGL backends. Both expect a current
+// context with the GL entry points loaded.
+
+// Every frame draws the given number of animated objects. False if the
+// stream buffer cannot be created, e.g. below OpenGL 3.0.
+bool InitRenderer(std::size_t objects = 1024) noexcept;
+// Deletes the renderer's GL objects, needs the context to be current.
+void ReleaseRenderer() noexcept;
+void ResizeRenderer(int width, int height) noexcept;
+void RenderFrame() noexcept;
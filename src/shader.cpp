@@ -0,0 +1,366 @@
+#include "shader.hpp"
+#include "log.hpp"
+#include "program_cache.hpp"
+
+#include <cstring>
+#include <utility>
+#include <vector>
+
+static bool bParallelCompile{false};
+
+static void LogInfoLog(const char* what, GLuint object, bool bProgram) noexcept
+{
+  char    infoLog[1024]{};
+  GLsizei length{0};
+
+  if (bProgram) {
+    glGetProgramInfoLog(object, sizeof infoLog, &length, infoLog);
+  }
+  else {
+    glGetShaderInfoLog(object, sizeof infoLog, &length, infoLog);
+  }
+
+  Log("%s failed: %s", what, infoLog);
+}
+
+// Whether the program linked, otherwise logs why, preferably the errors
+// of a shader that failed to compile.
+static bool CheckLinkStatus(GLuint        program,
+                            const GLuint* pShaders,
+                            int           count) noexcept
+{
+  GLint bLinked{GL_FALSE};
+  auto  bCompiled{true};
+
+  glGetProgramiv(program, GL_LINK_STATUS, &bLinked);
+  if (bLinked) {
+    return true;
+  }
+
+  for (auto i{0}; i < count; ++i) {
+    GLint bShaderCompiled{GL_TRUE};
+    GLint type{0};
+
+    if (pShaders[i]) {
+      glGetShaderiv(pShaders[i], GL_COMPILE_STATUS, &bShaderCompiled);
+      glGetShaderiv(pShaders[i], GL_SHADER_TYPE, &type);
+    }
+    if (!bShaderCompiled) {
+      LogInfoLog(GL_VERTEX_SHADER == type     ? "vertex shader"
+                 : GL_FRAGMENT_SHADER == type ? "fragment shader"
+                                              : "compute shader",
+                 pShaders[i],
+                 false);
+      bCompiled = false;
+    }
+  }
+  if (bCompiled) {
+    LogInfoLog("program link", program, true);
+  }
+
+  return false;
+}
+
+// Compiles and links on the loader's context, blocking there. The data
+// holds the source of every stage, each terminated by a null character.
+static GLuint BuildOnLoader(const GLenum (&types)[2],
+                            int                           count,
+                            bool                          bRetrievable,
+                            const std::vector<std::byte>& data) noexcept
+{
+  GLuint shaders[2]{};
+  auto   pSource{reinterpret_cast<const char*>(data.data())};
+  auto   program{glCreateProgram()};
+
+  for (auto i{0}; program && i < count; ++i) {
+    shaders[i] = glCreateShader(types[i]);
+    glShaderSource(shaders[i], 1, &pSource, nullptr);
+    glCompileShader(shaders[i]);
+    glAttachShader(program, shaders[i]);
+    pSource += std::strlen(pSource) + 1;
+  }
+
+#if GL_DISPATCH_VERSION >= 41
+  if (program && bRetrievable) {
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
+#else
+  static_cast<void>(bRetrievable);
+#endif
+
+  if (program) {
+    glLinkProgram(program);
+    if (!CheckLinkStatus(program, shaders, count)) {
+      glDeleteProgram(program);
+      program = 0;
+    }
+  }
+
+  // Deleting zero is silently ignored, attached shaders live on until
+  // detached.
+  for (auto i{0}; i < count; ++i) {
+    if (program) {
+      glDetachShader(program, shaders[i]);
+    }
+    glDeleteShader(shaders[i]);
+  }
+
+  return program;
+}
+
+bool EnableParallelShaderCompile() noexcept
+{
+  bParallelCompile = false;
+
+#ifdef glMaxShaderCompilerThreadsKHR
+  if (glExtensions.Contains("GL_KHR_parallel_shader_compile"_ext)
+      && glMaxShaderCompilerThreadsKHR) {
+    // All ones lets the driver pick the number of threads.
+    glMaxShaderCompilerThreadsKHR(0xffffffff);
+    bParallelCompile = true;
+  }
+#endif
+
+  Log("shader compiler: %s",
+      bParallelCompile ? "parallel, GL_KHR_parallel_shader_compile"
+                       : "blocking");
+
+  return bParallelCompile;
+}
+
+GLuint BuildProgram(const char* const* vertexSources,
+                    GLsizei            vertexCount,
+                    const char* const* fragmentSources,
+                    GLsizei            fragmentCount) noexcept
+{
+  auto         program{glCreateProgram()};
+  const GLuint shaders[]{glCreateShader(GL_VERTEX_SHADER),
+                         glCreateShader(GL_FRAGMENT_SHADER)};
+
+  if (program && shaders[0] && shaders[1]) {
+    glShaderSource(shaders[0], vertexCount, vertexSources, nullptr);
+    glShaderSource(shaders[1], fragmentCount, fragmentSources, nullptr);
+    for (const auto shader : shaders) {
+      glCompileShader(shader);
+      glAttachShader(program, shader);
+    }
+
+    glLinkProgram(program);
+    if (!CheckLinkStatus(program, shaders, 2)) {
+      glDeleteProgram(program);
+      program = 0;
+    }
+  }
+  else {
+    glDeleteProgram(program);
+    program = 0;
+  }
+
+  // Deleting zero is silently ignored, attached shaders live on until
+  // detached.
+  for (const auto shader : shaders) {
+    if (program) {
+      glDetachShader(program, shader);
+    }
+    glDeleteShader(shader);
+  }
+
+  return program;
+}
+
+bool AsyncProgram::Begin(const char* const* vertexSources,
+                         GLsizei            vertexCount,
+                         const char* const* fragmentSources,
+                         GLsizei            fragmentCount) noexcept
+{
+  const Stage stages[]{{GL_VERTEX_SHADER, vertexSources, vertexCount},
+                       {GL_FRAGMENT_SHADER, fragmentSources, fragmentCount}};
+
+  return Begin(stages, 2);
+}
+
+bool AsyncProgram::BeginCompute(const char* const* sources,
+                                GLsizei            count) noexcept
+{
+  const Stage stage{GL_COMPUTE_SHADER, sources, count};
+
+  if (glVersion < 43) {
+    Release();
+    m_bFailed = true;
+    return false;
+  }
+
+  return Begin(&stage, 1);
+}
+
+bool AsyncProgram::Begin(const Stage* pStages, int count) noexcept
+{
+  ProgramKey key;
+
+  Release();
+
+  for (auto i{0}; i < count; ++i) {
+    key.AddShader(pStages[i].type, pStages[i].sources, pStages[i].count);
+  }
+
+  m_key     = key.Value();
+  m_program = programCache.Load(m_key);
+  if (m_program) {
+    m_bLinked = true;
+    return true;
+  }
+
+  m_start = std::chrono::steady_clock::now();
+
+  if (!bParallelCompile && loader.Running() && count <= maxStages) {
+    std::vector<std::byte> data;
+    GLenum                 types[maxStages]{};
+
+    for (auto i{0}; i < count; ++i) {
+      types[i] = pStages[i].type;
+      for (GLsizei part{0}; part < pStages[i].count; ++part) {
+        const auto pPart{pStages[i].sources[part]};
+        const auto pBytes{reinterpret_cast<const std::byte*>(pPart)};
+
+        data.insert(data.end(), pBytes, pBytes + std::strlen(pPart));
+      }
+      data.push_back(std::byte{0});
+    }
+
+    const auto bRetrievable{programCache.Enabled()};
+
+    m_load = loader.Submit(
+      "build program",
+      std::move(data),
+      [types, count, bRetrievable](
+        const std::vector<std::byte>& sources) noexcept {
+        return BuildOnLoader(types, count, bRetrievable, sources);
+      });
+    if (m_load.Valid()) {
+      return true;
+    }
+  }
+
+  m_program = count <= maxStages ? glCreateProgram() : 0;
+  if (!m_program) {
+    m_bFailed = true;
+    return false;
+  }
+
+  for (auto i{0}; i < count; ++i) {
+    m_shaders[i] = glCreateShader(pStages[i].type);
+    if (!m_shaders[i]) {
+      Release();
+      m_bFailed = true;
+      return false;
+    }
+
+    glShaderSource(m_shaders[i], pStages[i].count, pStages[i].sources, nullptr);
+    glCompileShader(m_shaders[i]);
+    glAttachShader(m_program, m_shaders[i]);
+  }
+
+#if GL_DISPATCH_VERSION >= 41
+  if (programCache.Enabled()) {
+    glProgramParameteri(m_program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
+#endif
+  glLinkProgram(m_program);
+
+  return true;
+}
+
+GLuint AsyncProgram::Poll() noexcept
+{
+  GLint bDone{GL_TRUE};
+
+  // The loader checked the link status and logged why it failed.
+  if (m_load.Valid()) {
+    if (!loader.Poll(&m_load, &m_program)) {
+      return 0;
+    }
+    if (!m_program) {
+      m_bFailed = true;
+      return 0;
+    }
+
+    programCache.Store(
+      m_key,
+      m_program,
+      std::chrono::nanoseconds{std::chrono::steady_clock::now() - m_start}
+        .count());
+    m_bLinked = true;
+
+    return m_program;
+  }
+
+  if (m_bLinked || !m_program) {
+    return m_bLinked ? m_program : 0;
+  }
+
+  if (bParallelCompile) {
+    glGetProgramiv(m_program, GL_COMPLETION_STATUS_KHR, &bDone);
+    if (!bDone) {
+      return 0;
+    }
+  }
+
+  if (!CheckLinkStatus(m_program, m_shaders, maxStages)) {
+    Release();
+    m_bFailed = true;
+    return 0;
+  }
+
+  for (auto& shader : m_shaders) {
+    if (shader) {
+      glDetachShader(m_program, shader);
+      glDeleteShader(shader);
+      shader = 0;
+    }
+  }
+
+  programCache.Store(
+    m_key,
+    m_program,
+    std::chrono::nanoseconds{std::chrono::steady_clock::now() - m_start}
+      .count());
+  m_bLinked = true;
+
+  return m_program;
+}
+
+void AsyncProgram::Release() noexcept
+{
+  // The loader may not use the names any more once they are deleted and
+  // can be handed out again.
+  if (m_load.Valid()) {
+    m_program = loader.Finish(&m_load);
+  }
+
+  // Also runs at exit, when there may be no context any more.
+  for (auto& shader : m_shaders) {
+    if (shader) {
+      glDeleteShader(shader);
+      shader = 0;
+    }
+  }
+  if (m_program) {
+    glDeleteProgram(m_program);
+  }
+
+  m_program = 0;
+  m_key     = 0;
+  m_bLinked = false;
+  m_bFailed = false;
+}
+
+void AsyncProgram::Swap(AsyncProgram& other) noexcept
+{
+  std::swap(m_program, other.m_program);
+  std::swap(m_shaders, other.m_shaders);
+  std::swap(m_load, other.m_load);
+  std::swap(m_key, other.m_key);
+  std::swap(m_start, other.m_start);
+  std::swap(m_bLinked, other.m_bLinked);
+  std::swap(m_bFailed, other.m_bFailed);
+}
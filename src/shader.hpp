@@ -0,0 +1,79 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#include "gl.hpp"
+#include "loader.hpp"
+
+// Lets the driver compile and link on threads of its own if it supports
+// GL_KHR_parallel_shader_compile, once after LoadGl. False if it does not.
+bool EnableParallelShaderCompile() noexcept;
+
+// Compiles and links right away, waiting for the driver and bypassing the
+// program cache, for small programs that must be there from the first
+// frame. Zero if it failed, in which case the errors were logged.
+GLuint BuildProgram(const char* const* vertexSources,
+                    GLsizei            vertexCount,
+                    const char* const* fragmentSources,
+                    GLsizei            fragmentCount) noexcept;
+
+// A program built without waiting for the driver. Begin hands over the
+// compiles and the link without asking for their status, so programs
+// begun one after another build in parallel, and Poll only asks for
+// GL_COMPLETION_STATUS_KHR until the driver is done. Without
+// GL_KHR_parallel_shader_compile the first Poll waits for the program.
+// Shader sources are given as parts concatenated in order, e.g. a
+// #version line followed by the shared source. Programs come from the
+// program cache when it has them. Without the extension but with the
+// loader running, the loader compiles and links instead.
+class AsyncProgram {
+public:
+  AsyncProgram() noexcept = default;
+  AsyncProgram(const AsyncProgram&) = delete;
+  AsyncProgram& operator=(const AsyncProgram&) = delete;
+  ~AsyncProgram()
+  {
+    Release();
+  }
+
+  bool Begin(const char* const* vertexSources,
+             GLsizei            vertexCount,
+             const char* const* fragmentSources,
+             GLsizei            fragmentCount) noexcept;
+  // Needs OpenGL 4.3.
+  bool BeginCompute(const char* const* sources, GLsizei count) noexcept;
+
+  // The program once linked, zero while it builds or if it failed, in
+  // which case the errors were logged.
+  GLuint Poll() noexcept;
+  bool   Failed() const noexcept
+  {
+    return m_bFailed;
+  }
+
+  // Deletes the program, needs the context to be current.
+  void Release() noexcept;
+  // Exchanges the programs and their builds, e.g. to replace a program by
+  // a rebuilt one once it linked.
+  void Swap(AsyncProgram& other) noexcept;
+
+private:
+  static constexpr int maxStages{2};
+
+  struct Stage {
+    GLenum             type;
+    const char* const* sources;
+    GLsizei            count;
+  };
+
+  bool Begin(const Stage* pStages, int count) noexcept;
+
+  GLuint                                m_program{0};
+  GLuint                                m_shaders[maxStages]{};
+  LoadTicket                            m_load; // While the loader builds.
+  std::uint64_t                         m_key{0};
+  std::chrono::steady_clock::time_point m_start{};
+  bool                                  m_bLinked{false};
+  bool                                  m_bFailed{false};
+};
@@ -0,0 +1,487 @@
+#include "shader_library.hpp"
+#include "log.hpp"
+#include "paths.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <system_error>
+
+static constexpr char magic[]{"polychrome-shader-permutations 1"};
+
+ShaderLibrary shaderLibrary;
+
+static int GlslVersion(const ShaderFamilyInfo& family,
+                       std::uint32_t           features) noexcept
+{
+  auto glslVersion{family.glslVersion};
+
+  for (std::size_t i{0}; i < family.featureCount; ++i) {
+    if (0 != (features & (std::uint32_t{1} << i))) {
+      glslVersion = std::max(glslVersion, family.pFeatures[i].glslVersion);
+    }
+  }
+
+  return glslVersion;
+}
+
+// One part for the #version line and the defines, ahead of the family's
+// parts of every stage.
+static std::string Header(const ShaderFamilyInfo& family,
+                          std::uint32_t           features) noexcept
+{
+  std::string header{"#version "
+                     + std::to_string(GlslVersion(family, features))
+                     + " core\n"};
+
+  for (std::size_t i{0}; i < family.featureCount; ++i) {
+    if (0 != (features & (std::uint32_t{1} << i))) {
+      header += "#define ";
+      header += family.pFeatures[i].define;
+      header += '\n';
+    }
+  }
+
+  return header;
+}
+
+// The family name followed by the defines of the features, the way the
+// pre-warm list spells a permutation.
+static std::string Describe(const ShaderFamilyInfo& family,
+                            std::uint32_t           features) noexcept
+{
+  std::string line{family.name};
+
+  for (std::size_t i{0}; i < family.featureCount; ++i) {
+    if (0 != (features & (std::uint32_t{1} << i))) {
+      line += ' ';
+      line += family.pFeatures[i].define;
+    }
+  }
+
+  return line;
+}
+
+// The features of a pre-warm list line if it names the family and only
+// features it has.
+static bool Parse(const std::string&      line,
+                  const ShaderFamilyInfo& family,
+                  std::uint32_t*          pFeatures) noexcept
+{
+  std::istringstream stream{line};
+  std::string        word;
+  std::uint32_t      features{0};
+
+  if (!(stream >> word) || word != family.name) {
+    return false;
+  }
+
+  while (stream >> word) {
+    std::size_t i{0};
+
+    while (i < family.featureCount && word != family.pFeatures[i].define) {
+      ++i;
+    }
+    if (i == family.featureCount) {
+      return false;
+    }
+
+    features |= std::uint32_t{1} << i;
+  }
+
+  *pFeatures = features;
+
+  return true;
+}
+
+bool ShaderLibrary::Open(const char* name) noexcept
+{
+  const auto directory{GetCacheDirectory()};
+
+  Close();
+  m_prewarmList.clear();
+  m_prewarmed = 0;
+  m_path.clear();
+  m_shaderDirectory.clear();
+  m_files.clear();
+
+  if (const auto shaderDir{std::getenv("POLYCHROME_SHADER_DIR")}) {
+    std::error_code ec;
+
+    std::filesystem::create_directories(shaderDir, ec);
+    if (!ec && m_watcher.Start(shaderDir)) {
+      m_shaderDirectory = shaderDir;
+      Log("shader library: reloading sources from %s", shaderDir);
+    }
+    else {
+      Log("shader library: cannot watch %s", shaderDir);
+    }
+  }
+
+  if (directory.empty()) {
+    return false;
+  }
+
+  m_path = directory / name;
+
+  std::ifstream file{m_path};
+  std::string   line;
+
+  if (!std::getline(file, line) || line != magic) {
+    return false;
+  }
+
+  while (std::getline(file, line)) {
+    if (!line.empty()) {
+      m_prewarmList.push_back(line);
+    }
+  }
+
+  Log("shader library: %zu permutation(s) to pre-warm",
+      m_prewarmList.size());
+
+  return true;
+}
+
+void ShaderLibrary::Close() noexcept
+{
+  std::vector<std::string> requested;
+  std::uint32_t            prewarmedRequests{0};
+
+  for (std::size_t i{0}; i < m_count; ++i) {
+    const auto& permutation{m_permutations[i]};
+
+    if (permutation.bRequested) {
+      requested.push_back(
+        Describe(*permutation.pFamily, permutation.features));
+      prewarmedRequests += permutation.bPrewarmed;
+    }
+  }
+
+  if (m_count) {
+    Log("shader library: %zu permutation(s) requested, %u pre-warmed, %u "
+        "pre-warmed in vain",
+        requested.size(),
+        prewarmedRequests,
+        m_prewarmed - prewarmedRequests);
+  }
+
+  // A launch that requested nothing, e.g. because it failed early, keeps
+  // the list of the last one that did.
+  std::sort(requested.begin(), requested.end());
+  std::sort(m_prewarmList.begin(), m_prewarmList.end());
+  if (!requested.empty() && requested != m_prewarmList && !m_path.empty()) {
+    std::string text{magic};
+
+    for (const auto& line : requested) {
+      text += '\n';
+      text += line;
+    }
+    text += '\n';
+
+    if (!WriteFileAtomically(m_path, text.data(), text.size())) {
+      Log("shader library: failed to write %s", m_path.string().c_str());
+    }
+    m_prewarmList = std::move(requested);
+  }
+
+  m_watcher.Stop();
+
+  for (std::size_t i{0}; i < m_count; ++i) {
+    auto& permutation{m_permutations[i]};
+
+    permutation.program.Release();
+    permutation.reload.Release();
+    permutation.files.clear();
+    permutation.pFamily    = nullptr;
+    permutation.features   = 0;
+    permutation.bRequested = false;
+    permutation.bPrewarmed = false;
+    permutation.bReloading = false;
+  }
+
+  m_count     = 0;
+  m_prewarmed = 0;
+}
+
+void ShaderLibrary::Update() noexcept
+{
+  bool bStale[maxPermutations]{};
+  auto bAnyStale{false};
+
+  for (std::size_t i{0}; i < m_count; ++i) {
+    auto& permutation{m_permutations[i]};
+
+    if (!permutation.bReloading) {
+      continue;
+    }
+
+    // A failed rebuild logged why when it was polled.
+    if (permutation.reload.Poll()) {
+      permutation.program.Swap(permutation.reload);
+      permutation.reload.Release();
+      permutation.bReloading = false;
+      Log("shader library: reloaded %s",
+          Describe(*permutation.pFamily, permutation.features).c_str());
+    }
+    else if (permutation.reload.Failed()) {
+      permutation.bReloading = false;
+      Log("shader library: kept the previous %s",
+          Describe(*permutation.pFamily, permutation.features).c_str());
+    }
+  }
+
+  if (m_shaderDirectory.empty()) {
+    return;
+  }
+
+  // Editors often write a file several times per save, only actual
+  // changes to files that were read count.
+  for (const auto& name : m_watcher.TakeChanges()) {
+    const auto    pFile{m_files.find(name)};
+    std::ifstream file{m_shaderDirectory / name, std::ios::binary};
+
+    if (m_files.end() == pFile || !file) {
+      continue;
+    }
+
+    std::string text{std::istreambuf_iterator<char>{file},
+                     std::istreambuf_iterator<char>{}};
+
+    if (text == pFile->second) {
+      continue;
+    }
+
+    pFile->second = std::move(text);
+    for (std::size_t i{0}; i < m_count; ++i) {
+      const auto& files{m_permutations[i].files};
+
+      if (std::find(files.begin(), files.end(), name) != files.end()) {
+        bStale[i] = true;
+        bAnyStale = true;
+      }
+    }
+  }
+
+  for (std::size_t i{0}; bAnyStale && i < m_count; ++i) {
+    if (bStale[i]) {
+      Begin(m_permutations[i], m_permutations[i].reload);
+      m_permutations[i].bReloading = true;
+    }
+  }
+}
+
+AsyncProgram* ShaderLibrary::Request(const ShaderFamilyInfo& family,
+                                     std::uint32_t           features) noexcept
+{
+  if (family.featureCount < 32 && 0 != features >> family.featureCount) {
+    Log("shader library: %s has no feature %08x", family.name, features);
+    return nullptr;
+  }
+
+  auto pPermutation{Find(family, features)};
+
+  if (!pPermutation) {
+    pPermutation = Build(family, features);
+  }
+  if (!pPermutation) {
+    return nullptr;
+  }
+
+  pPermutation->bRequested = true;
+
+  return &pPermutation->program;
+}
+
+void ShaderLibrary::Prewarm(const ShaderFamilyInfo& family) noexcept
+{
+  for (const auto& line : m_prewarmList) {
+    std::uint32_t features{0};
+
+    // The list may come from a driver with a newer OpenGL version, whose
+    // GLSL versions are the OpenGL version times ten since 3.3.
+    if (Parse(line, family, &features) && !Find(family, features)
+        && GlslVersion(family, features) <= 10 * glVersion) {
+      if (const auto pPermutation{Build(family, features)}) {
+        pPermutation->bPrewarmed = true;
+        ++m_prewarmed;
+      }
+    }
+  }
+}
+
+ShaderLibrary::Permutation*
+ShaderLibrary::Find(const ShaderFamilyInfo& family,
+                    std::uint32_t           features) noexcept
+{
+  for (std::size_t i{0}; i < m_count; ++i) {
+    if (&family == m_permutations[i].pFamily
+        && features == m_permutations[i].features) {
+      return &m_permutations[i];
+    }
+  }
+
+  return nullptr;
+}
+
+ShaderLibrary::Permutation*
+ShaderLibrary::Build(const ShaderFamilyInfo& family,
+                     std::uint32_t           features) noexcept
+{
+  if (maxPermutations == m_count) {
+    Log("shader library: no room for %s",
+        Describe(family, features).c_str());
+    return nullptr;
+  }
+
+  auto& permutation{m_permutations[m_count++]};
+
+  permutation.pFamily  = &family;
+  permutation.features = features;
+
+  // A permutation that failed to begin stays, so that it is not begun
+  // again on every request.
+  Begin(permutation, permutation.program);
+
+  return &permutation;
+}
+
+GLuint ShaderLibrary::BuildFallback(const ShaderFamilyInfo&   family,
+                                    std::uint32_t             features,
+                                    const ShaderStageSources& fragment) noexcept
+{
+  const auto               header{Header(family, features)};
+  std::vector<std::string> texts;
+  std::vector<std::string> files; // Not watched, the fallback is not kept.
+
+  texts.reserve(
+    static_cast<std::size_t>(family.vertex.count + fragment.count));
+
+  const auto vertexParts{StageParts(header, family.vertex, &texts, &files)};
+  const auto fragmentParts{StageParts(header, fragment, &texts, &files)};
+
+  return BuildProgram(vertexParts.data(),
+                      static_cast<GLsizei>(vertexParts.size()),
+                      fragmentParts.data(),
+                      static_cast<GLsizei>(fragmentParts.size()));
+}
+
+void ShaderLibrary::Begin(Permutation&  permutation,
+                          AsyncProgram& program) noexcept
+{
+  const auto& family{*permutation.pFamily};
+  const auto  header{Header(family, permutation.features)};
+
+  permutation.files.clear();
+
+  // Reserved up front, so that growing does not move the texts the parts
+  // point at.
+  std::vector<std::string> texts;
+
+  texts.reserve(static_cast<std::size_t>(
+    family.vertex.count + family.fragment.count + family.compute.count));
+
+  const auto stageParts{[&](const ShaderStageSources& stage) {
+    return StageParts(header, stage, &texts, &permutation.files);
+  }};
+
+  if (family.compute.count) {
+    const auto parts{stageParts(family.compute)};
+
+    program.BeginCompute(parts.data(), static_cast<GLsizei>(parts.size()));
+  }
+  else {
+    const auto vertexParts{stageParts(family.vertex)};
+    const auto fragmentParts{stageParts(family.fragment)};
+
+    program.Begin(vertexParts.data(),
+                  static_cast<GLsizei>(vertexParts.size()),
+                  fragmentParts.data(),
+                  static_cast<GLsizei>(fragmentParts.size()));
+  }
+}
+
+// The header part followed by the stage's parts, whose texts are appended
+// to the given ones, reserved so that the parts stay where they are.
+std::vector<const char*>
+ShaderLibrary::StageParts(const std::string&        header,
+                          const ShaderStageSources& stage,
+                          std::vector<std::string>* pTexts,
+                          std::vector<std::string>* pFiles) noexcept
+{
+  std::vector<const char*> parts{header.c_str()};
+
+  for (GLsizei i{0}; i < stage.count; ++i) {
+    pTexts->push_back(
+      ReadSource(stage.parts[i]->name, stage.parts[i]->text, pFiles, 0));
+    parts.push_back(pTexts->back().c_str());
+  }
+
+  return parts;
+}
+
+// The built-in source, or with a shader directory the file of that name
+// with its includes expanded. A missing file is written with the built-in
+// source for editing.
+std::string ShaderLibrary::ReadSource(const char*               name,
+                                      const char*               pBuiltIn,
+                                      std::vector<std::string>* pFiles,
+                                      int depth) noexcept
+{
+  if (m_shaderDirectory.empty()) {
+    return pBuiltIn;
+  }
+
+  const auto    path{m_shaderDirectory / name};
+  std::ifstream file{path, std::ios::binary};
+  std::string   text;
+
+  if (file) {
+    text.assign(std::istreambuf_iterator<char>{file},
+                std::istreambuf_iterator<char>{});
+  }
+  else if (pBuiltIn) {
+    text = pBuiltIn;
+    WriteFileAtomically(path, text.data(), text.size());
+  }
+  else {
+    Log("shader library: %s is missing", path.string().c_str());
+  }
+
+  m_files[name] = text;
+  if (std::find(pFiles->begin(), pFiles->end(), name) == pFiles->end()) {
+    pFiles->push_back(name);
+  }
+
+  std::istringstream lines{text};
+  std::string        line;
+  std::string        expanded;
+
+  while (std::getline(lines, line)) {
+    const auto directive{line.find_first_not_of(" \t")};
+    const auto open{line.find('"')};
+    const auto close{line.rfind('"')};
+
+    if (std::string::npos != directive
+        && 0 == line.compare(directive, 8, "#include")
+        && std::string::npos != open && open < close) {
+      if (depth < maxIncludeDepth) {
+        expanded += ReadSource(line.substr(open + 1, close - open - 1).c_str(),
+                               nullptr,
+                               pFiles,
+                               depth + 1);
+      }
+      else {
+        Log("shader library: includes of %s nest too deep", name);
+      }
+    }
+    else {
+      expanded += line;
+    }
+    expanded += '\n';
+  }
+
+  return expanded;
+}
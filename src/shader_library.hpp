@@ -0,0 +1,212 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <initializer_list>
+#include <map>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "file_watcher.hpp"
+#include "gl.hpp"
+#include "shader.hpp"
+
+// A feature of a shader family: the #define that turns it on and the
+// least GLSL version it needs, e.g. 430 for shader storage buffers.
+struct ShaderFeature {
+  const char* define;
+  int         glslVersion;
+};
+
+// Features of one family as bits indexed by an enum, so that the features
+// of one family cannot be handed to another.
+template<typename Feature>
+class FeatureSet {
+public:
+  static_assert(std::is_enum_v<Feature>);
+
+  constexpr FeatureSet() noexcept = default;
+  constexpr FeatureSet(std::initializer_list<Feature> features) noexcept
+  {
+    for (const auto feature : features) {
+      m_bits |= Bit(feature);
+    }
+  }
+
+  constexpr FeatureSet With(Feature feature, bool bEnabled) const noexcept
+  {
+    auto features{*this};
+
+    if (bEnabled) {
+      features.m_bits |= Bit(feature);
+    }
+
+    return features;
+  }
+  constexpr bool Has(Feature feature) const noexcept
+  {
+    return 0 != (m_bits & Bit(feature));
+  }
+  constexpr std::uint32_t Bits() const noexcept
+  {
+    return m_bits;
+  }
+
+private:
+  static constexpr std::uint32_t Bit(Feature feature) noexcept
+  {
+    return std::uint32_t{1} << static_cast<unsigned>(feature);
+  }
+
+  std::uint32_t m_bits{0};
+};
+
+// For families without features.
+enum class NoShaderFeature : std::uint8_t {};
+
+// A source part and the name of the file that replaces it in the shader
+// directory.
+struct ShaderSource {
+  const char* name;
+  const char* text;
+};
+
+// Source parts of a stage, concatenated in order.
+struct ShaderStageSources {
+  const ShaderSource* const* parts;
+  GLsizei                    count;
+};
+
+// Programs built from the same sources that differ in the features they
+// enable. Every stage of a permutation starts with the #version line of
+// the newest version among the family's and its features', followed by
+// the defines of its features. A family has either vertex and fragment or
+// compute sources. The name identifies it in the pre-warm list.
+struct ShaderFamilyInfo {
+  const char*          name;
+  int                  glslVersion;
+  const ShaderFeature* pFeatures; // Indexed by the feature enum.
+  std::size_t          featureCount;
+  ShaderStageSources   vertex;
+  ShaderStageSources   fragment;
+  ShaderStageSources   compute;
+};
+
+template<typename Feature>
+struct ShaderFamily {
+  static_assert(std::is_enum_v<Feature>);
+
+  ShaderFamilyInfo info;
+};
+
+// Builds the permutations of shader families when they are first
+// requested, asynchronously and through the program cache, and keeps them
+// until Close. The permutations a launch requested are written to a list
+// in the cache directory, which the next launch reads on Open so that
+// Prewarm can begin them before they are requested. A list recorded by a
+// production run can be put there to prime a fresh install.
+//
+// With POLYCHROME_SHADER_DIR set, source parts are read from the files of
+// that name in the directory, which start out as copies of the built-in
+// sources, and may #include "other files" there. When a file changes, the
+// permutations that read it, directly or through an include, are rebuilt
+// in the background and replace the old ones between frames once linked.
+// A rebuild that fails keeps the old program.
+class ShaderLibrary {
+public:
+  static constexpr std::size_t maxPermutations{64};
+
+  ShaderLibrary() noexcept = default;
+  ShaderLibrary(const ShaderLibrary&) = delete;
+  ShaderLibrary& operator=(const ShaderLibrary&) = delete;
+
+  // Reads the pre-warm list, which may not exist.
+  bool Open(const char* name) noexcept;
+  // Writes the permutations requested since Open if they changed and
+  // deletes the programs, needs the context to be current.
+  void Close() noexcept;
+
+  // Swaps in the rebuilt permutations that linked and starts rebuilding
+  // those whose files changed, between frames.
+  void Update() noexcept;
+
+  // The permutation, begun on the first request, null if there is no room
+  // for it or the features are not the family's. The library owns it, and
+  // its program changes when it is reloaded.
+  template<typename Feature>
+  AsyncProgram* Request(const ShaderFamily<Feature>& family,
+                        FeatureSet<Feature>          features) noexcept
+  {
+    return Request(family.info, features.Bits());
+  }
+
+  // Begins the permutations of the family on the pre-warm list.
+  template<typename Feature>
+  void Prewarm(const ShaderFamily<Feature>& family) noexcept
+  {
+    Prewarm(family.info);
+  }
+
+  // The permutation's vertex stage with the given fragment stage instead
+  // of the family's, read the same way but built right away with
+  // BuildProgram, e.g. as a fallback drawn while the permutation builds.
+  // The caller owns it, zero if it failed.
+  template<typename Feature>
+  GLuint BuildFallback(const ShaderFamily<Feature>& family,
+                       FeatureSet<Feature>          features,
+                       const ShaderStageSources&    fragment) noexcept
+  {
+    return BuildFallback(family.info, features.Bits(), fragment);
+  }
+
+private:
+  struct Permutation {
+    const ShaderFamilyInfo*  pFamily{nullptr};
+    std::uint32_t            features{0};
+    bool                     bRequested{false};
+    bool                     bPrewarmed{false};
+    bool                     bReloading{false};
+    AsyncProgram             program;
+    AsyncProgram             reload;
+    std::vector<std::string> files; // Read from the shader directory.
+  };
+
+  // Includes nest at most this deep, which also ends include cycles.
+  static constexpr int maxIncludeDepth{8};
+
+  AsyncProgram* Request(const ShaderFamilyInfo& family,
+                        std::uint32_t           features) noexcept;
+  void          Prewarm(const ShaderFamilyInfo& family) noexcept;
+  GLuint        BuildFallback(const ShaderFamilyInfo&   family,
+                              std::uint32_t             features,
+                              const ShaderStageSources& fragment) noexcept;
+  Permutation*  Find(const ShaderFamilyInfo& family,
+                     std::uint32_t           features) noexcept;
+  Permutation*  Build(const ShaderFamilyInfo& family,
+                      std::uint32_t           features) noexcept;
+  void          Begin(Permutation& permutation, AsyncProgram& program) noexcept;
+  std::string   ReadSource(const char*               name,
+                           const char*               pBuiltIn,
+                           std::vector<std::string>* pFiles,
+                           int                       depth) noexcept;
+
+  std::vector<const char*>
+  StageParts(const std::string&        header,
+             const ShaderStageSources& stage,
+             std::vector<std::string>* pTexts,
+             std::vector<std::string>* pFiles) noexcept;
+
+  std::filesystem::path    m_path;
+  std::vector<std::string> m_prewarmList; // Family name, then defines.
+  Permutation              m_permutations[maxPermutations];
+  std::size_t              m_count{0};
+  std::uint32_t            m_prewarmed{0};
+
+  std::filesystem::path              m_shaderDirectory;
+  FileWatcher                        m_watcher;
+  std::map<std::string, std::string> m_files; // Contents as last read.
+};
+
+extern ShaderLibrary shaderLibrary;
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// Lock-free ring buffer for exactly one producer and one consumer thread.
+// Each side caches the other side's index and only reloads it when the
+// queue looks full or empty, so the shared cache lines rarely bounce.
+template<typename T, std::size_t Capacity>
+class SpscQueue {
+  static_assert(0 != Capacity && 0 == (Capacity & (Capacity - 1)),
+                "Capacity must be a power of two");
+
+public:
+  // Producer side.
+  bool TryPush(const T& value) noexcept
+  {
+    const auto tail{m_tail.load(std::memory_order_relaxed)};
+
+    if (tail - m_cachedHead == Capacity) {
+      m_cachedHead = m_head.load(std::memory_order_acquire);
+      if (tail - m_cachedHead == Capacity) {
+        return false;
+      }
+    }
+
+    m_items[tail & (Capacity - 1)] = value;
+    m_tail.store(tail + 1, std::memory_order_release);
+
+    return true;
+  }
+
+  // Consumer side.
+  bool TryPop(T* pValue) noexcept
+  {
+    const auto head{m_head.load(std::memory_order_relaxed)};
+
+    if (head == m_cachedTail) {
+      m_cachedTail = m_tail.load(std::memory_order_acquire);
+      if (head == m_cachedTail) {
+        return false;
+      }
+    }
+
+    *pValue = m_items[head & (Capacity - 1)];
+    m_head.store(head + 1, std::memory_order_release);
+
+    return true;
+  }
+
+private:
+  static constexpr std::size_t cacheLineSize{64};
+
+  alignas(cacheLineSize) std::atomic<std::size_t> m_head{0};
+  std::size_t m_cachedTail{0};
+
+  alignas(cacheLineSize) std::atomic<std::size_t> m_tail{0};
+  std::size_t m_cachedHead{0};
+
+  alignas(cacheLineSize) T m_items[Capacity]{};
+};
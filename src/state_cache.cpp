@@ -0,0 +1,1026 @@
+#include "state_cache.hpp"
+#include "gl.hpp"
+
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <tuple>
+
+// The wrappers call the driver through a copy of the dispatch table, which
+// the macros from gl_dispatch.hpp would turn from driver.glX into
+// driver.gl.glX.
+#undef glActiveTexture
+#undef glBindBuffer
+#undef glBindBufferBase
+#undef glBindBufferRange
+#undef glBindBuffersBase
+#undef glBindBuffersRange
+#undef glBindFramebuffer
+#undef glBindSampler
+#undef glBindSamplers
+#undef glBindTexture
+#undef glBindTextureUnit
+#undef glBindTextures
+#undef glBindVertexArray
+#undef glBlendColor
+#undef glBlendEquation
+#undef glBlendEquationSeparate
+#undef glBlendEquationSeparatei
+#undef glBlendEquationi
+#undef glBlendFunc
+#undef glBlendFuncSeparate
+#undef glBlendFuncSeparatei
+#undef glBlendFunci
+#undef glClearColor
+#undef glClearDepth
+#undef glClearDepthf
+#undef glClearStencil
+#undef glColorMask
+#undef glColorMaski
+#undef glCullFace
+#undef glDeleteBuffers
+#undef glDeleteFramebuffers
+#undef glDeleteSamplers
+#undef glDeleteTextures
+#undef glDeleteVertexArrays
+#undef glDepthFunc
+#undef glDepthMask
+#undef glDisable
+#undef glDisablei
+#undef glEnable
+#undef glEnablei
+#undef glFrontFace
+#undef glPolygonMode
+#undef glPolygonOffset
+#undef glScissor
+#undef glScissorArrayv
+#undef glScissorIndexed
+#undef glScissorIndexedv
+#undef glStencilFunc
+#undef glStencilFuncSeparate
+#undef glStencilMask
+#undef glStencilMaskSeparate
+#undef glStencilOp
+#undef glStencilOpSeparate
+#undef glUseProgram
+#undef glViewport
+#undef glViewportArrayv
+#undef glViewportIndexedf
+#undef glViewportIndexedfv
+
+namespace {
+
+constexpr std::size_t maxTextureUnits{32};
+
+// Targets and capabilities the cache tracks, anything else passes through.
+constexpr GLenum bufferTargets[]{GL_ARRAY_BUFFER,
+                                 GL_ATOMIC_COUNTER_BUFFER,
+                                 GL_COPY_READ_BUFFER,
+                                 GL_COPY_WRITE_BUFFER,
+                                 GL_DISPATCH_INDIRECT_BUFFER,
+                                 GL_DRAW_INDIRECT_BUFFER,
+                                 GL_ELEMENT_ARRAY_BUFFER,
+                                 GL_PARAMETER_BUFFER,
+                                 GL_PIXEL_PACK_BUFFER,
+                                 GL_PIXEL_UNPACK_BUFFER,
+                                 GL_QUERY_BUFFER,
+                                 GL_SHADER_STORAGE_BUFFER,
+                                 GL_TEXTURE_BUFFER,
+                                 GL_TRANSFORM_FEEDBACK_BUFFER,
+                                 GL_UNIFORM_BUFFER};
+constexpr GLenum textureTargets[]{GL_TEXTURE_1D,
+                                  GL_TEXTURE_1D_ARRAY,
+                                  GL_TEXTURE_2D,
+                                  GL_TEXTURE_2D_ARRAY,
+                                  GL_TEXTURE_2D_MULTISAMPLE,
+                                  GL_TEXTURE_2D_MULTISAMPLE_ARRAY,
+                                  GL_TEXTURE_3D,
+                                  GL_TEXTURE_BUFFER,
+                                  GL_TEXTURE_CUBE_MAP,
+                                  GL_TEXTURE_CUBE_MAP_ARRAY,
+                                  GL_TEXTURE_RECTANGLE};
+constexpr GLenum capabilities[]{GL_BLEND,
+                                GL_CULL_FACE,
+                                GL_DEPTH_CLAMP,
+                                GL_DEPTH_TEST,
+                                GL_FRAMEBUFFER_SRGB,
+                                GL_MULTISAMPLE,
+                                GL_POLYGON_OFFSET_FILL,
+                                GL_PRIMITIVE_RESTART,
+                                GL_PROGRAM_POINT_SIZE,
+                                GL_RASTERIZER_DISCARD,
+                                GL_SAMPLE_ALPHA_TO_COVERAGE,
+                                GL_SCISSOR_TEST,
+                                GL_STENCIL_TEST,
+                                GL_TEXTURE_CUBE_MAP_SEAMLESS};
+
+constexpr std::size_t bufferTargetCount{std::size(bufferTargets)};
+constexpr std::size_t textureTargetCount{std::size(textureTargets)};
+constexpr std::size_t capabilityCount{std::size(capabilities)};
+
+// Element array bindings belong to the vertex array.
+constexpr std::size_t elementArrayBuffer{6};
+static_assert(GL_ELEMENT_ARRAY_BUFFER == bufferTargets[elementArrayBuffer]);
+
+// An empty optional is a value the cache does not know.
+struct StateCache {
+  std::optional<GLuint> program;
+  std::optional<GLuint> vertexArray;
+  std::optional<GLuint> buffers[bufferTargetCount];
+  std::optional<GLenum> activeTexture;
+  std::optional<GLuint> textures[maxTextureUnits][textureTargetCount];
+  std::optional<GLuint> samplers[maxTextureUnits];
+  std::optional<GLuint> drawFramebuffer;
+  std::optional<GLuint> readFramebuffer;
+  std::optional<bool>   enabled[capabilityCount];
+
+  std::optional<std::array<GLenum, 4>>  blendFunc;
+  std::optional<std::array<GLenum, 2>>  blendEquation;
+  std::optional<std::array<GLfloat, 4>> blendColor;
+  std::optional<GLenum>                 depthFunc;
+  std::optional<GLboolean>              depthMask;
+
+  // Front and back faces.
+  std::optional<std::tuple<GLenum, GLint, GLuint>> stencilFunc[2];
+  std::optional<std::array<GLenum, 3>>             stencilOp[2];
+  std::optional<GLuint>                            stencilMask[2];
+
+  std::optional<GLenum>                   cullFace;
+  std::optional<GLenum>                   frontFace;
+  std::optional<GLenum>                   polygonMode;
+  std::optional<std::array<GLfloat, 2>>   polygonOffset;
+  std::optional<std::array<GLboolean, 4>> colorMask;
+  std::optional<std::array<GLfloat, 4>>   clearColor;
+  std::optional<GLdouble>                 clearDepth;
+  std::optional<GLint>                    clearStencil;
+  std::optional<std::array<GLint, 4>>     viewport;
+  std::optional<std::array<GLint, 4>>     scissor;
+
+  StateCacheStats stats;
+};
+
+} // namespace
+
+static GlDispatch              driver{};
+static thread_local StateCache cache{};
+
+template<std::size_t N>
+static std::size_t IndexOf(const GLenum (&values)[N], GLenum value) noexcept
+{
+  std::size_t i{0};
+
+  while (i < N && values[i] != value) {
+    ++i;
+  }
+
+  return i;
+}
+
+// Records the value and tells whether the call has to reach the driver.
+template<typename T>
+static bool Update(std::optional<T>& cached, const T& value) noexcept
+{
+  if (cached && *cached == value) {
+    ++cache.stats.elided;
+    return false;
+  }
+
+  cached = value;
+  ++cache.stats.issued;
+
+  return true;
+}
+
+// For calls the cache cannot skip, e.g. because they change several
+// values at once.
+static void Issue() noexcept
+{
+  ++cache.stats.issued;
+}
+
+static std::optional<GLuint>* TextureUnitBindings() noexcept
+{
+  if (!cache.activeTexture) {
+    return nullptr;
+  }
+
+  const auto unit{*cache.activeTexture - GL_TEXTURE0};
+
+  return unit < maxTextureUnits ? cache.textures[unit] : nullptr;
+}
+
+// Faces as indices into the stencil state, FRONT_AND_BACK sets both.
+static std::size_t FirstFace(GLenum face) noexcept
+{
+  return GL_BACK == face ? 1 : 0;
+}
+
+static std::size_t LastFace(GLenum face) noexcept
+{
+  return GL_FRONT == face ? 0 : 1;
+}
+
+static void Forget(std::optional<GLuint>* bindings,
+                   std::size_t            count,
+                   GLsizei                n,
+                   const GLuint*          names) noexcept
+{
+  for (GLsizei i{0}; i < n; ++i) {
+    for (std::size_t j{0}; j < count; ++j) {
+      if (bindings[j] == names[i]) {
+        bindings[j] = 0;
+      }
+    }
+  }
+}
+
+static void APIENTRY Cached_glUseProgram(GLuint program)
+{
+  if (Update(cache.program, program)) {
+    driver.glUseProgram(program);
+  }
+}
+
+static void APIENTRY Cached_glBindBuffer(GLenum target, GLuint buffer)
+{
+  const auto i{IndexOf(bufferTargets, target)};
+
+  if (bufferTargetCount == i) {
+    Issue();
+    driver.glBindBuffer(target, buffer);
+  }
+  else if (Update(cache.buffers[i], buffer)) {
+    driver.glBindBuffer(target, buffer);
+  }
+}
+
+static void APIENTRY Cached_glActiveTexture(GLenum texture)
+{
+  if (Update(cache.activeTexture, texture)) {
+    driver.glActiveTexture(texture);
+  }
+}
+
+static void APIENTRY Cached_glBindTexture(GLenum target, GLuint texture)
+{
+  const auto bindings{TextureUnitBindings()};
+  const auto i{IndexOf(textureTargets, target)};
+
+  if (!bindings || textureTargetCount == i) {
+    Issue();
+    driver.glBindTexture(target, texture);
+  }
+  else if (Update(bindings[i], texture)) {
+    driver.glBindTexture(target, texture);
+  }
+}
+
+static void APIENTRY Cached_glEnable(GLenum cap)
+{
+  const auto i{IndexOf(capabilities, cap)};
+
+  if (capabilityCount == i) {
+    Issue();
+    driver.glEnable(cap);
+  }
+  else if (Update(cache.enabled[i], true)) {
+    driver.glEnable(cap);
+  }
+}
+
+static void APIENTRY Cached_glDisable(GLenum cap)
+{
+  const auto i{IndexOf(capabilities, cap)};
+
+  if (capabilityCount == i) {
+    Issue();
+    driver.glDisable(cap);
+  }
+  else if (Update(cache.enabled[i], false)) {
+    driver.glDisable(cap);
+  }
+}
+
+static void APIENTRY Cached_glBlendFunc(GLenum sfactor, GLenum dfactor)
+{
+  if (Update(cache.blendFunc, {sfactor, dfactor, sfactor, dfactor})) {
+    driver.glBlendFunc(sfactor, dfactor);
+  }
+}
+
+static void APIENTRY Cached_glBlendFuncSeparate(GLenum sfactorRGB,
+                                                GLenum dfactorRGB,
+                                                GLenum sfactorAlpha,
+                                                GLenum dfactorAlpha)
+{
+  if (Update(cache.blendFunc,
+             {sfactorRGB, dfactorRGB, sfactorAlpha, dfactorAlpha})) {
+    driver.glBlendFuncSeparate(sfactorRGB,
+                               dfactorRGB,
+                               sfactorAlpha,
+                               dfactorAlpha);
+  }
+}
+
+static void APIENTRY Cached_glBlendEquation(GLenum mode)
+{
+  if (Update(cache.blendEquation, {mode, mode})) {
+    driver.glBlendEquation(mode);
+  }
+}
+
+static void APIENTRY Cached_glBlendEquationSeparate(GLenum modeRGB,
+                                                    GLenum modeAlpha)
+{
+  if (Update(cache.blendEquation, {modeRGB, modeAlpha})) {
+    driver.glBlendEquationSeparate(modeRGB, modeAlpha);
+  }
+}
+
+static void APIENTRY Cached_glBlendColor(GLfloat red,
+                                         GLfloat green,
+                                         GLfloat blue,
+                                         GLfloat alpha)
+{
+  if (Update(cache.blendColor, {red, green, blue, alpha})) {
+    driver.glBlendColor(red, green, blue, alpha);
+  }
+}
+
+static void APIENTRY Cached_glDepthFunc(GLenum func)
+{
+  if (Update(cache.depthFunc, func)) {
+    driver.glDepthFunc(func);
+  }
+}
+
+static void APIENTRY Cached_glDepthMask(GLboolean flag)
+{
+  if (Update(cache.depthMask, flag)) {
+    driver.glDepthMask(flag);
+  }
+}
+
+static void APIENTRY Cached_glStencilFuncSeparate(GLenum face,
+                                                  GLenum func,
+                                                  GLint  ref,
+                                                  GLuint mask)
+{
+  const std::tuple value{func, ref, mask};
+  auto             bIssue{false};
+
+  for (auto i{FirstFace(face)}; i <= LastFace(face); ++i) {
+    bIssue = bIssue || cache.stencilFunc[i] != value;
+    cache.stencilFunc[i] = value;
+  }
+
+  if (bIssue) {
+    Issue();
+    driver.glStencilFuncSeparate(face, func, ref, mask);
+  }
+  else {
+    ++cache.stats.elided;
+  }
+}
+
+static void APIENTRY Cached_glStencilFunc(GLenum func, GLint ref, GLuint mask)
+{
+  Cached_glStencilFuncSeparate(GL_FRONT_AND_BACK, func, ref, mask);
+}
+
+static void APIENTRY Cached_glStencilOpSeparate(GLenum face,
+                                                GLenum sfail,
+                                                GLenum dpfail,
+                                                GLenum dppass)
+{
+  const std::array value{sfail, dpfail, dppass};
+  auto             bIssue{false};
+
+  for (auto i{FirstFace(face)}; i <= LastFace(face); ++i) {
+    bIssue = bIssue || cache.stencilOp[i] != value;
+    cache.stencilOp[i] = value;
+  }
+
+  if (bIssue) {
+    Issue();
+    driver.glStencilOpSeparate(face, sfail, dpfail, dppass);
+  }
+  else {
+    ++cache.stats.elided;
+  }
+}
+
+static void APIENTRY Cached_glStencilOp(GLenum fail,
+                                        GLenum zfail,
+                                        GLenum zpass)
+{
+  Cached_glStencilOpSeparate(GL_FRONT_AND_BACK, fail, zfail, zpass);
+}
+
+static void APIENTRY Cached_glStencilMaskSeparate(GLenum face, GLuint mask)
+{
+  auto bIssue{false};
+
+  for (auto i{FirstFace(face)}; i <= LastFace(face); ++i) {
+    bIssue = bIssue || cache.stencilMask[i] != mask;
+    cache.stencilMask[i] = mask;
+  }
+
+  if (bIssue) {
+    Issue();
+    driver.glStencilMaskSeparate(face, mask);
+  }
+  else {
+    ++cache.stats.elided;
+  }
+}
+
+static void APIENTRY Cached_glStencilMask(GLuint mask)
+{
+  Cached_glStencilMaskSeparate(GL_FRONT_AND_BACK, mask);
+}
+
+static void APIENTRY Cached_glCullFace(GLenum mode)
+{
+  if (Update(cache.cullFace, mode)) {
+    driver.glCullFace(mode);
+  }
+}
+
+static void APIENTRY Cached_glFrontFace(GLenum mode)
+{
+  if (Update(cache.frontFace, mode)) {
+    driver.glFrontFace(mode);
+  }
+}
+
+// Core profiles only know GL_FRONT_AND_BACK.
+static void APIENTRY Cached_glPolygonMode(GLenum face, GLenum mode)
+{
+  if (GL_FRONT_AND_BACK != face) {
+    cache.polygonMode.reset();
+    Issue();
+    driver.glPolygonMode(face, mode);
+  }
+  else if (Update(cache.polygonMode, mode)) {
+    driver.glPolygonMode(face, mode);
+  }
+}
+
+static void APIENTRY Cached_glPolygonOffset(GLfloat factor, GLfloat units)
+{
+  if (Update(cache.polygonOffset, {factor, units})) {
+    driver.glPolygonOffset(factor, units);
+  }
+}
+
+static void APIENTRY Cached_glColorMask(GLboolean red,
+                                        GLboolean green,
+                                        GLboolean blue,
+                                        GLboolean alpha)
+{
+  if (Update(cache.colorMask, {red, green, blue, alpha})) {
+    driver.glColorMask(red, green, blue, alpha);
+  }
+}
+
+static void APIENTRY Cached_glClearColor(GLfloat red,
+                                         GLfloat green,
+                                         GLfloat blue,
+                                         GLfloat alpha)
+{
+  if (Update(cache.clearColor, {red, green, blue, alpha})) {
+    driver.glClearColor(red, green, blue, alpha);
+  }
+}
+
+static void APIENTRY Cached_glClearDepth(GLdouble depth)
+{
+  if (Update(cache.clearDepth, depth)) {
+    driver.glClearDepth(depth);
+  }
+}
+
+static void APIENTRY Cached_glClearStencil(GLint s)
+{
+  if (Update(cache.clearStencil, s)) {
+    driver.glClearStencil(s);
+  }
+}
+
+static void APIENTRY Cached_glViewport(GLint   x,
+                                       GLint   y,
+                                       GLsizei width,
+                                       GLsizei height)
+{
+  if (Update(cache.viewport, {x, y, width, height})) {
+    driver.glViewport(x, y, width, height);
+  }
+}
+
+static void APIENTRY Cached_glScissor(GLint   x,
+                                      GLint   y,
+                                      GLsizei width,
+                                      GLsizei height)
+{
+  if (Update(cache.scissor, {x, y, width, height})) {
+    driver.glScissor(x, y, width, height);
+  }
+}
+
+// Deleting a bound object binds zero in its place. Programs in use are not
+// deleted before they are no longer in use, so they keep their names.
+static void APIENTRY Cached_glDeleteBuffers(GLsizei n, const GLuint* buffers)
+{
+  Forget(cache.buffers, bufferTargetCount, n, buffers);
+  Issue();
+  driver.glDeleteBuffers(n, buffers);
+}
+
+static void APIENTRY Cached_glDeleteTextures(GLsizei       n,
+                                             const GLuint* textures)
+{
+  Forget(cache.textures[0], maxTextureUnits * textureTargetCount, n, textures);
+  Issue();
+  driver.glDeleteTextures(n, textures);
+}
+
+#if GL_DISPATCH_VERSION >= 30
+static void APIENTRY Cached_glBindVertexArray(GLuint array)
+{
+  if (Update(cache.vertexArray, array)) {
+    cache.buffers[elementArrayBuffer].reset();
+    driver.glBindVertexArray(array);
+  }
+}
+
+// Indexed binds also bind the generic binding point.
+static void APIENTRY Cached_glBindBufferBase(GLenum target,
+                                             GLuint index,
+                                             GLuint buffer)
+{
+  if (const auto i{IndexOf(bufferTargets, target)}; i < bufferTargetCount) {
+    cache.buffers[i] = buffer;
+  }
+
+  Issue();
+  driver.glBindBufferBase(target, index, buffer);
+}
+
+static void APIENTRY Cached_glBindBufferRange(GLenum     target,
+                                              GLuint     index,
+                                              GLuint     buffer,
+                                              GLintptr   offset,
+                                              GLsizeiptr size)
+{
+  if (const auto i{IndexOf(bufferTargets, target)}; i < bufferTargetCount) {
+    cache.buffers[i] = buffer;
+  }
+
+  Issue();
+  driver.glBindBufferRange(target, index, buffer, offset, size);
+}
+
+static void APIENTRY Cached_glBindFramebuffer(GLenum target,
+                                              GLuint framebuffer)
+{
+  auto bIssue{false};
+
+  switch (target) {
+  case GL_FRAMEBUFFER:
+    bIssue = cache.drawFramebuffer != framebuffer
+             || cache.readFramebuffer != framebuffer;
+    cache.drawFramebuffer = framebuffer;
+    cache.readFramebuffer = framebuffer;
+    break;
+
+  case GL_DRAW_FRAMEBUFFER:
+    bIssue                = cache.drawFramebuffer != framebuffer;
+    cache.drawFramebuffer = framebuffer;
+    break;
+
+  case GL_READ_FRAMEBUFFER:
+    bIssue                = cache.readFramebuffer != framebuffer;
+    cache.readFramebuffer = framebuffer;
+    break;
+
+  default:
+    bIssue = true;
+    break;
+  }
+
+  if (bIssue) {
+    Issue();
+    driver.glBindFramebuffer(target, framebuffer);
+  }
+  else {
+    ++cache.stats.elided;
+  }
+}
+
+static void APIENTRY Cached_glDeleteVertexArrays(GLsizei       n,
+                                                 const GLuint* arrays)
+{
+  const auto vertexArray{cache.vertexArray};
+
+  Forget(&cache.vertexArray, 1, n, arrays);
+  if (cache.vertexArray != vertexArray) {
+    cache.buffers[elementArrayBuffer].reset();
+  }
+
+  Issue();
+  driver.glDeleteVertexArrays(n, arrays);
+}
+
+static void APIENTRY Cached_glDeleteFramebuffers(GLsizei       n,
+                                                 const GLuint* framebuffers)
+{
+  Forget(&cache.drawFramebuffer, 1, n, framebuffers);
+  Forget(&cache.readFramebuffer, 1, n, framebuffers);
+  Issue();
+  driver.glDeleteFramebuffers(n, framebuffers);
+}
+
+// Indexed state forgets the state it overrides for some draw buffers or
+// viewports.
+static void APIENTRY Cached_glColorMaski(GLuint    index,
+                                         GLboolean r,
+                                         GLboolean g,
+                                         GLboolean b,
+                                         GLboolean a)
+{
+  cache.colorMask.reset();
+  Issue();
+  driver.glColorMaski(index, r, g, b, a);
+}
+
+static void APIENTRY Cached_glEnablei(GLenum target, GLuint index)
+{
+  if (const auto i{IndexOf(capabilities, target)}; i < capabilityCount) {
+    cache.enabled[i].reset();
+  }
+
+  Issue();
+  driver.glEnablei(target, index);
+}
+
+static void APIENTRY Cached_glDisablei(GLenum target, GLuint index)
+{
+  if (const auto i{IndexOf(capabilities, target)}; i < capabilityCount) {
+    cache.enabled[i].reset();
+  }
+
+  Issue();
+  driver.glDisablei(target, index);
+}
+#endif
+
+#if GL_DISPATCH_VERSION >= 33
+static void APIENTRY Cached_glBindSampler(GLuint unit, GLuint sampler)
+{
+  if (unit >= maxTextureUnits) {
+    Issue();
+    driver.glBindSampler(unit, sampler);
+  }
+  else if (Update(cache.samplers[unit], sampler)) {
+    driver.glBindSampler(unit, sampler);
+  }
+}
+
+static void APIENTRY Cached_glDeleteSamplers(GLsizei       count,
+                                             const GLuint* samplers)
+{
+  Forget(cache.samplers, maxTextureUnits, count, samplers);
+  Issue();
+  driver.glDeleteSamplers(count, samplers);
+}
+#endif
+
+#if GL_DISPATCH_VERSION >= 40
+static void APIENTRY Cached_glBlendFunci(GLuint buf, GLenum src, GLenum dst)
+{
+  cache.blendFunc.reset();
+  Issue();
+  driver.glBlendFunci(buf, src, dst);
+}
+
+static void APIENTRY Cached_glBlendFuncSeparatei(GLuint buf,
+                                                 GLenum srcRGB,
+                                                 GLenum dstRGB,
+                                                 GLenum srcAlpha,
+                                                 GLenum dstAlpha)
+{
+  cache.blendFunc.reset();
+  Issue();
+  driver.glBlendFuncSeparatei(buf, srcRGB, dstRGB, srcAlpha, dstAlpha);
+}
+
+static void APIENTRY Cached_glBlendEquationi(GLuint buf, GLenum mode)
+{
+  cache.blendEquation.reset();
+  Issue();
+  driver.glBlendEquationi(buf, mode);
+}
+
+static void APIENTRY Cached_glBlendEquationSeparatei(GLuint buf,
+                                                     GLenum modeRGB,
+                                                     GLenum modeAlpha)
+{
+  cache.blendEquation.reset();
+  Issue();
+  driver.glBlendEquationSeparatei(buf, modeRGB, modeAlpha);
+}
+#endif
+
+#if GL_DISPATCH_VERSION >= 41
+// Shares the cached value with glClearDepth, a float widens exactly.
+static void APIENTRY Cached_glClearDepthf(GLfloat d)
+{
+  if (Update(cache.clearDepth, static_cast<GLdouble>(d))) {
+    driver.glClearDepthf(d);
+  }
+}
+
+static void APIENTRY Cached_glViewportArrayv(GLuint         first,
+                                             GLsizei        count,
+                                             const GLfloat* v)
+{
+  cache.viewport.reset();
+  Issue();
+  driver.glViewportArrayv(first, count, v);
+}
+
+static void APIENTRY Cached_glViewportIndexedf(GLuint  index,
+                                               GLfloat x,
+                                               GLfloat y,
+                                               GLfloat w,
+                                               GLfloat h)
+{
+  cache.viewport.reset();
+  Issue();
+  driver.glViewportIndexedf(index, x, y, w, h);
+}
+
+static void APIENTRY Cached_glViewportIndexedfv(GLuint index, const GLfloat* v)
+{
+  cache.viewport.reset();
+  Issue();
+  driver.glViewportIndexedfv(index, v);
+}
+
+static void APIENTRY Cached_glScissorArrayv(GLuint       first,
+                                            GLsizei      count,
+                                            const GLint* v)
+{
+  cache.scissor.reset();
+  Issue();
+  driver.glScissorArrayv(first, count, v);
+}
+
+static void APIENTRY Cached_glScissorIndexed(GLuint  index,
+                                             GLint   left,
+                                             GLint   bottom,
+                                             GLsizei width,
+                                             GLsizei height)
+{
+  cache.scissor.reset();
+  Issue();
+  driver.glScissorIndexed(index, left, bottom, width, height);
+}
+
+static void APIENTRY Cached_glScissorIndexedv(GLuint index, const GLint* v)
+{
+  cache.scissor.reset();
+  Issue();
+  driver.glScissorIndexedv(index, v);
+}
+#endif
+
+#if GL_DISPATCH_VERSION >= 44
+// Multi-binds set several units at once, forget them rather than tracking
+// every one.
+static void APIENTRY Cached_glBindBuffersBase(GLenum        target,
+                                              GLuint        first,
+                                              GLsizei       count,
+                                              const GLuint* buffers)
+{
+  if (const auto i{IndexOf(bufferTargets, target)}; i < bufferTargetCount) {
+    cache.buffers[i].reset();
+  }
+
+  Issue();
+  driver.glBindBuffersBase(target, first, count, buffers);
+}
+
+static void APIENTRY Cached_glBindBuffersRange(GLenum            target,
+                                               GLuint            first,
+                                               GLsizei           count,
+                                               const GLuint*     buffers,
+                                               const GLintptr*   offsets,
+                                               const GLsizeiptr* sizes)
+{
+  if (const auto i{IndexOf(bufferTargets, target)}; i < bufferTargetCount) {
+    cache.buffers[i].reset();
+  }
+
+  Issue();
+  driver.glBindBuffersRange(target, first, count, buffers, offsets, sizes);
+}
+
+static void APIENTRY Cached_glBindTextures(GLuint        first,
+                                           GLsizei       count,
+                                           const GLuint* textures)
+{
+  for (auto unit{first}; unit < first + count && unit < maxTextureUnits;
+       ++unit) {
+    for (auto& binding : cache.textures[unit]) {
+      binding.reset();
+    }
+  }
+
+  Issue();
+  driver.glBindTextures(first, count, textures);
+}
+
+static void APIENTRY Cached_glBindSamplers(GLuint        first,
+                                           GLsizei       count,
+                                           const GLuint* samplers)
+{
+  for (auto unit{first}; unit < first + count && unit < maxTextureUnits;
+       ++unit) {
+    cache.samplers[unit].reset();
+  }
+
+  Issue();
+  driver.glBindSamplers(first, count, samplers);
+}
+#endif
+
+#if GL_DISPATCH_VERSION >= 45
+static void APIENTRY Cached_glBindTextureUnit(GLuint unit, GLuint texture)
+{
+  if (unit < maxTextureUnits) {
+    for (auto& binding : cache.textures[unit]) {
+      binding.reset();
+    }
+  }
+
+  Issue();
+  driver.glBindTextureUnit(unit, texture);
+}
+#endif
+
+// Every call the cache wraps, grouped by the GL version introducing it.
+#define STATE_CACHE_CALLS(X) \
+  X(glActiveTexture) \
+  X(glBindBuffer) \
+  X(glBindTexture) \
+  X(glBlendColor) \
+  X(glBlendEquation) \
+  X(glBlendEquationSeparate) \
+  X(glBlendFunc) \
+  X(glBlendFuncSeparate) \
+  X(glClearColor) \
+  X(glClearDepth) \
+  X(glClearStencil) \
+  X(glColorMask) \
+  X(glCullFace) \
+  X(glDeleteBuffers) \
+  X(glDeleteTextures) \
+  X(glDepthFunc) \
+  X(glDepthMask) \
+  X(glDisable) \
+  X(glEnable) \
+  X(glFrontFace) \
+  X(glPolygonMode) \
+  X(glPolygonOffset) \
+  X(glScissor) \
+  X(glStencilFunc) \
+  X(glStencilFuncSeparate) \
+  X(glStencilMask) \
+  X(glStencilMaskSeparate) \
+  X(glStencilOp) \
+  X(glStencilOpSeparate) \
+  X(glUseProgram) \
+  X(glViewport) \
+  STATE_CACHE_CALLS_30(X) \
+  STATE_CACHE_CALLS_33(X) \
+  STATE_CACHE_CALLS_40(X) \
+  STATE_CACHE_CALLS_41(X) \
+  STATE_CACHE_CALLS_44(X) \
+  STATE_CACHE_CALLS_45(X)
+
+#if GL_DISPATCH_VERSION >= 30
+#define STATE_CACHE_CALLS_30(X) \
+  X(glBindBufferBase) \
+  X(glBindBufferRange) \
+  X(glBindFramebuffer) \
+  X(glBindVertexArray) \
+  X(glColorMaski) \
+  X(glDeleteFramebuffers) \
+  X(glDeleteVertexArrays) \
+  X(glDisablei) \
+  X(glEnablei)
+#else
+#define STATE_CACHE_CALLS_30(X)
+#endif
+
+#if GL_DISPATCH_VERSION >= 33
+#define STATE_CACHE_CALLS_33(X) \
+  X(glBindSampler) \
+  X(glDeleteSamplers)
+#else
+#define STATE_CACHE_CALLS_33(X)
+#endif
+
+#if GL_DISPATCH_VERSION >= 40
+#define STATE_CACHE_CALLS_40(X) \
+  X(glBlendEquationSeparatei) \
+  X(glBlendEquationi) \
+  X(glBlendFuncSeparatei) \
+  X(glBlendFunci)
+#else
+#define STATE_CACHE_CALLS_40(X)
+#endif
+
+#if GL_DISPATCH_VERSION >= 41
+#define STATE_CACHE_CALLS_41(X) \
+  X(glClearDepthf) \
+  X(glScissorArrayv) \
+  X(glScissorIndexed) \
+  X(glScissorIndexedv) \
+  X(glViewportArrayv) \
+  X(glViewportIndexedf) \
+  X(glViewportIndexedfv)
+#else
+#define STATE_CACHE_CALLS_41(X)
+#endif
+
+#if GL_DISPATCH_VERSION >= 44
+#define STATE_CACHE_CALLS_44(X) \
+  X(glBindBuffersBase) \
+  X(glBindBuffersRange) \
+  X(glBindSamplers) \
+  X(glBindTextures)
+#else
+#define STATE_CACHE_CALLS_44(X)
+#endif
+
+#if GL_DISPATCH_VERSION >= 45
+#define STATE_CACHE_CALLS_45(X) X(glBindTextureUnit)
+#else
+#define STATE_CACHE_CALLS_45(X)
+#endif
+
+// With lazy binding the slot may still hold its trampoline, which would
+// patch the slot over the wrapper on its first call.
+template<typename Pfn>
+static void Resolve(Pfn& slot) noexcept
+{
+  const auto i{static_cast<std::size_t>(reinterpret_cast<GlProc*>(&slot)
+                                        - reinterpret_cast<GlProc*>(&gl))};
+
+  if (reinterpret_cast<GlProc>(slot) == glDispatchTrampolines[i]) {
+    GlResolveLazy(i);
+  }
+}
+
+template<typename Pfn>
+static void Patch(Pfn& slot, Pfn cached) noexcept
+{
+  if (slot) {
+    slot = cached;
+  }
+}
+
+void InstallStateCache() noexcept
+{
+#define RESOLVE(fn) Resolve(gl.fn);
+#define PATCH(fn) Patch(gl.fn, &Cached_##fn);
+
+  STATE_CACHE_CALLS(RESOLVE)
+  driver = gl;
+  STATE_CACHE_CALLS(PATCH)
+
+#undef PATCH
+#undef RESOLVE
+
+  ResetStateCache();
+}
+
+void ResetStateCache() noexcept
+{
+  const auto stats{cache.stats};
+
+  cache       = {};
+  cache.stats = stats;
+}
+
+StateCacheStats TakeStateCacheStats() noexcept
+{
+  const auto stats{cache.stats};
+
+  cache.stats = {};
+
+  return stats;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+// Shadow copy of the GL state that is cheap to compare: bound program,
+// vertex array, buffers per target, textures and samplers per unit,
+// framebuffers, capabilities, blend, depth, stencil and raster state,
+// clear values, viewport and scissor. Installing it patches the dispatch
+// table so that calls setting a state to its current value are skipped.
+// Deleting objects and calls that change the state in ways the cache does
+// not track forget the affected values, so the cache never skips a call
+// that would have changed anything.
+//
+// GL state belongs to a context and a context to a thread, so every
+// thread has its own cache, starting out empty.
+
+// Must follow every LoadGl, the context must be current.
+void InstallStateCache() noexcept;
+// Forgets everything cached on the calling thread, e.g. after foreign code
+// changed the state.
+void ResetStateCache() noexcept;
+
+struct StateCacheStats {
+  std::uint32_t issued; // Calls passed on to the driver.
+  std::uint32_t elided; // Calls skipped as redundant.
+};
+
+// Counts of the calling thread since the previous call.
+StateCacheStats TakeStateCacheStats() noexcept;
@@ -0,0 +1,184 @@
+#include "stream_buffer.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+bool StreamBuffer::Init(std::size_t bytesPerFrame, int regions) noexcept
+{
+  constexpr GLbitfield persistentFlags{
+    GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT};
+
+  GLint uniformAlignment{0};
+  GLint storageAlignment{0};
+
+  Release();
+
+  if (glVersion < 30) {
+    Log("stream buffer: disabled, needs OpenGL 3.0");
+    return false;
+  }
+
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+  if (glVersion >= 43) {
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT,
+                  &storageAlignment);
+  }
+
+  // All of them are powers of two.
+  m_offsetAlignment = std::max({static_cast<std::size_t>(uniformAlignment),
+                                static_cast<std::size_t>(storageAlignment),
+                                alignof(std::max_align_t)});
+
+  const auto regionCount{std::clamp(regions, 1, maxRegions)};
+
+  m_bPersistent = GL_DISPATCH_VERSION >= 44 && glVersion >= 44;
+  m_regions     = m_bPersistent ? static_cast<std::size_t>(regionCount) : 1;
+  m_regionSize  = (bytesPerFrame + m_offsetAlignment - 1)
+                 & ~(m_offsetAlignment - 1);
+
+  const auto size{static_cast<GLsizeiptr>(m_regionSize * m_regions)};
+
+  glGenBuffers(1, &m_buffer);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+
+  if (m_bPersistent) {
+#if GL_DISPATCH_VERSION >= 44
+    glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, persistentFlags);
+#endif
+    m_pMapped = static_cast<std::byte*>(
+      glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, persistentFlags));
+    if (!m_pMapped) {
+      Log("stream buffer: failed to map %zu KiB",
+          m_regionSize * m_regions / 1024);
+      Release();
+      return false;
+    }
+  }
+  else {
+    glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+  }
+
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  Log("stream buffer: %zu region(s) of %zu KiB, %s",
+      m_regions,
+      m_regionSize / 1024,
+      m_bPersistent ? "persistently mapped" : "orphaned every frame");
+
+  return true;
+}
+
+void StreamBuffer::Release() noexcept
+{
+  for (auto& fence : m_fences) {
+    if (fence) {
+      glDeleteSync(fence);
+      fence = nullptr;
+    }
+  }
+
+  if (m_buffer) {
+    // Deleting a buffer unmaps it.
+    glDeleteBuffers(1, &m_buffer);
+    m_buffer = 0;
+  }
+
+  m_pMapped = nullptr;
+  m_pRegion = nullptr;
+  m_frame   = 0;
+}
+
+void StreamBuffer::BeginFrame() noexcept
+{
+  if (!m_buffer) {
+    return;
+  }
+
+  m_used.store(0, std::memory_order_relaxed);
+
+  if (!m_bPersistent) {
+    // Orphaning hands the driver a fresh store while the GPU may still
+    // read the old one, so mapping it need not synchronize.
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER,
+                 static_cast<GLsizeiptr>(m_regionSize),
+                 nullptr,
+                 GL_STREAM_DRAW);
+    m_pRegion = static_cast<std::byte*>(
+      glMapBufferRange(GL_COPY_WRITE_BUFFER,
+                       0,
+                       static_cast<GLsizeiptr>(m_regionSize),
+                       GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT
+                         | GL_MAP_UNSYNCHRONIZED_BIT));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    m_regionOffset = 0;
+    return;
+  }
+
+  const auto region{m_frame % m_regions};
+  auto&      fence{m_fences[region]};
+
+  if (fence) {
+    GLbitfield flags{GL_SYNC_FLUSH_COMMANDS_BIT};
+    GLenum     result{GL_TIMEOUT_EXPIRED};
+
+    do {
+      result = glClientWaitSync(fence, flags, 100'000'000);
+      flags  = 0;
+    } while (GL_TIMEOUT_EXPIRED == result);
+
+    glDeleteSync(fence);
+    fence = nullptr;
+  }
+
+  m_regionOffset = static_cast<GLintptr>(region * m_regionSize);
+  m_pRegion      = m_pMapped + m_regionOffset;
+}
+
+void StreamBuffer::Commit() noexcept
+{
+  if (m_bPersistent || !m_pRegion) {
+    return;
+  }
+
+  glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+  glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  m_pRegion = nullptr;
+}
+
+void StreamBuffer::EndFrame() noexcept
+{
+  if (!m_buffer) {
+    return;
+  }
+
+  Commit();
+
+  if (m_bPersistent) {
+    m_fences[m_frame % m_regions] =
+      glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+
+  m_pRegion = nullptr;
+  ++m_frame;
+}
+
+StreamAllocation StreamBuffer::Allocate(std::size_t size,
+                                        std::size_t alignment) noexcept
+{
+  // Regions start aligned to the offset alignment, so aligning offsets
+  // within the region aligns both the pointer and the buffer offset.
+  const auto reserved{size + alignment - 1};
+  const auto used{m_used.fetch_add(reserved, std::memory_order_relaxed)};
+
+  if (!m_pRegion || used > m_regionSize || m_regionSize - used < reserved) {
+    return {nullptr, 0};
+  }
+
+  const auto offset{(used + alignment - 1) & ~(alignment - 1)};
+
+  return {m_pRegion + offset,
+          m_regionOffset + static_cast<GLintptr>(offset)};
+}
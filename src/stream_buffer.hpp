@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+#include "gl.hpp"
+
+// A region of the stream buffer written by the CPU this frame.
+struct StreamAllocation {
+  void*    pData;  // Null if the frame's region is exhausted.
+  GLintptr offset; // Into Name(), e.g. for glBindBufferRange.
+};
+
+// Ring of per-frame regions in one buffer object for vertex and uniform
+// data that changes every frame. With OpenGL 4.4 the buffer is mapped
+// once, persistently and coherently, and every region is fenced so it is
+// only rewritten after the GPU read it. Older contexts orphan and map the
+// buffer every frame instead, which leaves the renaming to the driver.
+// Either way no data goes through glBufferSubData.
+class StreamBuffer {
+public:
+  static constexpr int maxRegions{4};
+
+  StreamBuffer() noexcept = default;
+  StreamBuffer(const StreamBuffer&) = delete;
+  StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+  // Needs OpenGL 3.0 for glMapBufferRange.
+  bool Init(std::size_t bytesPerFrame, int regions) noexcept;
+  // Unmaps and deletes the buffer, needs the context to be current.
+  void Release() noexcept;
+
+  // Waits until the GPU is done with the next region and maps it.
+  void BeginFrame() noexcept;
+  // Unmaps the region unless it is mapped persistently, call once the
+  // frame's data is written and before the draw calls reading it.
+  void Commit() noexcept;
+  // Fences the region, call after the frame's draw calls.
+  void EndFrame() noexcept;
+
+  // Any thread may allocate between BeginFrame and Commit, the offset is
+  // atomic. Alignment must be a power of two up to OffsetAlignment().
+  StreamAllocation Allocate(std::size_t size, std::size_t alignment) noexcept;
+
+  GLuint Name() const noexcept
+  {
+    return m_buffer;
+  }
+  // Valid for uniform and shader storage buffer bindings alike.
+  std::size_t OffsetAlignment() const noexcept
+  {
+    return m_offsetAlignment;
+  }
+
+private:
+  GLuint                   m_buffer{0};
+  bool                     m_bPersistent{false};
+  std::byte*               m_pMapped{nullptr}; // Whole buffer if persistent.
+  std::byte*               m_pRegion{nullptr};
+  GLintptr                 m_regionOffset{0};
+  std::size_t              m_regionSize{0};
+  std::size_t              m_regions{0};
+  std::size_t              m_frame{0};
+  std::atomic<std::size_t> m_used{0};
+  std::size_t              m_offsetAlignment{256};
+  GLsync                   m_fences[maxRegions]{};
+};
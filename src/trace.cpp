@@ -0,0 +1,202 @@
+#include "trace.hpp"
+#include "log.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace {
+
+struct TraceEvent {
+  const char*   name;
+  std::uint64_t begin; // TraceNow ticks, GPU nanoseconds for GPU zones.
+  std::uint64_t end;
+  bool          bGpu;
+};
+
+struct TraceBuffer {
+  static constexpr std::size_t capacity{std::size_t{1} << 16};
+
+  const char*                name{nullptr};
+  std::uint32_t              tid{0};
+  std::atomic<std::uint64_t> count{0};
+  TraceEvent                 events[capacity];
+};
+
+struct TraceClock {
+  std::uint64_t                         ticks;
+  std::chrono::steady_clock::time_point time;
+};
+
+} // namespace
+
+bool traceEnabled{false};
+
+static std::mutex                                traceMutex;
+static std::vector<std::unique_ptr<TraceBuffer>> traceBuffers;
+static TraceClock                                traceStart{};
+static std::int64_t                              traceGpuNs{0};
+static std::uint64_t                             traceGpuTicks{0};
+static thread_local TraceBuffer*                 pTraceBuffer{nullptr};
+
+// Registering takes a lock, but only on the first event of every thread.
+static TraceBuffer* GetTraceBuffer() noexcept
+{
+  if (!pTraceBuffer) {
+    const std::lock_guard lock{traceMutex};
+
+    try {
+      auto buffer{std::make_unique<TraceBuffer>()};
+      buffer->tid = static_cast<std::uint32_t>(traceBuffers.size() + 1);
+      traceBuffers.push_back(std::move(buffer));
+      pTraceBuffer = traceBuffers.back().get();
+    }
+    catch (const std::bad_alloc&) {
+      return nullptr;
+    }
+  }
+
+  return pTraceBuffer;
+}
+
+static void Record(const TraceEvent& event) noexcept
+{
+  if (const auto pBuffer{GetTraceBuffer()}) {
+    const auto count{pBuffer->count.load(std::memory_order_relaxed)};
+
+    pBuffer->events[count & (TraceBuffer::capacity - 1)] = event;
+    pBuffer->count.store(count + 1, std::memory_order_release);
+  }
+}
+
+void StartTrace() noexcept
+{
+  traceStart   = {TraceNow(), std::chrono::steady_clock::now()};
+  traceEnabled = true;
+}
+
+void SetTraceThreadName(const char* name) noexcept
+{
+  if (!traceEnabled) {
+    return;
+  }
+
+  if (const auto pBuffer{GetTraceBuffer()}) {
+    pBuffer->name = name;
+  }
+}
+
+void RecordTraceZone(const char*   name,
+                     std::uint64_t begin,
+                     std::uint64_t end) noexcept
+{
+  Record({name, begin, end, false});
+}
+
+void SetTraceGpuClock(std::int64_t gpuNs, std::uint64_t now) noexcept
+{
+  traceGpuNs    = gpuNs;
+  traceGpuTicks = now;
+}
+
+void RecordTraceGpuZone(const char*  name,
+                        std::int64_t beginNs,
+                        std::int64_t endNs) noexcept
+{
+  if (traceEnabled) {
+    Record({name,
+            static_cast<std::uint64_t>(beginNs),
+            static_cast<std::uint64_t>(endNs),
+            true});
+  }
+}
+
+static void WriteJsonString(std::ostream& stream, const char* string)
+{
+  stream << '"';
+  for (auto c{string}; *c; ++c) {
+    if ('"' == *c || '\\' == *c) {
+      stream << '\\';
+    }
+    stream << *c;
+  }
+  stream << '"';
+}
+
+bool WriteTrace(const std::filesystem::path& path) noexcept
+{
+  const std::lock_guard lock{traceMutex};
+  std::ofstream         file{path, std::ios::trunc};
+  std::uint64_t         nEvents{0};
+  std::uint64_t         nLost{0};
+
+  // Calibrate the ticks against the steady clock over the whole trace.
+  const auto ticks{TraceNow() - traceStart.ticks};
+  const std::chrono::duration<double, std::micro> elapsed{
+    std::chrono::steady_clock::now() - traceStart.time};
+  const auto usPerTick{ticks ? elapsed.count() / ticks : 0.0};
+
+  const auto toMicroseconds{[&](std::uint64_t value) {
+    return static_cast<double>(
+             static_cast<std::int64_t>(value - traceStart.ticks))
+           * usPerTick;
+  }};
+  const auto gpuToMicroseconds{[&](std::uint64_t ns) {
+    return toMicroseconds(traceGpuTicks)
+           + static_cast<double>(static_cast<std::int64_t>(ns) - traceGpuNs)
+               / 1e3;
+  }};
+
+  file << std::fixed << std::setprecision(3)
+       << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+       << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+       << "\"args\":{\"name\":\"polychrome\"}},\n"
+       << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+       << "\"args\":{\"name\":\"GPU\"}}";
+
+  for (const auto& buffer : traceBuffers) {
+    const auto count{buffer->count.load(std::memory_order_acquire)};
+    const auto first{count > TraceBuffer::capacity
+                       ? count - TraceBuffer::capacity
+                       : 0};
+
+    if (buffer->name) {
+      file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+           << "\"tid\":" << buffer->tid << ",\"args\":{\"name\":";
+      WriteJsonString(file, buffer->name);
+      file << "}}";
+    }
+
+    for (auto i{first}; i < count; ++i) {
+      const auto& event{buffer->events[i & (TraceBuffer::capacity - 1)]};
+      const auto  begin{event.bGpu ? gpuToMicroseconds(event.begin)
+                                   : toMicroseconds(event.begin)};
+      const auto  end{event.bGpu ? gpuToMicroseconds(event.end)
+                                 : toMicroseconds(event.end)};
+
+      file << ",\n{\"name\":";
+      WriteJsonString(file, event.name);
+      file << ",\"ph\":\"X\",\"pid\":1,\"tid\":"
+           << (event.bGpu ? 0 : buffer->tid) << ",\"ts\":" << begin
+           << ",\"dur\":" << end - begin << '}';
+    }
+
+    nEvents += count - first;
+    nLost += first;
+  }
+
+  file << "\n]}\n";
+  file.close();
+
+  Log("trace: %llu event(s) written, %llu overwritten",
+      static_cast<unsigned long long>(nEvents),
+      static_cast<unsigned long long>(nLost));
+
+  return static_cast<bool>(file);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define POLYCHROME_TRACE_TSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define POLYCHROME_TRACE_TSC
+#else
+#include <chrono>
+#endif
+
+// Zone tracing exported as Chrome Trace Event JSON, which chrome://tracing
+// and ui.perfetto.dev open. Zones are timed with the TSC, assumed to be
+// invariant, and each thread appends to its own ring of events, so the
+// hot path takes no locks. The rings keep the latest events only.
+
+// Set by StartTrace before any thread records.
+extern bool traceEnabled;
+
+inline std::uint64_t TraceNow() noexcept
+{
+#ifdef POLYCHROME_TRACE_TSC
+  return __rdtsc();
+#else
+  return static_cast<std::uint64_t>(
+    std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+void StartTrace() noexcept;
+// Names the calling thread in the trace.
+void SetTraceThreadName(const char* name) noexcept;
+void RecordTraceZone(const char*   name,
+                     std::uint64_t begin,
+                     std::uint64_t end) noexcept;
+
+// Pairs a GL_TIMESTAMP with TraceNow so that GPU zones, which are timed
+// in GPU nanoseconds, line up with the CPU zones.
+void SetTraceGpuClock(std::int64_t gpuNs, std::uint64_t now) noexcept;
+void RecordTraceGpuZone(const char*  name,
+                        std::int64_t beginNs,
+                        std::int64_t endNs) noexcept;
+
+// Must not race with recording threads, i.e. call it after joining them.
+bool WriteTrace(const std::filesystem::path& path) noexcept;
+
+// Records the enclosing block as a zone.
+class TraceZone {
+public:
+  explicit TraceZone(const char* name) noexcept :
+    m_name{traceEnabled ? name : nullptr},
+    m_begin{traceEnabled ? TraceNow() : 0}
+  {
+  }
+  TraceZone(const TraceZone&) = delete;
+  TraceZone& operator=(const TraceZone&) = delete;
+  ~TraceZone()
+  {
+    if (m_name) {
+      RecordTraceZone(m_name, m_begin, TraceNow());
+    }
+  }
+
+private:
+  const char*   m_name;
+  std::uint64_t m_begin;
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Chase-Lev deque of pointers with a fixed capacity, as formulated for the
+// C11 memory model by Lê et al. The owner thread pushes and pops at the
+// bottom, any other thread steals from the top, and only a contended last
+// item costs a compare-and-swap.
+template<typename T, std::size_t Capacity>
+class WorkStealingDeque {
+  static_assert(0 != Capacity && 0 == (Capacity & (Capacity - 1)),
+                "Capacity must be a power of two");
+
+public:
+  // Owner side, false if the deque is full.
+  bool Push(T* pItem) noexcept
+  {
+    const auto bottom{m_bottom.load(std::memory_order_relaxed)};
+    const auto top{m_top.load(std::memory_order_acquire)};
+
+    if (bottom - top >= static_cast<std::int64_t>(Capacity)) {
+      return false;
+    }
+
+    m_items[bottom & (Capacity - 1)].store(pItem, std::memory_order_relaxed);
+    m_bottom.store(bottom + 1, std::memory_order_release);
+
+    return true;
+  }
+
+  // Owner side, the most recently pushed item.
+  T* Pop() noexcept
+  {
+    const auto bottom{m_bottom.load(std::memory_order_relaxed) - 1};
+
+    m_bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    auto top{m_top.load(std::memory_order_relaxed)};
+    if (top > bottom) {
+      m_bottom.store(bottom + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+
+    auto pItem{m_items[bottom & (Capacity - 1)].load(
+      std::memory_order_relaxed)};
+    if (top == bottom) {
+      // The last item, thieves may race for it.
+      if (!m_top.compare_exchange_strong(top,
+                                         top + 1,
+                                         std::memory_order_seq_cst,
+                                         std::memory_order_relaxed)) {
+        pItem = nullptr;
+      }
+      m_bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    return pItem;
+  }
+
+  // Any thread, the least recently pushed item. Null if the deque is empty
+  // or another thread won the item.
+  T* Steal() noexcept
+  {
+    auto top{m_top.load(std::memory_order_acquire)};
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const auto bottom{m_bottom.load(std::memory_order_acquire)};
+
+    if (top >= bottom) {
+      return nullptr;
+    }
+
+    const auto pItem{
+      m_items[top & (Capacity - 1)].load(std::memory_order_relaxed)};
+    if (!m_top.compare_exchange_strong(top,
+                                       top + 1,
+                                       std::memory_order_seq_cst,
+                                       std::memory_order_relaxed)) {
+      return nullptr;
+    }
+
+    return pItem;
+  }
+
+private:
+  static constexpr std::size_t cacheLineSize{64};
+
+  alignas(cacheLineSize) std::atomic<std::int64_t> m_top{0};
+  alignas(cacheLineSize) std::atomic<std::int64_t> m_bottom{0};
+  alignas(cacheLineSize) std::atomic<T*> m_items[Capacity]{};
+};
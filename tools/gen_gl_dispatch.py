@@ -0,0 +1,259 @@
+#!/usr/bin/env python3
+"""Generates the OpenGL dispatch table from GL/glcorearb.h.
+
+The table is one contiguous struct of function pointers, grouped by the GL
+version or extension that introduces them, so that the loader can resolve
+only the groups supported by the current context. Calls go through macros
+in the style of glad, e.g. glClear expands to gl.glClear.
+
+Every entry point also gets a trampoline for lazy binding, which resolves
+the real function through GlResolveLazy on the first call and skips calls
+that cannot be resolved.
+"""
+
+import argparse
+import os
+import re
+import sys
+
+FEATURE_RE = re.compile(r'^#ifndef (GL_[A-Za-z0-9_]+)$')
+PROTOTYPE_RE = re.compile(
+    r'^GLAPI (?P<ret>.+?) ?APIENTRY (?P<name>gl\w+) \((?P<params>.*)\);$')
+VERSION_RE = re.compile(r'^GL_VERSION_(\d)_(\d)$')
+
+
+class Feature:
+    def __init__(self, name):
+        self.name = name
+        match = VERSION_RE.match(name)
+        self.version = int(match[1]) * 10 + int(match[2]) if match else 0
+        self.commands = []
+
+
+class Command:
+    def __init__(self, ret, name, params):
+        self.ret = ret
+        self.name = name
+        self.params = params
+
+    @property
+    def pfn(self):
+        return 'PFN' + self.name.upper() + 'PROC'
+
+    @property
+    def args(self):
+        if self.params == 'void':
+            return ''
+        return ', '.join(re.search(r'(\w+)$', param.strip())[1]
+                         for param in self.params.split(','))
+
+
+def parse(path):
+    features = []
+    current = None
+
+    with open(path, encoding='utf-8') as header:
+        for line in header:
+            line = line.rstrip()
+            match = FEATURE_RE.match(line)
+            if match:
+                current = Feature(match[1])
+                features.append(current)
+                continue
+
+            match = PROTOTYPE_RE.match(line)
+            if match:
+                if current is None:
+                    sys.exit(f'{path}: {match["name"]} outside of a feature')
+                current.commands.append(
+                    Command(match['ret'], match['name'], match['params']))
+
+    return [feature for feature in features if feature.commands]
+
+
+def select(features, max_version, extensions):
+    known = {feature.name for feature in features}
+    for extension in extensions:
+        if extension not in known:
+            sys.exit(f'{extension} is not an extension with entry points in '
+                     'glcorearb.h')
+
+    return [
+        feature for feature in features
+        if (feature.version and feature.version <= max_version)
+        or feature.name in extensions
+    ]
+
+
+def write_if_changed(path, text):
+    try:
+        with open(path, encoding='utf-8', newline='') as existing:
+            if existing.read() == text:
+                return
+    except FileNotFoundError:
+        pass
+
+    with open(path, 'w', encoding='utf-8', newline='') as output:
+        output.write(text)
+
+
+def generate_header(features, max_version):
+    count = sum(len(feature.commands) for feature in features)
+    lines = [
+        '// Generated by tools/gen_gl_dispatch.py from GL/glcorearb.h, do not',
+        '// edit.',
+        '#pragma once',
+        '',
+        '#include <cstddef>',
+        '#include <cstdint>',
+        '',
+        '#include <GL/glcorearb.h>',
+        '',
+        '// Highest GL version in the table, e.g. 46, for code that uses',
+        '// entry points of newer versions.',
+        f'#define GL_DISPATCH_VERSION {max_version}',
+        '',
+        'struct GlDispatch {',
+    ]
+
+    for i, feature in enumerate(features):
+        if i:
+            lines.append('')
+        lines.append(f'  // {feature.name}')
+        for command in feature.commands:
+            lines.append(f'  {command.pfn} {command.name};')
+
+    lines += [
+        '};',
+        '',
+        '// Entry points introduced by one GL version or extension, a',
+        '// contiguous run of slots in GlDispatch.',
+        'struct GlDispatchFeature {',
+        '  const char*   name;',
+        '  int           version;   // E.g. 43, zero for extensions.',
+        '  std::uint64_t extension; // HashExtension(name) for extensions.',
+        '  std::uint16_t first;',
+        '  std::uint16_t count;',
+        '};',
+        '',
+        f'constexpr std::size_t glDispatchSize{{{count}}};',
+        f'constexpr std::size_t glDispatchFeatureCount{{{len(features)}}};',
+        '',
+        'extern const char* const       glDispatchNames[glDispatchSize];',
+        'extern const GlDispatchFeature '
+        'glDispatchFeatures[glDispatchFeatureCount];',
+        '',
+        '// Trampolines that resolve their slot on the first call.',
+        'extern void (*const glDispatchTrampolines[glDispatchSize])();',
+        '',
+        '// Resolves and patches the given slot, defined by the loader. Null',
+        '// if the entry point cannot be resolved, the slot keeps the',
+        '// trampoline then.',
+        'void (*GlResolveLazy(std::size_t slot) noexcept)();',
+        '',
+        'extern GlDispatch gl;',
+        '',
+    ]
+
+    for feature in features:
+        for command in feature.commands:
+            lines.append(f'#define {command.name} gl.{command.name}')
+
+    return '\n'.join(lines) + '\n'
+
+
+def generate_source(features):
+    lines = [
+        '// Generated by tools/gen_gl_dispatch.py from GL/glcorearb.h, do not',
+        '// edit.',
+        '#include "gl_dispatch.hpp"',
+        '',
+        '#include "extensions.hpp"',
+        '',
+        'static_assert(sizeof(GlDispatch)',
+        '              == glDispatchSize * sizeof(void (*)()));',
+        '',
+        'const char* const glDispatchNames[glDispatchSize]{',
+    ]
+
+    for feature in features:
+        for command in feature.commands:
+            lines.append(f'  "{command.name}",')
+
+    lines += [
+        '};',
+        '',
+        'const GlDispatchFeature glDispatchFeatures[glDispatchFeatureCount]{',
+    ]
+
+    first = 0
+    for feature in features:
+        extension = f'"{feature.name}"_ext' if not feature.version else '0'
+        lines.append(f'  {{"{feature.name}", {feature.version}, {extension}, '
+                     f'{first}, {len(feature.commands)}}},')
+        first += len(feature.commands)
+
+    lines += [
+        '};',
+        '',
+    ]
+
+    slot = 0
+    for feature in features:
+        for command in feature.commands:
+            # Entry points that fail to resolve are skipped, calls of
+            # functions with results yield zero.
+            lines += [
+                f'static {command.ret} APIENTRY Lazy_{command.name}'
+                f'({command.params})',
+                '{',
+                f'  if (const auto proc{{reinterpret_cast<{command.pfn}>('
+                f'GlResolveLazy({slot}))}}) {{',
+                f'    return proc({command.args});',
+                '  }',
+            ]
+            if command.ret.strip() != 'void':
+                lines.append('  return {};')
+            lines += [
+                '}',
+                '',
+            ]
+            slot += 1
+
+    lines.append('void (*const glDispatchTrampolines[glDispatchSize])(){')
+    for feature in features:
+        for command in feature.commands:
+            lines.append(
+                f'  reinterpret_cast<void (*)()>(&Lazy_{command.name}),')
+    lines.append('};')
+
+    return '\n'.join(lines) + '\n'
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('header', help='path to GL/glcorearb.h')
+    parser.add_argument('--version', default='4.6',
+                        help='highest GL version to include, e.g. 4.6')
+    parser.add_argument('--extensions', default='',
+                        help='comma separated extensions to include')
+    parser.add_argument('--output-dir', required=True)
+    args = parser.parse_args()
+
+    match = re.fullmatch(r'(\d)\.(\d)', args.version)
+    if not match:
+        sys.exit(f'invalid GL version {args.version}')
+
+    extensions = [name for name in args.extensions.split(',') if name]
+    max_version = int(match[1]) * 10 + int(match[2])
+    features = select(parse(args.header), max_version, extensions)
+
+    os.makedirs(args.output_dir, exist_ok=True)
+    write_if_changed(os.path.join(args.output_dir, 'gl_dispatch.hpp'),
+                     generate_header(features, max_version))
+    write_if_changed(os.path.join(args.output_dir, 'gl_dispatch.cpp'),
+                     generate_source(features))
+
+
+if __name__ == '__main__':
+    main()